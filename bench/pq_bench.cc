@@ -0,0 +1,533 @@
+// Mikrobenchmarki wszystkich publicznych operacji PriorityQueue
+//
+// budowa:       cmake -S bench -B build/bench && cmake --build build/bench
+// uruchomienie: build/bench/pq_bench --benchmark_format=json --benchmark_out=bench.json
+//
+// każdy benchmark ma dwa argumenty: liczbę par w kolejce i odsetek duplikatów
+// (jaka część wstawianych par jest równa parze już wstawionej)
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "priorityqueue.hh"
+
+
+namespace
+{
+	// duży typ klucza i wartości: porównania po pierwszym słowie, kopia 256 bajtów
+	struct large
+	{
+		std::array<std::uint64_t, 32> words;
+
+		friend bool operator==(const large& a, const large& b)
+		{
+			return a.words[0] == b.words[0];
+		}
+
+		friend bool operator<(const large& a, const large& b)
+		{
+			return a.words[0] < b.words[0];
+		}
+	};
+
+	template<typename T>
+	T make(std::uint64_t x);
+
+	template<>
+	int make<int>(std::uint64_t x)
+	{
+		return static_cast<int>(x);
+	}
+
+	template<>
+	unsigned make<unsigned>(std::uint64_t x)
+	{
+		return static_cast<unsigned>(x);
+	}
+
+	template<>
+	std::string make<std::string>(std::uint64_t x)
+	{
+		//wspólny prefiks, żeby porównania nie kończyły się na pierwszym znaku
+		return "priority-queue-benchmark-key-" + std::to_string(x);
+	}
+
+	template<>
+	large make<large>(std::uint64_t x)
+	{
+		large result;
+		result.words.fill(x);
+		return result;
+	}
+
+	// n par, z których duplicates procent powtarza wcześniejsze
+	template<typename K, typename V>
+	std::vector<std::pair<K, V>> makePairs(std::size_t n, int duplicates, unsigned seed)
+	{
+		std::mt19937_64 random(seed);
+		std::size_t distinct = std::max<std::size_t>(1, n * (100 - duplicates) / 100);
+		std::vector<std::pair<K, V>> pool;
+		pool.reserve(distinct);
+		for (std::size_t i = 0; i < distinct; ++i)
+			pool.emplace_back(make<K>(random() % (4 * n + 1)), make<V>(random() % (4 * n + 1)));
+
+		std::vector<std::pair<K, V>> result(pool);
+		result.reserve(n);
+		while (result.size() < n)
+			result.push_back(pool[random() % distinct]);
+		std::shuffle(result.begin(), result.end(), random);
+		return result;
+	}
+
+	template<typename Q>
+	Q makeQueue(const std::vector<std::pair<typename Q::key_type, typename Q::value_type>>& pairs)
+	{
+		Q queue;
+		for (const auto& p : pairs)
+			queue.insert(p.first, p.second);
+		return queue;
+	}
+
+	template<typename Q>
+	std::vector<std::pair<typename Q::key_type, typename Q::value_type>> pairsFor(
+			const benchmark::State& state, unsigned seed = 1)
+	{
+		return makePairs<typename Q::key_type, typename Q::value_type>(
+				static_cast<std::size_t>(state.range(0)), static_cast<int>(state.range(1)), seed);
+	}
+
+	void finish(benchmark::State& state)
+	{
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+
+	template<typename Q>
+	void BM_Insert(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		for (auto _ : state)
+		{
+			Q queue;
+			for (const auto& p : pairs)
+				queue.insert(p.first, p.second);
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_DeleteMin(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			Q queue = makeQueue<Q>(pairs);
+			state.ResumeTiming();
+			while (!queue.empty())
+				queue.deleteMin();
+		}
+		finish(state);
+	}
+
+	// kolejka zdarzeń (symulacja, algorytm Dijkstry): n razy deleteMin i wstawienie usuniętego klucza
+	// z wartością większą o losowy przyrost, w kolejce n par
+	template<typename Q>
+	void BM_Monotone(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		auto steps = pairsFor<Q>(state, 2);
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			Q queue = makeQueue<Q>(pairs);
+			state.ResumeTiming();
+			for (const auto& step : steps)
+			{
+				auto key = queue.minKey();
+				auto value = queue.minValue();
+				queue.deleteMin();
+				queue.insert(key, value + step.second);
+			}
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_DeleteMax(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			Q queue = makeQueue<Q>(pairs);
+			state.ResumeTiming();
+			while (!queue.empty())
+				queue.deleteMax();
+		}
+		finish(state);
+	}
+
+	// n zmian wartości dla kluczy obecnych w kolejce
+	template<typename Q>
+	void BM_ChangeValue(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		auto updates = pairsFor<Q>(state, 2);
+		Q queue = makeQueue<Q>(pairs);
+		for (auto _ : state)
+		{
+			for (std::size_t i = 0; i < pairs.size(); ++i)
+				queue.changeValue(pairs[i].first, updates[i].second);
+			benchmark::ClobberMemory();
+		}
+		finish(state);
+	}
+
+	// ranking 100 par o największych wartościach spośród n wstawianych
+	template<typename Q>
+	void BM_InsertKeepingLargest(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		for (auto _ : state)
+		{
+			Q queue;
+			for (const auto& p : pairs)
+				queue.insertKeepingLargest(p.first, p.second, 100);
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+	// przejście po parach o wartościach z przedziału obejmującego około połowy par
+	template<typename Q>
+	void BM_RangeByValue(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		Q queue = makeQueue<Q>(pairs);
+		auto lo = make<typename Q::value_type>(state.range(0));
+		auto hi = make<typename Q::value_type>(3 * state.range(0));
+		for (auto _ : state)
+		{
+			std::size_t count = 0;
+			for (const auto& p : queue.rangeByValue(lo, hi))
+			{
+				benchmark::DoNotOptimize(p.first);
+				++count;
+			}
+			benchmark::DoNotOptimize(count);
+		}
+		finish(state);
+	}
+
+	// scalenie dwóch kolejek po n par
+	template<typename Q>
+	void BM_Merge(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		auto other_pairs = pairsFor<Q>(state, 2);
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			Q queue = makeQueue<Q>(pairs);
+			Q other = makeQueue<Q>(other_pairs);
+			state.ResumeTiming();
+			queue.merge(other);
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+	// zapis kolejki do strumienia i odtworzenie jej z niego
+	template<typename Q>
+	void BM_Serialize(benchmark::State& state)
+	{
+		Q queue = makeQueue<Q>(pairsFor<Q>(state));
+		for (auto _ : state)
+		{
+			std::stringstream stream;
+			queue.serialize(stream);
+			Q copy = Q::deserialize(stream);
+			benchmark::DoNotOptimize(copy.size());
+		}
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_Copy(benchmark::State& state)
+	{
+		Q queue = makeQueue<Q>(pairsFor<Q>(state));
+		for (auto _ : state)
+		{
+			Q copy(queue);
+			benchmark::DoNotOptimize(copy.size());
+		}
+		finish(state);
+	}
+
+	// porównanie równych kolejek - pesymistyczny przypadek, przechodzi obie do końca
+	template<typename Q>
+	void BM_Equal(benchmark::State& state)
+	{
+		Q queue = makeQueue<Q>(pairsFor<Q>(state));
+		Q copy(queue);
+		for (auto _ : state)
+			benchmark::DoNotOptimize(queue == copy);
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_Less(benchmark::State& state)
+	{
+		Q queue = makeQueue<Q>(pairsFor<Q>(state));
+		Q copy(queue);
+		for (auto _ : state)
+			benchmark::DoNotOptimize(queue < copy);
+		finish(state);
+	}
+
+	// konstruktor z zakresu, kopia i merge z PriorityQueueParallel na state.range(2) wątkach
+	// (1 - sekwencyjnie, dla porównania)
+	template<typename Q>
+	void BM_ParallelBuild(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		PriorityQueueParallel parallel(static_cast<unsigned>(state.range(2)));
+		for (auto _ : state)
+		{
+			Q queue(parallel, pairs.begin(), pairs.end());
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_ParallelCopy(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		Q queue(pairs.begin(), pairs.end());
+		PriorityQueueParallel parallel(static_cast<unsigned>(state.range(2)));
+		for (auto _ : state)
+		{
+			Q copy(parallel, queue);
+			benchmark::DoNotOptimize(copy.size());
+		}
+		finish(state);
+	}
+
+	template<typename Q>
+	void BM_ParallelMerge(benchmark::State& state)
+	{
+		auto pairs = pairsFor<Q>(state);
+		auto other_pairs = pairsFor<Q>(state, 2);
+		PriorityQueueParallel parallel(static_cast<unsigned>(state.range(2)));
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			Q queue(pairs.begin(), pairs.end());
+			Q other(other_pairs.begin(), other_pairs.end());
+			state.ResumeTiming();
+			queue.merge(parallel, other);
+			benchmark::DoNotOptimize(queue.size());
+		}
+		finish(state);
+	}
+
+
+	struct heap_policy : PriorityQueueDefaultPolicy
+	{
+		typedef PriorityQueueHeapEngine<4> engine;
+	};
+
+	struct cow_policy : PriorityQueueDefaultPolicy
+	{
+		typedef PriorityQueueCopyOnWriteEngine<> engine;
+	};
+
+	struct lazy_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool lazy_deletion = true;
+	};
+
+	// koszt liczników (porównań, alokacji i czasu każdej operacji) względem tree_int
+	struct stats_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool collect_stats = true;
+	};
+
+	// kopiec parujący: operacje na maksimum są liniowe, więc bez PQ_BENCH_ALL
+	struct pairing_policy : PriorityQueueDefaultPolicy
+	{
+		typedef PriorityQueuePairingEngine engine;
+	};
+
+	// indeks haszujący po kluczu zamiast drzewa po kluczu
+	struct hash_policy : PriorityQueueDefaultPolicy
+	{
+		typedef PriorityQueueHashEngine<> engine;
+	};
+
+	// kubełki pozycyjne dla całkowitych wartości bez znaku, z polityką monotone
+	// (bez PQ_BENCH_ALL: operacje na maksimum przeglądają najstarszy kubełek)
+	typedef PriorityQueueMonotonePolicy radix_policy;
+
+	// klucze porównywane jednym wywołaniem std::string::compare, z zapamiętanymi w węzłach 8 bajtami
+	// klucza po wspólnym prefiksie make<std::string> (zgodnymi z porządkiem, bo prefiks jest wspólny)
+	struct string_compare
+	{
+		int operator()(const std::string& a, const std::string& b) const noexcept
+		{
+			return a.compare(b);
+		}
+	};
+
+	struct string_prefix
+	{
+		std::uint64_t operator()(const std::string& key) const noexcept
+		{
+			const std::size_t skip = sizeof("priority-queue-benchmark-key-") - 1;
+			std::uint64_t prefix = 0;
+			for (std::size_t i = skip; i < skip + 8; ++i)
+				prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+			return prefix;
+		}
+	};
+
+	struct prefix_policy : PriorityQueueDefaultPolicy
+	{
+		typedef string_compare key_compare;
+		typedef string_compare value_compare;
+		typedef string_prefix key_prefix;
+	};
+
+	// changeValue, insertKeeping* i merge bez kopii zapasowych (std::string może rzucić przy kopiowaniu)
+	struct basic_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool basic_guarantee = true;
+	};
+
+	typedef PriorityQueue<int, int> tree_int;
+	typedef PriorityQueue<std::string, std::string> tree_string;
+	typedef PriorityQueue<large, large> tree_large;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, heap_policy> heap_int;
+	typedef PriorityQueue<std::string, std::string,
+			std::allocator<std::pair<std::string, std::string>>, heap_policy> heap_string;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, cow_policy> cow_int;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, lazy_policy> lazy_int;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, stats_policy> stats_int;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, pairing_policy> pairing_int;
+	typedef PriorityQueue<int, int, std::allocator<std::pair<int, int>>, hash_policy> hash_int;
+	typedef PriorityQueue<std::string, std::string,
+			std::allocator<std::pair<std::string, std::string>>, hash_policy> hash_string;
+	typedef PriorityQueue<std::string, std::string,
+			std::allocator<std::pair<std::string, std::string>>, basic_policy> basic_tree_string;
+	typedef PriorityQueue<std::string, std::string,
+			std::allocator<std::pair<std::string, std::string>>, prefix_policy> prefix_tree_string;
+	typedef PriorityQueue<int, unsigned> tree_uint;
+	typedef PriorityQueue<int, unsigned, std::allocator<std::pair<int, unsigned>>, pairing_policy> pairing_uint;
+	typedef PriorityQueue<int, unsigned, std::allocator<std::pair<int, unsigned>>, radix_policy> radix_uint;
+
+	// rozmiary 2^10 .. 2^16, duplikaty 0%, 50% i 90%
+	void sizes(benchmark::internal::Benchmark* b)
+	{
+		for (int duplicates : {0, 50, 90})
+			for (int n = 1 << 10; n <= 1 << 16; n <<= 3)
+				b->Args({n, duplicates});
+	}
+
+	// operacje PriorityQueueParallel: rozmiary 2^16 .. 2^22, bez duplikatów, na 1, 4 i 16 wątkach
+	void parallelSizes(benchmark::internal::Benchmark* b)
+	{
+		for (int n = 1 << 16; n <= 1 << 22; n <<= 3)
+			for (int threads : {1, 4, 16})
+				b->Args({n, 0, threads});
+	}
+
+	// changeValue w silniku kopcowym jest liniowe, więc mniejsze rozmiary
+	void smallSizes(benchmark::internal::Benchmark* b)
+	{
+		for (int duplicates : {0, 90})
+			b->Args({1 << 10, duplicates});
+	}
+}
+
+
+#define PQ_BENCH_ALL(Q) \
+	BENCHMARK_TEMPLATE(BM_Insert, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_InsertKeepingLargest, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_DeleteMin, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_DeleteMax, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_Merge, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_Copy, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_Equal, Q)->Apply(sizes); \
+	BENCHMARK_TEMPLATE(BM_Less, Q)->Apply(sizes)
+
+PQ_BENCH_ALL(tree_int);
+PQ_BENCH_ALL(tree_string);
+PQ_BENCH_ALL(tree_large);
+PQ_BENCH_ALL(heap_int);
+PQ_BENCH_ALL(heap_string);
+PQ_BENCH_ALL(cow_int);
+PQ_BENCH_ALL(lazy_int);
+PQ_BENCH_ALL(stats_int);
+PQ_BENCH_ALL(hash_int);
+PQ_BENCH_ALL(hash_string);
+PQ_BENCH_ALL(prefix_tree_string);
+
+BENCHMARK_TEMPLATE(BM_ChangeValue, tree_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, tree_large)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, cow_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, lazy_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, stats_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, basic_tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_InsertKeepingLargest, basic_tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Merge, basic_tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, prefix_tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, pairing_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, hash_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, hash_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, heap_int)->Apply(smallSizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, heap_string)->Apply(smallSizes);
+
+BENCHMARK_TEMPLATE(BM_RangeByValue, tree_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RangeByValue, cow_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_RangeByValue, lazy_int)->Apply(sizes);
+
+BENCHMARK_TEMPLATE(BM_Insert, pairing_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_DeleteMin, pairing_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Merge, pairing_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Copy, pairing_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Equal, pairing_int)->Apply(sizes);
+
+BENCHMARK_TEMPLATE(BM_Insert, radix_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_DeleteMin, radix_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_ChangeValue, radix_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Merge, radix_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Copy, radix_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Monotone, tree_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Monotone, pairing_uint)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Monotone, radix_uint)->Apply(sizes);
+
+BENCHMARK_TEMPLATE(BM_Serialize, tree_int)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Serialize, tree_string)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Serialize, heap_int)->Apply(sizes);
+
+BENCHMARK_TEMPLATE(BM_ParallelBuild, tree_int)->Apply(parallelSizes);
+BENCHMARK_TEMPLATE(BM_ParallelBuild, tree_string)->Apply(parallelSizes);
+BENCHMARK_TEMPLATE(BM_ParallelCopy, tree_int)->Apply(parallelSizes);
+BENCHMARK_TEMPLATE(BM_ParallelCopy, tree_string)->Apply(parallelSizes);
+BENCHMARK_TEMPLATE(BM_ParallelMerge, tree_int)->Apply(parallelSizes);
+BENCHMARK_TEMPLATE(BM_ParallelMerge, tree_string)->Apply(parallelSizes);
+
+BENCHMARK_MAIN();
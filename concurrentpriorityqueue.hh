@@ -0,0 +1,529 @@
+#ifndef CONCURRENT_PRIORITY_QUEUE_GUARD
+#define CONCURRENT_PRIORITY_QUEUE_GUARD
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "priorityqueue.hh"
+
+
+// semantyka minimum (i maksimum) w ConcurrentPriorityQueue
+enum class ConcurrentPriorityQueueOrdering
+{
+	// deleteMin usuwa globalnie najmniejszą parę; blokuje po kolei wszystkie kolejki cząstkowe
+	strict,
+	// deleteMin usuwa mniejsze z minimów dwóch losowych kolejek cząstkowych (MultiQueue);
+	// usunięta para jest z dużym prawdopodobieństwem blisko minimum, a wątki rzadko na siebie czekają
+	relaxed
+};
+
+
+// Kolejka dla wielu wątków: pary są rozdzielane po kluczu (Hash) między kolejki cząstkowe
+// PriorityQueue<K, V, Alloc, Policy>, każda pod własnym muteksem, więc insert i changeValue
+// blokują tylko jedną z nich. Operacje na minimum i maksimum zależą od ConcurrentPriorityQueueOrdering.
+// Metody zwracają kopie kluczy i wartości, bo referencja do pary mogłaby się unieważnić
+// zaraz po zwolnieniu blokady. Każda operacja ma takie gwarancje, jak odpowiadająca jej
+// operacja PriorityQueue.
+template<typename K, typename V, typename Hash = std::hash<K>, typename Alloc = std::allocator<std::pair<K, V>>,
+		typename Policy = PriorityQueueDefaultPolicy>
+class ConcurrentPriorityQueue
+{
+public: // public typedefs
+
+	typedef size_t size_type;
+	typedef K key_type;
+	typedef V value_type;
+	typedef PriorityQueue<K, V, Alloc, Policy> queue_type;
+
+private: // members and helpers
+
+	// kolejka cząstkowa; dopełnienie do linii pamięci podręcznej, żeby muteksy sąsiednich
+	// kolejek nie dzieliły jednej linii
+	struct shard
+	{
+		std::mutex lock;
+		queue_type queue;
+		char padding[64];
+
+		explicit shard(const Alloc& alloc) : queue(alloc)
+		{ }
+	};
+
+	typedef std::unique_lock<std::mutex> shard_lock;
+
+	std::vector<std::unique_ptr<shard>> shards;
+	Hash hasher;
+	ConcurrentPriorityQueueOrdering ordering;
+
+	shard& shardFor(const K& key)
+	{
+		return *shards[hasher(key) % shards.size()];
+	}
+
+	// generator liczb losowych wątku, do wyboru kolejek cząstkowych w trybie relaxed
+	static std::minstd_rand& random() noexcept
+	{
+		thread_local std::minstd_rand generator(
+				static_cast<unsigned>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+		return generator;
+	}
+
+	// czy para (ak, av) jest bliżej wymaganego końca (minimum, gdy !max_end) niż (bk, bv)
+	// porządek jak w PriorityQueue: po wartości, potem po kluczu
+	static bool better(const K& ak, const V& av, const K& bk, const V& bv, bool max_end)
+	{
+		if (max_end)
+			return pq_detail::CompBySnd<K, V, false, Policy>::less(bk, bv, ak, av);
+		return pq_detail::CompBySnd<K, V, false, Policy>::less(ak, av, bk, bv);
+	}
+
+	static const K& endKey(const queue_type& queue, bool max_end)
+	{
+		return max_end ? queue.maxKey() : queue.minKey();
+	}
+
+	static const V& endValue(const queue_type& queue, bool max_end)
+	{
+		return max_end ? queue.maxValue() : queue.minValue();
+	}
+
+	// blokuje wszystkie kolejki cząstkowe (zawsze w tej samej kolejności, więc bez zakleszczeń)
+	// i zwraca tę, której minimum (maksimum) jest najlepsze; nullptr, gdy wszystkie są puste
+	shard* lockAllAndFind(std::vector<shard_lock>& locks, bool max_end)
+	{
+		locks.reserve(shards.size());
+		shard* best = nullptr;
+		for (auto& s : shards)
+		{
+			locks.emplace_back(s->lock);
+			if (s->queue.empty())
+				continue;
+			if (best == nullptr || better(endKey(s->queue, max_end), endValue(s->queue, max_end),
+					endKey(best->queue, max_end), endValue(best->queue, max_end), max_end))
+				best = s.get();
+		}
+		return best;
+	}
+
+	// dwie różne losowe kolejki cząstkowe, zablokowane w kolejności adresów; zwraca lepszą z nich
+	// albo nullptr, gdy obie są puste
+	shard* lockTwoAndFind(shard_lock& first, shard_lock& second, bool max_end)
+	{
+		size_type i = random()() % shards.size();
+		size_type j = random()() % (shards.size() - 1);
+		if (j >= i)
+			++j;
+		if (j < i)
+			std::swap(i, j);
+		first = shard_lock(shards[i]->lock);
+		second = shard_lock(shards[j]->lock);
+
+		queue_type& a = shards[i]->queue;
+		queue_type& b = shards[j]->queue;
+		if (a.empty())
+			return b.empty() ? nullptr : shards[j].get();
+		if (b.empty())
+			return shards[i].get();
+		return better(endKey(b, max_end), endValue(b, max_end), endKey(a, max_end), endValue(a, max_end), max_end) ?
+				shards[j].get() : shards[i].get();
+	}
+
+	// wykonanie f na kolejce cząstkowej z najlepszym minimum (maksimum), pod jej blokadą
+	// zwraca false, gdy kolejka jest pusta
+	template<typename F>
+	bool withEnd(bool max_end, F f)
+	{
+		if (ordering == ConcurrentPriorityQueueOrdering::relaxed && shards.size() > 1)
+		{
+			shard_lock first, second;
+			shard* s = lockTwoAndFind(first, second, max_end);
+			if (s != nullptr)
+			{
+				f(s->queue);
+				return true;
+			}
+			//obie wylosowane były puste - sprawdzamy wszystkie, żeby nie zgłosić pustej kolejki bez powodu
+		}
+		std::vector<shard_lock> locks;
+		shard* s = lockAllAndFind(locks, max_end);
+		if (s == nullptr)
+			return false;
+		f(s->queue);
+		return true;
+	}
+
+public: // interface
+
+	// Konstruktor tworzący pustą kolejkę złożoną z shard_count kolejek cząstkowych
+	// (domyślnie po jednej na wątek sprzętowy)
+	explicit ConcurrentPriorityQueue(
+			ConcurrentPriorityQueueOrdering ordering = ConcurrentPriorityQueueOrdering::strict,
+			size_type shard_count = std::thread::hardware_concurrency(),
+			const Hash& hash = Hash(), const Alloc& alloc = Alloc()) :
+			hasher(hash), ordering(ordering)
+	{
+		if (shard_count == 0)
+			shard_count = 1;
+		shards.reserve(shard_count);
+		for (size_type i = 0; i < shard_count; ++i)
+			shards.emplace_back(new shard(alloc));
+	}
+
+	ConcurrentPriorityQueue(const ConcurrentPriorityQueue&) = delete;
+	ConcurrentPriorityQueue& operator=(const ConcurrentPriorityQueue&) = delete;
+
+	ConcurrentPriorityQueueOrdering orderingMode() const noexcept
+	{
+		return ordering;
+	}
+
+	// Metoda zwracająca liczbę par w kolejce
+	// przy równoległych zmianach wynik jest tylko przybliżony
+	// zlozonosc: O(liczba kolejek cząstkowych)
+	size_type size() const
+	{
+		size_type result = 0;
+		for (auto& s : shards)
+		{
+			std::lock_guard<std::mutex> guard(s->lock);
+			result += s->queue.size();
+		}
+		return result;
+	}
+
+	bool empty() const
+	{
+		for (auto& s : shards)
+		{
+			std::lock_guard<std::mutex> guard(s->lock);
+			if (!s->queue.empty())
+				return false;
+		}
+		return true;
+	}
+
+	// Metoda wstawiająca parę do kolejki cząstkowej wyznaczonej przez klucz
+	// strong guarantee, zlozonosc: O(log size())
+	void insert(const K& key, const V& value)
+	{
+		shard& s = shardFor(key);
+		std::lock_guard<std::mutex> guard(s.lock);
+		s.queue.insert(key, value);
+	}
+
+	// Metoda zmieniająca wartość przypisaną kluczowi key; pary o tym kluczu są w jednej kolejce cząstkowej
+	// strong guarantee, zlozonosc: O(log size())
+	void changeValue(const K& key, const V& value)
+	{
+		shard& s = shardFor(key);
+		std::lock_guard<std::mutex> guard(s.lock);
+		s.queue.changeValue(key, value);
+	}
+
+	// Metody zwracające kopię najmniejszej (największej) wartości lub jej klucza
+	// w trybie relaxed - spośród dwóch losowych kolejek cząstkowych
+	// strong guarantee
+	V minValue()
+	{
+		return copyEnd<V>(false, [](const queue_type& q) { return q.minValue(); });
+	}
+
+	K minKey()
+	{
+		return copyEnd<K>(false, [](const queue_type& q) { return q.minKey(); });
+	}
+
+	V maxValue()
+	{
+		return copyEnd<V>(true, [](const queue_type& q) { return q.maxValue(); });
+	}
+
+	K maxKey()
+	{
+		return copyEnd<K>(true, [](const queue_type& q) { return q.maxKey(); });
+	}
+
+	// Metody usuwające parę o najmniejszej (największej) wartości; nic nie robią na pustej kolejce
+	// strong guarantee
+	void deleteMin()
+	{
+		withEnd(false, [](queue_type& q) { q.deleteMin(); });
+	}
+
+	void deleteMax()
+	{
+		withEnd(true, [](queue_type& q) { q.deleteMax(); });
+	}
+
+	// Metody wyjmujące parę o najmniejszej (największej) wartości w jednej operacji
+	// (osobne minValue i deleteMin mogą dotyczyć różnych par, gdy działają inne wątki)
+	// zwracają false, gdy kolejka jest pusta
+	// strong guarantee dla kolejki: jeśli przypisanie K lub V rzuci, para zostaje w kolejce
+	bool popMin(K& key, V& value)
+	{
+		return withEnd(false, [&](queue_type& q) { key = q.minKey(); value = q.minValue(); q.deleteMin(); });
+	}
+
+	bool popMax(K& key, V& value)
+	{
+		return withEnd(true, [&](queue_type& q) { key = q.maxKey(); value = q.maxValue(); q.deleteMax(); });
+	}
+
+private:
+	template<typename R, typename F>
+	R copyEnd(bool max_end, F f)
+	{
+		std::unique_ptr<R> result;
+		if (!withEnd(max_end, [&](queue_type& q) { result.reset(new R(f(q))); }))
+			throw PQEmptyEx;
+		return std::move(*result);
+	}
+};
+
+
+// Kolejka dla wątków roboczych (np. planisty zadań): kolejka cząstkowa PriorityQueue<K, V, Alloc, Policy>
+// na każdy wątek, który wskazuje ją numerem worker (0 .. shardCount() - 1). insert wstawia do kolejki
+// wątku, a popMin wyjmuje mniejsze z minimów kolejki wątku i jednej innej kolejki, podglądanej bez czekania
+// (try_lock; zajęta nie jest brana pod uwagę): tej, która miała najlepsze minimum przy ostatnim
+// odświeżeniu progu, jeśli próg jest lepszy od minimum kolejki wątku, a wpp. losowej. Próg (kopię
+// najlepszego minimum i numer jego kolejki) publikuje co refresh_period swoich popMin każdy wątek,
+// przeglądając bez czekania wszystkie kolejki. Pary zgromadzone w jednej kolejce (np. wątku, który przestał
+// wyjmować) są więc wyjmowane przez wszystkie wątki, zanim te wezmą gorsze pary z własnych kolejek,
+// a błąd rangi wyjętej pary ograniczają: wiek progu (najwyżej refresh_period wywołań popMin wątku)
+// i kolejki zajęte w chwili podglądania. Pusta kolejka wątku kradnie zawsze, a false oznacza,
+// że puste były wszystkie kolejki cząstkowe.
+// Metody zwracają kopie kluczy i wartości, a każda operacja ma takie gwarancje, jak odpowiadająca jej
+// operacja PriorityQueue. Pary o jednym kluczu mogą trafić do różnych kolejek cząstkowych, więc nie ma
+// changeValue; kolejnością wyjmowania steruje się wartościami przy wstawianiu.
+template<typename K, typename V, typename Alloc = std::allocator<std::pair<K, V>>,
+		typename Policy = PriorityQueueDefaultPolicy>
+class ShardedPriorityQueue
+{
+public: // public typedefs
+
+	typedef size_t size_type;
+	typedef K key_type;
+	typedef V value_type;
+	typedef PriorityQueue<K, V, Alloc, Policy> queue_type;
+
+private: // members and helpers
+
+	// kolejka cząstkowa wątku i liczba jego popMin od ostatniego odświeżenia progu (pod blokadą kolejki);
+	// dopełnienie do linii pamięci podręcznej, jak w ConcurrentPriorityQueue
+	struct shard
+	{
+		std::mutex lock;
+		queue_type queue;
+		size_type pops = 0;
+		char padding[64];
+
+		explicit shard(const Alloc& alloc) : queue(alloc)
+		{ }
+	};
+
+	// opublikowany próg: kopia najlepszego minimum z ostatniego odświeżenia i numer jego kolejki
+	struct threshold
+	{
+		size_type shard_index;
+		K key;
+		V value;
+
+		threshold(size_type shard_index, const K& key, const V& value) :
+				shard_index(shard_index), key(key), value(value)
+		{ }
+	};
+
+	typedef std::unique_lock<std::mutex> shard_lock;
+
+	std::vector<std::unique_ptr<shard>> shards;
+	size_type refresh_period;
+	// czytany i zmieniany tylko przez std::atomic_load i std::atomic_store
+	std::shared_ptr<const threshold> published;
+
+	static std::minstd_rand& random() noexcept
+	{
+		thread_local std::minstd_rand generator(
+				static_cast<unsigned>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+		return generator;
+	}
+
+	// czy minimum kolejki a jest mniejsze od minimum kolejki b (obie niepuste)
+	static bool better(const queue_type& a, const queue_type& b)
+	{
+		return pq_detail::CompBySnd<K, V, false, Policy>::less(a.minKey(), a.minValue(), b.minKey(), b.minValue());
+	}
+
+	// odświeżenie progu przez wątek worker (jego kolejka jest już zablokowana); pozostałe kolejki
+	// blokujemy bez czekania, więc kolejność blokowania nie ma znaczenia, a zajęte pomijamy
+	void publishThreshold(size_type worker)
+	{
+		std::vector<shard_lock> locks;
+		locks.reserve(shards.size());
+		const queue_type* best = nullptr;
+		size_type best_index = 0;
+		for (size_type i = 0; i < shards.size(); ++i)
+		{
+			if (i != worker)
+			{
+				locks.emplace_back(shards[i]->lock, std::try_to_lock);
+				if (!locks.back().owns_lock())
+					continue;
+			}
+			const queue_type& q = shards[i]->queue;
+			if (!q.empty() && (best == nullptr || better(q, *best)))
+			{
+				best = &q;
+				best_index = i;
+			}
+		}
+		std::shared_ptr<const threshold> fresh;
+		if (best != nullptr)
+			fresh = std::make_shared<const threshold>(best_index, best->minKey(), best->minValue());
+		std::atomic_store(&published, fresh);
+	}
+
+	// kolejka cząstkowa, którą wątek worker podgląda obok swojej, patrz opis klasy
+	size_type peekedShard(size_type worker, const queue_type* local)
+	{
+		std::shared_ptr<const threshold> hint = std::atomic_load(&published);
+		if (hint && hint->shard_index != worker && (local == nullptr || pq_detail::CompBySnd<K, V, false, Policy>::less(
+				hint->key, hint->value, local->minKey(), local->minValue())))
+			return hint->shard_index;
+		size_type j = random()() % (shards.size() - 1);
+		return j >= worker ? j + 1 : j;
+	}
+
+	// wykonanie f na kolejce cząstkowej, z której wyjmuje wątek worker, pod jej blokadą
+	// zwraca false, gdy wszystkie kolejki cząstkowe są puste
+	template<typename F>
+	bool withMin(size_type worker, F f)
+	{
+		assert(worker < shards.size());
+		{
+			shard& local = *shards[worker];
+			shard_lock own(local.lock);
+			if (shards.size() > 1 && ++local.pops >= refresh_period)
+			{
+				local.pops = 0;
+				publishThreshold(worker);
+			}
+			queue_type* from = local.queue.empty() ? nullptr : &local.queue;
+			shard_lock peeked;
+			if (shards.size() > 1)
+			{
+				size_type j = peekedShard(worker, from);
+				peeked = shard_lock(shards[j]->lock, std::try_to_lock);
+				if (peeked.owns_lock() && !shards[j]->queue.empty() &&
+						(from == nullptr || better(shards[j]->queue, *from)))
+					from = &shards[j]->queue;
+			}
+			if (from != nullptr)
+			{
+				f(*from);
+				return true;
+			}
+		}
+
+		//kolejka wątku i podglądana są puste (albo podglądana zajęta) - szukamy najlepszego minimum
+		//we wszystkich, blokując je po kolei, jak ConcurrentPriorityQueue w trybie strict
+		std::vector<shard_lock> locks;
+		locks.reserve(shards.size());
+		shard* best = nullptr;
+		for (auto& s : shards)
+		{
+			locks.emplace_back(s->lock);
+			if (!s->queue.empty() && (best == nullptr || better(s->queue, best->queue)))
+				best = s.get();
+		}
+		if (best == nullptr)
+			return false;
+		f(best->queue);
+		return true;
+	}
+
+public: // interface
+
+	// Konstruktor tworzący pustą kolejkę z worker_count kolejek cząstkowych (domyślnie po jednej na wątek
+	// sprzętowy); refresh_period - co ile swoich popMin wątek odświeża próg (0 - co shardCount())
+	explicit ShardedPriorityQueue(size_type worker_count = std::thread::hardware_concurrency(),
+			size_type refresh_period = 0, const Alloc& alloc = Alloc()) :
+			refresh_period(refresh_period)
+	{
+		if (worker_count == 0)
+			worker_count = 1;
+		if (this->refresh_period == 0)
+			this->refresh_period = worker_count;
+		shards.reserve(worker_count);
+		for (size_type i = 0; i < worker_count; ++i)
+			shards.emplace_back(new shard(alloc));
+	}
+
+	ShardedPriorityQueue(const ShardedPriorityQueue&) = delete;
+	ShardedPriorityQueue& operator=(const ShardedPriorityQueue&) = delete;
+
+	size_type shardCount() const noexcept
+	{
+		return shards.size();
+	}
+
+	// Metoda zwracająca liczbę par w kolejce
+	// przy równoległych zmianach wynik jest tylko przybliżony
+	// zlozonosc: O(liczba kolejek cząstkowych)
+	size_type size() const
+	{
+		size_type result = 0;
+		for (auto& s : shards)
+		{
+			std::lock_guard<std::mutex> guard(s->lock);
+			result += s->queue.size();
+		}
+		return result;
+	}
+
+	bool empty() const
+	{
+		for (auto& s : shards)
+		{
+			std::lock_guard<std::mutex> guard(s->lock);
+			if (!s->queue.empty())
+				return false;
+		}
+		return true;
+	}
+
+	// Metoda wstawiająca parę do kolejki cząstkowej wątku worker
+	// strong guarantee, zlozonosc: O(log size())
+	void insert(size_type worker, const K& key, const V& value)
+	{
+		assert(worker < shards.size());
+		std::lock_guard<std::mutex> guard(shards[worker]->lock);
+		shards[worker]->queue.insert(key, value);
+	}
+
+	// Metoda wyjmująca przybliżone minimum (patrz opis klasy) dla wątku worker; zwraca false,
+	// gdy kolejka jest pusta
+	// strong guarantee dla kolejki: jeśli przypisanie K lub V rzuci, para zostaje w kolejce
+	// zlozonosc: O(log size()) plus O(liczba kolejek cząstkowych) co refresh_period wywołań
+	// i przy pustej kolejce wątku i podglądanej
+	bool popMin(size_type worker, K& key, V& value)
+	{
+		return withMin(worker, [&](queue_type& q) { key = q.minKey(); value = q.minValue(); q.deleteMin(); });
+	}
+
+	// Metoda usuwająca przybliżone minimum dla wątku worker; nic nie robi na pustej kolejce
+	// strong guarantee
+	void deleteMin(size_type worker)
+	{
+		withMin(worker, [](queue_type& q) { q.deleteMin(); });
+	}
+};
+
+
+#endif
@@ -1,142 +1,8423 @@
 #ifndef PRIORITY_QUEUE_GUARD
 #define PRIORITY_QUEUE_GUARD
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <set>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+// pliki kolejki (save, mapFrom) są mapowane do pamięci w systemach POSIX, a gdzie indziej wczytywane
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PRIORITY_QUEUE_MMAP 1
+#else
+#define PRIORITY_QUEUE_MMAP 0
+#endif
 
 // wyjątki
 struct PriorityQueueNotFoundException : public std::exception
 {
-	virtual const char* what() const throw()
-	{
-		return "Key doesn't exist in queue";
-	}
-} PQNotFoundEx;
+	virtual const char* what() const throw()
+	{
+		return "Key doesn't exist in queue";
+	}
+} PQNotFoundEx;
+
+struct PriorityQueueEmptyException : public std::exception
+{
+	virtual const char* what() const throw()
+	{
+		return "Invalid operation on empty queue";
+	}
+} PQEmptyEx;
+
+struct PriorityQueueFormatException : public std::exception
+{
+	virtual const char* what() const throw()
+	{
+		return "Invalid priority queue file";
+	}
+} PQFormatEx;
+
+
+// Liczniki kolejki z polityką collect_stats (patrz PriorityQueueDefaultPolicy), zwracane przez stats()
+// obejmują tylko zmiany kolejki: insert, insertBatch, emplace, insertKeeping*, deleteMin, deleteMax, popMinN,
+// erase, changeValue i merge (dla merge - po stronie kolejki, do której scalamy)
+struct PriorityQueueStats
+{
+	// liczba wywołań i łączny czas (zegar steady_clock) jednego rodzaju operacji
+	struct operation
+	{
+		std::uint64_t calls = 0;
+		std::uint64_t nanoseconds = 0;
+	};
+
+	// wywołania porównań par CompByFst i CompBySnd (wyszukiwania po samym kluczu nie są liczone)
+	std::uint64_t comparisons = 0;
+	// alokacje pamięci na pary: węzły drzewa, tablica kopca, prywatne kopie współdzielonej zawartości
+	std::uint64_t allocations = 0;
+	// wycofania częściowo wykonanych zmian po wyjątku (gałęzie catch (...) silników)
+	std::uint64_t rollbacks = 0;
+
+	operation insert;        // insert, insertBatch, emplace, insertKeepingSmallest, insertKeepingLargest
+	operation remove;        // deleteMin, deleteMax, popMinN, erase
+	operation change_value;  // changeValue
+	operation merge;         // merge
+};
+
+
+// Zapis i odczyt jednego klucza albo jednej wartości w rekordach PriorityQueue::serialize i deserialize
+// write dopisuje bajty x do out, read odczytuje obiekt od first (nie dalej niż do last) i przesuwa first;
+// read rzuca PQFormatEx, gdy bajtów brakuje albo są niepoprawne
+// są wersje dla typów trywialnie kopiowalnych (bajty obiektu) i std::basic_string (długość i znaki);
+// dla innych typów wystarczy dopisać specjalizację
+template<typename T, typename = void>
+struct PriorityQueueSerializer;
+
+template<typename T>
+struct PriorityQueueSerializer<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type>
+{
+	static void write(std::string& out, const T& x)
+	{
+		out.append(reinterpret_cast<const char*>(&x), sizeof(T));
+	}
+
+	static T read(const char*& first, const char* last)
+	{
+		if (static_cast<std::size_t>(last - first) < sizeof(T))
+			throw PQFormatEx;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type bytes;
+		std::memcpy(&bytes, first, sizeof(T));
+		first += sizeof(T);
+		return *reinterpret_cast<const T*>(&bytes);
+	}
+};
+
+template<typename C, typename Traits, typename A>
+struct PriorityQueueSerializer<std::basic_string<C, Traits, A>>
+{
+	static_assert(std::is_trivially_copyable<C>::value, "Serialized strings require trivially copyable characters!");
+
+	static void write(std::string& out, const std::basic_string<C, Traits, A>& x)
+	{
+		PriorityQueueSerializer<std::uint64_t>::write(out, x.size());
+		out.append(reinterpret_cast<const char*>(x.data()), x.size() * sizeof(C));
+	}
+
+	static std::basic_string<C, Traits, A> read(const char*& first, const char* last)
+	{
+		std::uint64_t length = PriorityQueueSerializer<std::uint64_t>::read(first, last);
+		if (length > static_cast<std::uint64_t>(last - first) / sizeof(C))
+			throw PQFormatEx;
+		std::basic_string<C, Traits, A> x(static_cast<std::size_t>(length), C());
+		std::memcpy(&x[0], first, static_cast<std::size_t>(length) * sizeof(C));
+		first += length * sizeof(C);
+		return x;
+	}
+};
+
+
+namespace pq_detail
+{
+	// zaczep (hook) drzewa czerwono-czarnego, wbudowany bezpośrednio w element kolejki
+	struct rb_hook
+	{
+		rb_hook* parent;
+		rb_hook* left;
+		rb_hook* right;
+		bool red;
+	};
+
+	// miejsce, w które należy podpiąć nowy węzeł: syn parent-a (lewy albo prawy)
+	struct rb_spot
+	{
+		rb_hook* parent;
+		bool left;
+	};
+
+	// intruzywne drzewo czerwono-czarne
+	// drzewo nie alokuje pamięci i nie porównuje elementów - porównania wykonuje wywołujący
+	// przy szukaniu miejsca (find_spot, lower_bound), dlatego wszystkie operacje modyfikujące
+	// strukturę (link, insert_before, erase) są no-throw
+	// korzeń nie wskazuje na obiekt drzewa, więc drzewo można przenosić w O(1)
+	class rb_tree
+	{
+	public:
+		rb_tree() noexcept : root(nullptr), leftmost(nullptr), rightmost(nullptr)
+		{ }
+
+		rb_tree(const rb_tree&) = delete;
+		rb_tree& operator=(const rb_tree&) = delete;
+
+		rb_tree(rb_tree&& tree) noexcept :
+				root(tree.root), leftmost(tree.leftmost), rightmost(tree.rightmost)
+		{
+			tree.reset();
+		}
+
+		rb_tree& operator=(rb_tree&& tree) noexcept
+		{
+			swap(tree);
+			tree.reset();
+			return *this;
+		}
+
+		bool empty() const noexcept
+		{
+			return root == nullptr;
+		}
+
+		rb_hook* top() const noexcept
+		{
+			return root;
+		}
+
+		rb_hook* first() const noexcept
+		{
+			return leftmost;
+		}
+
+		rb_hook* last() const noexcept
+		{
+			return rightmost;
+		}
+
+		// następnik w porządku drzewa, nullptr za ostatnim elementem
+		static rb_hook* next(rb_hook* x) noexcept
+		{
+			if (x->right)
+			{
+				x = x->right;
+				while (x->left)
+					x = x->left;
+				return x;
+			}
+			while (x->parent && x == x->parent->right)
+				x = x->parent;
+			return x->parent;
+		}
+
+		// poprzednik w porządku drzewa, nullptr przed pierwszym elementem
+		static rb_hook* prev(rb_hook* x) noexcept
+		{
+			if (x->left)
+			{
+				x = x->left;
+				while (x->right)
+					x = x->right;
+				return x;
+			}
+			while (x->parent && x == x->parent->left)
+				x = x->parent;
+			return x->parent;
+		}
+
+		// miejsce za wszystkimi elementami równymi nowemu (jak multiset::insert)
+		// goes_left(h) == true wtedy i tylko wtedy, gdy nowy element jest mniejszy od h
+		// może rzucić tylko to, co rzuci goes_left; drzewo nie jest zmieniane
+		template<typename GoesLeft>
+		rb_spot find_spot(GoesLeft goes_left) const
+		{
+			rb_spot spot = {nullptr, true};
+			rb_hook* x = root;
+			while (x)
+			{
+				spot.parent = x;
+				spot.left = goes_left(x);
+				x = spot.left ? x->left : x->right;
+			}
+			return spot;
+		}
+
+		// pierwszy element h, dla którego is_less(h) == false, albo nullptr
+		template<typename IsLess>
+		rb_hook* lower_bound(IsLess is_less) const
+		{
+			rb_hook* result = nullptr;
+			rb_hook* x = root;
+			while (x)
+			{
+				if (is_less(x))
+					x = x->right;
+				else
+				{
+					result = x;
+					x = x->left;
+				}
+			}
+			return result;
+		}
+
+		// podpięcie węzła w miejscu znalezionym przez find_spot, no-throw
+		void link(const rb_spot& spot, rb_hook* x) noexcept
+		{
+			x->parent = spot.parent;
+			x->left = x->right = nullptr;
+			x->red = true;
+			if (!spot.parent)
+			{
+				root = leftmost = rightmost = x;
+			}
+			else if (spot.left)
+			{
+				spot.parent->left = x;
+				if (spot.parent == leftmost)
+					leftmost = x;
+			}
+			else
+			{
+				spot.parent->right = x;
+				if (spot.parent == rightmost)
+					rightmost = x;
+			}
+			insert_fixup(x);
+		}
+
+		// wstawienie węzła bezpośrednio przed pos (pos == nullptr - na koniec), no-throw
+		// wywołujący gwarantuje, że porządek drzewa zostaje zachowany
+		void insert_before(rb_hook* pos, rb_hook* x) noexcept
+		{
+			if (!pos)
+				link(rb_spot{rightmost, false}, x);
+			else if (!pos->left)
+				link(rb_spot{pos, true}, x);
+			else
+				link(rb_spot{prev(pos), false}, x);
+		}
+
+		// odpięcie węzła z drzewa, no-throw
+		void erase(rb_hook* z) noexcept
+		{
+			if (z == leftmost)
+				leftmost = next(z);
+			if (z == rightmost)
+				rightmost = prev(z);
+
+			rb_hook* x;
+			rb_hook* x_parent;
+			bool removed_red = z->red;
+
+			if (!z->left)
+			{
+				x = z->right;
+				x_parent = z->parent;
+				transplant(z, z->right);
+			}
+			else if (!z->right)
+			{
+				x = z->left;
+				x_parent = z->parent;
+				transplant(z, z->left);
+			}
+			else
+			{
+				// z ma dwóch synów, na jego miejsce wchodzi następnik y
+				rb_hook* y = z->right;
+				while (y->left)
+					y = y->left;
+				removed_red = y->red;
+				x = y->right;
+				if (y->parent == z)
+					x_parent = y;
+				else
+				{
+					x_parent = y->parent;
+					transplant(y, y->right);
+					y->right = z->right;
+					y->right->parent = y;
+				}
+				transplant(z, y);
+				y->left = z->left;
+				y->left->parent = y;
+				y->red = z->red;
+			}
+
+			if (!removed_red)
+				erase_fixup(x, x_parent);
+		}
+
+		void swap(rb_tree& tree) noexcept
+		{
+			std::swap(root, tree.root);
+			std::swap(leftmost, tree.leftmost);
+			std::swap(rightmost, tree.rightmost);
+		}
+
+		// zapomnienie o wszystkich węzłach (nie zwalnia ich), no-throw
+		void reset() noexcept
+		{
+			root = leftmost = rightmost = nullptr;
+		}
+
+		// zbudowanie drzewa z n węzłów podanych w porządku drzewa (dotychczasowe węzły są zapominane)
+		// drzewo jest idealnie zrównoważone: czerwone są tylko węzły najgłębszego poziomu
+		// no-throw, bez porównań, O(n)
+		void assign_sorted(rb_hook* const* nodes, size_t n) noexcept
+		{
+			reset();
+			if (n == 0)
+				return;
+			size_t deepest = 0;
+			while ((size_t(2) << deepest) - 1 < n)
+				++deepest;
+			root = build(nodes, 0, n, nullptr, 0, deepest);
+			leftmost = nodes[0];
+			rightmost = nodes[n - 1];
+		}
+
+	private:
+		rb_hook* root;
+		rb_hook* leftmost;
+		rb_hook* rightmost;
+
+		// poddrzewo z węzłów [lo, hi), którego korzeń leży na głębokości depth
+		// głębokość rekursji O(log n)
+		static rb_hook* build(rb_hook* const* nodes, size_t lo, size_t hi, rb_hook* parent,
+				size_t depth, size_t deepest) noexcept
+		{
+			if (lo == hi)
+				return nullptr;
+			size_t mid = lo + (hi - lo) / 2;
+			rb_hook* x = nodes[mid];
+			x->parent = parent;
+			x->red = depth == deepest && depth > 0;
+			x->left = build(nodes, lo, mid, x, depth + 1, deepest);
+			x->right = build(nodes, mid + 1, hi, x, depth + 1, deepest);
+			return x;
+		}
+
+		static bool is_red(const rb_hook* x) noexcept
+		{
+			return x && x->red;
+		}
+
+		void transplant(rb_hook* u, rb_hook* v) noexcept
+		{
+			if (!u->parent)
+				root = v;
+			else if (u == u->parent->left)
+				u->parent->left = v;
+			else
+				u->parent->right = v;
+			if (v)
+				v->parent = u->parent;
+		}
+
+		void rotate_left(rb_hook* x) noexcept
+		{
+			rb_hook* y = x->right;
+			x->right = y->left;
+			if (y->left)
+				y->left->parent = x;
+			transplant(x, y);
+			y->left = x;
+			x->parent = y;
+		}
+
+		void rotate_right(rb_hook* x) noexcept
+		{
+			rb_hook* y = x->left;
+			x->left = y->right;
+			if (y->right)
+				y->right->parent = x;
+			transplant(x, y);
+			y->right = x;
+			x->parent = y;
+		}
+
+		void insert_fixup(rb_hook* x) noexcept
+		{
+			while (x != root && x->parent->red)
+			{
+				rb_hook* p = x->parent;
+				rb_hook* g = p->parent; // p jest czerwony, więc nie jest korzeniem
+				if (p == g->left)
+				{
+					rb_hook* u = g->right;
+					if (is_red(u))
+					{
+						p->red = u->red = false;
+						g->red = true;
+						x = g;
+					}
+					else
+					{
+						if (x == p->right)
+						{
+							rotate_left(p);
+							std::swap(x, p);
+						}
+						p->red = false;
+						g->red = true;
+						rotate_right(g);
+					}
+				}
+				else
+				{
+					rb_hook* u = g->left;
+					if (is_red(u))
+					{
+						p->red = u->red = false;
+						g->red = true;
+						x = g;
+					}
+					else
+					{
+						if (x == p->left)
+						{
+							rotate_right(p);
+							std::swap(x, p);
+						}
+						p->red = false;
+						g->red = true;
+						rotate_left(g);
+					}
+				}
+			}
+			root->red = false;
+		}
+
+		void erase_fixup(rb_hook* x, rb_hook* x_parent) noexcept
+		{
+			while (x != root && !is_red(x))
+			{
+				if (x == x_parent->left)
+				{
+					rb_hook* w = x_parent->right;
+					if (w->red)
+					{
+						w->red = false;
+						x_parent->red = true;
+						rotate_left(x_parent);
+						w = x_parent->right;
+					}
+					if (!is_red(w->left) && !is_red(w->right))
+					{
+						w->red = true;
+						x = x_parent;
+						x_parent = x_parent->parent;
+					}
+					else
+					{
+						if (!is_red(w->right))
+						{
+							w->left->red = false;
+							w->red = true;
+							rotate_right(w);
+							w = x_parent->right;
+						}
+						w->red = x_parent->red;
+						x_parent->red = false;
+						if (w->right)
+							w->right->red = false;
+						rotate_left(x_parent);
+						x = root;
+					}
+				}
+				else
+				{
+					rb_hook* w = x_parent->left;
+					if (w->red)
+					{
+						w->red = false;
+						x_parent->red = true;
+						rotate_right(x_parent);
+						w = x_parent->left;
+					}
+					if (!is_red(w->left) && !is_red(w->right))
+					{
+						w->red = true;
+						x = x_parent;
+						x_parent = x_parent->parent;
+					}
+					else
+					{
+						if (!is_red(w->left))
+						{
+							w->right->red = false;
+							w->red = true;
+							rotate_left(w);
+							w = x_parent->left;
+						}
+						w->red = x_parent->red;
+						x_parent->red = false;
+						if (w->left)
+							w->left->red = false;
+						rotate_right(x_parent);
+						x = root;
+					}
+				}
+			}
+			if (x)
+				x->red = false;
+		}
+	};
+
+	// wymieszanie bitów skrótu (końcowy krok MurmurHash3), bo std::hash dla liczb całkowitych bywa
+	// identycznością, a hash_index bierze numer grupy i znacznik z różnych bitów skrótu
+	inline size_t mix_hash(size_t hash) noexcept
+	{
+		std::uint64_t x = hash;
+		x ^= x >> 33;
+		x *= 0xff51afd7ed558ccdULL;
+		x ^= x >> 33;
+		x *= 0xc4ceb9fe1a85ec53ULL;
+		x ^= x >> 33;
+		return static_cast<size_t>(x);
+	}
+
+	// intruzywny indeks haszujący z adresowaniem otwartym (jak Swiss table): tablica bajtów kontrolnych
+	// i tablica wskaźników na elementy; bajt zajętego miejsca to 7 bitów skrótu elementu (znacznik),
+	// wolnego - empty_slot, a zwolnionego - deleted_slot, więc szukanie sprawdza naraz całą grupę
+	// 8 bajtów (jedno słowo 64-bitowe, bez instrukcji zależnych od procesora) i sięga do elementu
+	// tylko przy zgodnym znaczniku; grupy są wyrównane, a kolejne sprawdzane grupy wyznacza
+	// sondowanie kwadratowe (przy liczbie grup będącej potęgą dwójki odwiedza wszystkie)
+	// jak rb_tree: indeks nie alokuje pamięci (tablice dostaje w rehash) i nie porównuje elementów
+	// (robi to matches w find), więc operacje modyfikujące są no-throw; skróty podaje wywołujący
+	// zajętych i zwolnionych miejsc jest najwyżej 7/8 pojemności, więc każda grupa sondowania
+	// kończy się na grupie z wolnym miejscem
+	template<typename T>
+	class hash_index
+	{
+	public:
+		static const size_t group_width = 8;
+
+		// tablice indeksu: capacity to 0 albo potęga dwójki, nie mniejsza od group_width
+		struct storage
+		{
+			unsigned char* control;
+			T** slots;
+			size_t capacity;
+		};
+
+		hash_index() noexcept : tables{nullptr, nullptr, 0}, elements(0), growth_left(0)
+		{ }
+
+		hash_index(const hash_index&) = delete;
+		hash_index& operator=(const hash_index&) = delete;
+
+		// liczba elementów
+		size_t size() const noexcept
+		{
+			return elements;
+		}
+
+		// ile elementów można jeszcze wstawić bez rehash
+		size_t room() const noexcept
+		{
+			return growth_left;
+		}
+
+		const storage& arrays() const noexcept
+		{
+			return tables;
+		}
+
+		// najmniejsza pojemność, przy której n elementów zajmuje najwyżej 7/8 miejsc
+		static size_t capacity_for(size_t n) noexcept
+		{
+			size_t capacity = group_width;
+			while (max_load(capacity) < n)
+				capacity *= 2;
+			return capacity;
+		}
+
+		// element x o skrócie hash, dla którego matches(x) == true, albo nullptr
+		// może rzucić tylko to, co rzuci matches; indeks nie jest zmieniany
+		template<typename Matches>
+		T* find(size_t hash, Matches matches) const
+		{
+			if (tables.capacity == 0)
+				return nullptr;
+			unsigned char tag = tag_of(hash);
+			for (probe p(hash, tables.capacity); ; p.next())
+			{
+				std::uint64_t group = load(p.offset);
+				for (std::uint64_t bits = match_tag(group, tag); bits != 0; bits &= bits - 1)
+				{
+					T* x = tables.slots[p.offset + lowest_byte(bits)];
+					if (matches(x))
+						return x;
+				}
+				if (match_empty(group) != 0)
+					return nullptr;
+			}
+		}
+
+		// wstawienie x o skrócie hash, no-throw; wywołujący gwarantuje, że room() > 0
+		void insert(size_t hash, T* x) noexcept
+		{
+			assert(growth_left > 0);
+			for (probe p(hash, tables.capacity); ; p.next())
+			{
+				std::uint64_t bits = match_free(load(p.offset));
+				if (bits == 0)
+					continue;
+				size_t i = p.offset + lowest_byte(bits);
+				if (tables.control[i] == empty_slot)
+					--growth_left;
+				tables.control[i] = tag_of(hash);
+				tables.slots[i] = x;
+				++elements;
+				return;
+			}
+		}
+
+		// usunięcie x o skrócie hash (x musi być w indeksie), no-throw
+		// miejsce w grupie, w której jest wolne miejsce, też staje się wolne - żadne szukanie
+		// nie przechodzi przez taką grupę dalej
+		void erase(size_t hash, const T* x) noexcept
+		{
+			size_t i = locate(hash, x);
+			assert(i != tables.capacity);
+			size_t group = i & ~(group_width - 1);
+			if (match_empty(load(group)) != 0)
+			{
+				tables.control[i] = empty_slot;
+				++growth_left;
+			}
+			else
+				tables.control[i] = deleted_slot;
+			--elements;
+		}
+
+		// zastąpienie x (o skrócie hash) elementem y o tym samym skrócie, jeśli x jest w indeksie, no-throw
+		void replace(size_t hash, const T* x, T* y) noexcept
+		{
+			size_t i = locate(hash, x);
+			if (i != tables.capacity)
+				tables.slots[i] = y;
+		}
+
+		// wywołanie f dla każdego elementu, w kolejności miejsc
+		template<typename F>
+		void for_each(F f) const
+		{
+			for (size_t i = 0; i < tables.capacity; ++i)
+				if (tables.control[i] < empty_slot)
+					f(tables.slots[i]);
+		}
+
+		// przeniesienie elementów do tablic fresh (pojemność co najmniej capacity_for(size())),
+		// hash_of(x) - skrót elementu x; fresh dostaje dotychczasowe tablice do zwolnienia, no-throw
+		template<typename HashOf>
+		void rehash(storage& fresh, HashOf hash_of) noexcept
+		{
+			assert(max_load(fresh.capacity) >= elements);
+			std::memset(fresh.control, empty_slot, fresh.capacity);
+			storage old = tables;
+			size_t count = elements;
+			tables = fresh;
+			elements = 0;
+			growth_left = max_load(fresh.capacity);
+			for (size_t i = 0; i < old.capacity; ++i)
+				if (old.control[i] < empty_slot)
+					insert(hash_of(old.slots[i]), old.slots[i]);
+			assert(elements == count);
+			(void) count;
+			fresh = old;
+		}
+
+		void swap(hash_index& index) noexcept
+		{
+			std::swap(tables, index.tables);
+			std::swap(elements, index.elements);
+			std::swap(growth_left, index.growth_left);
+		}
+
+		// zapomnienie o tablicach i elementach (nie zwalnia ich), no-throw
+		void reset() noexcept
+		{
+			tables = storage{nullptr, nullptr, 0};
+			elements = growth_left = 0;
+		}
+
+	private:
+		static const unsigned char empty_slot = 0x80;
+		static const unsigned char deleted_slot = 0xfe;
+		static const std::uint64_t low_bits = 0x0101010101010101ULL;
+		static const std::uint64_t high_bits = 0x8080808080808080ULL;
+
+		storage tables;
+		size_t elements;
+		size_t growth_left;
+
+		static size_t max_load(size_t capacity) noexcept
+		{
+			return capacity - capacity / 8;
+		}
+
+		static unsigned char tag_of(size_t hash) noexcept
+		{
+			return static_cast<unsigned char>(hash & 0x7f);
+		}
+
+		// kolejne grupy sondowania: przesunięcia o 1, 2, 3, ... grup od grupy wyznaczonej przez skrót
+		struct probe
+		{
+			size_t offset;
+			size_t mask;
+			size_t step;
+
+			probe(size_t hash, size_t capacity) noexcept :
+					offset((hash >> 7) * group_width & (capacity - 1)), mask(capacity - 1), step(0)
+			{ }
+
+			void next() noexcept
+			{
+				step += group_width;
+				offset = (offset + step) & mask;
+			}
+		};
+
+		// bajty grupy od offset jako słowo, pierwszy bajt najmłodszy (niezależnie od kolejności bajtów maszyny)
+		std::uint64_t load(size_t offset) const noexcept
+		{
+			std::uint64_t group = 0;
+			for (size_t i = 0; i < group_width; ++i)
+				group |= std::uint64_t(tables.control[offset + i]) << (8 * i);
+			return group;
+		}
+
+		// maski z najstarszym bitem ustawionym w bajtach grupy: o znaczniku tag (z rzadka także w zajętym
+		// bajcie tuż za zgodnym - wywołujący i tak sprawdza element), wolnych, wolnych albo zwolnionych
+		static std::uint64_t match_tag(std::uint64_t group, unsigned char tag) noexcept
+		{
+			std::uint64_t x = group ^ (low_bits * tag);
+			return (x - low_bits) & ~x & high_bits;
+		}
+
+		static std::uint64_t match_empty(std::uint64_t group) noexcept
+		{
+			return group & ~(group << 6) & high_bits;
+		}
+
+		static std::uint64_t match_free(std::uint64_t group) noexcept
+		{
+			return group & high_bits;
+		}
+
+		// numer najmłodszego bajtu maski
+		static size_t lowest_byte(std::uint64_t bits) noexcept
+		{
+#if defined(__GNUC__)
+			return static_cast<size_t>(__builtin_ctzll(bits)) / 8;
+#else
+			size_t i = 0;
+			while ((bits & 0x80) == 0)
+			{
+				bits >>= 8;
+				++i;
+			}
+			return i;
+#endif
+		}
+
+		// miejsce elementu x o skrócie hash albo tables.capacity, gdy go nie ma
+		size_t locate(size_t hash, const T* x) const noexcept
+		{
+			if (tables.capacity == 0)
+				return tables.capacity;
+			unsigned char tag = tag_of(hash);
+			for (probe p(hash, tables.capacity); ; p.next())
+			{
+				std::uint64_t group = load(p.offset);
+				for (std::uint64_t bits = match_tag(group, tag); bits != 0; bits &= bits - 1)
+				{
+					size_t i = p.offset + lowest_byte(bits);
+					if (tables.slots[i] == x)
+						return i;
+				}
+				if (match_empty(group) != 0)
+					return tables.capacity;
+			}
+		}
+	};
+
+	// zaczepy obu porządków jako osobne typy bazowe, żeby z zaczepu dało się wrócić do węzła
+	struct key_hook : rb_hook { };
+	struct value_hook : rb_hook { };
+
+	// liczba kopii pary przechowywanych w jednym węźle; bez trybu count_duplicates
+	// każdy węzeł to jedna kopia, a licznik nie zajmuje miejsca
+	template<bool Counted>
+	struct entry_count
+	{
+		size_t count = 1;
+
+		size_t copies() const noexcept
+		{
+			return count;
+		}
+
+		void set_copies(size_t c) noexcept
+		{
+			count = c;
+		}
+	};
+
+	template<>
+	struct entry_count<false>
+	{
+		size_t copies() const noexcept
+		{
+			return 1;
+		}
+
+		void set_copies(size_t) noexcept
+		{ }
+	};
+
+	// zapamiętany prefiks klucza (polityka key_prefix): Prefix rzutuje klucz na liczbę zgodnie z porządkiem
+	// kluczy (a < b => Prefix()(a) <= Prefix()(b), a == b => Prefix()(a) == Prefix()(b)), więc różne
+	// prefiksy rozstrzygają porównanie bez porównywania kluczy; bez key_prefix nie zajmuje miejsca
+	template<typename K, typename Prefix>
+	struct key_prefix_slot
+	{
+		typedef typename std::decay<decltype(Prefix()(std::declval<const K&>()))>::type prefix_type;
+		static_assert(std::is_arithmetic<prefix_type>::value, "Key prefix must be of an arithmetic type!");
+		static_assert(noexcept(Prefix()(std::declval<const K&>())), "Key prefix projection must be noexcept!");
+
+		prefix_type prefix = prefix_type();
+
+		static prefix_type prefix_of(const K& key) noexcept
+		{
+			return Prefix()(key);
+		}
+
+		prefix_type key_prefix() const noexcept
+		{
+			return prefix;
+		}
+
+		void set_key_prefix(prefix_type p) noexcept
+		{
+			prefix = p;
+		}
+
+		// -1 albo 1, gdy prefiksy rozstrzygają porównanie kluczy, 0 - gdy trzeba porównać klucze
+		static int prefix_order(prefix_type a, prefix_type b) noexcept
+		{
+			return a < b ? -1 : (b < a ? 1 : 0);
+		}
+	};
+
+	template<typename K>
+	struct key_prefix_slot<K, void>
+	{
+		struct prefix_type
+		{ };
+
+		static prefix_type prefix_of(const K&) noexcept
+		{
+			return prefix_type();
+		}
+
+		prefix_type key_prefix() const noexcept
+		{
+			return prefix_type();
+		}
+
+		void set_key_prefix(prefix_type) noexcept
+		{ }
+
+		static int prefix_order(prefix_type, prefix_type) noexcept
+		{
+			return 0;
+		}
+	};
+
+	// pojedynczy element kolejki, wpięty jednocześnie w oba drzewa
+	// Prefix - rzut klucza z polityki key_prefix (void - bez prefiksu), patrz key_prefix_slot
+	template<typename K, typename V, bool Counted, typename Prefix = void>
+	struct dual_node : key_hook, value_hook, entry_count<Counted>, key_prefix_slot<K, Prefix>
+	{
+		std::pair<K, V> entry;
+
+		// argumenty konstruktora std::pair<K, V>
+		template<typename... Args>
+		explicit dual_node(Args&&... args) :
+				entry(std::forward<Args>(args)...)
+		{
+			this->set_key_prefix(this->prefix_of(entry.first));
+		}
+
+		static dual_node* from_key(rb_hook* h) noexcept
+		{
+			return static_cast<dual_node*>(static_cast<key_hook*>(h));
+		}
+
+		static dual_node* from_value(rb_hook* h) noexcept
+		{
+			return static_cast<dual_node*>(static_cast<value_hook*>(h));
+		}
+
+		rb_hook* key_link() noexcept
+		{
+			return static_cast<key_hook*>(this);
+		}
+
+		rb_hook* value_link() noexcept
+		{
+			return static_cast<value_hook*>(this);
+		}
+	};
+
+	// element silnika parującego: zaczep drzewa po kluczu i miejsce w kopcu parującym
+	// (najbardziej lewy syn, prawy brat, lewy brat albo - u najbardziej lewego syna - ojciec)
+	// plan - decyzje porównań zapamiętane przed przebudową kopca, patrz pairing_engine::planCombine
+	template<typename K, typename V>
+	struct pairing_node : key_hook
+	{
+		pairing_node* child = nullptr;
+		pairing_node* next = nullptr;
+		pairing_node* prev = nullptr;
+		unsigned char plan = 0;
+		std::pair<K, V> entry;
+
+		// argumenty konstruktora std::pair<K, V>
+		template<typename... Args>
+		explicit pairing_node(Args&&... args) :
+				entry(std::forward<Args>(args)...)
+		{ }
+
+		static pairing_node* from_key(rb_hook* h) noexcept
+		{
+			return static_cast<pairing_node*>(static_cast<key_hook*>(h));
+		}
+
+		rb_hook* key_link() noexcept
+		{
+			return static_cast<key_hook*>(this);
+		}
+	};
+
+	// element silnika haszującego: zaczep drzewa po wartości, następna para o tym samym kluczu
+	// (pary o równym kluczu tworzą cykl, a indeks po kluczu wskazuje jedną z nich) i wymieszany
+	// skrót klucza - przebudowa indeksu nie wywołuje Hash, a szukanie porównuje klucze tylko przy równych skrótach
+	template<typename K, typename V>
+	struct hashed_node : value_hook
+	{
+		hashed_node* next_equal = this;
+		size_t hash = 0;
+		std::pair<K, V> entry;
+
+		// argumenty konstruktora std::pair<K, V>
+		template<typename... Args>
+		explicit hashed_node(Args&&... args) :
+				entry(std::forward<Args>(args)...)
+		{ }
+
+		static hashed_node* from_value(rb_hook* h) noexcept
+		{
+			return static_cast<hashed_node*>(static_cast<value_hook*>(h));
+		}
+
+		rb_hook* value_link() noexcept
+		{
+			return static_cast<value_hook*>(this);
+		}
+	};
+
+	// element silnika pozycyjnego: zaczep drzewa po kluczu i miejsce w porządku po wartości - zaczep
+	// drzewa par o najmniejszej wartości albo sąsiedzi na cyklicznej liście kubełka (patrz radix_engine)
+	template<typename K, typename V>
+	struct radix_node : key_hook, value_hook
+	{
+		radix_node* prev = nullptr;
+		radix_node* next = nullptr;
+		std::pair<K, V> entry;
+
+		// argumenty konstruktora std::pair<K, V>
+		template<typename... Args>
+		explicit radix_node(Args&&... args) :
+				entry(std::forward<Args>(args)...)
+		{ }
+
+		static radix_node* from_key(rb_hook* h) noexcept
+		{
+			return static_cast<radix_node*>(static_cast<key_hook*>(h));
+		}
+
+		static radix_node* from_value(rb_hook* h) noexcept
+		{
+			return static_cast<radix_node*>(static_cast<value_hook*>(h));
+		}
+
+		rb_hook* key_link() noexcept
+		{
+			return static_cast<key_hook*>(this);
+		}
+
+		rb_hook* value_link() noexcept
+		{
+			return static_cast<value_hook*>(this);
+		}
+	};
+
+	// numer najstarszego (najmłodszego) ustawionego bitu niezerowego x
+	inline unsigned highest_bit(std::uint64_t x) noexcept
+	{
+#if defined(__GNUC__)
+		return 63 - static_cast<unsigned>(__builtin_clzll(x));
+#else
+		unsigned bit = 0;
+		while (x >>= 1)
+			++bit;
+		return bit;
+#endif
+	}
+
+	inline unsigned lowest_bit(std::uint64_t x) noexcept
+	{
+#if defined(__GNUC__)
+		return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+		unsigned bit = 0;
+		while (!(x & 1))
+		{
+			x >>= 1;
+			++bit;
+		}
+		return bit;
+#endif
+	}
+
+	// porządki na parach (klucz, wartość)
+	// korzystają tylko z == i < typów K i V, a z polityką key_compare (value_compare) - z jej
+	// trójwartościowego porównania kluczy (wartości)
+
+	// czy pary można porównywać bez skoków warunkowych: == i < typów arytmetycznych są tanie,
+	// nie rzucają i nie mają efektów ubocznych, więc obliczamy oba porównania zawsze
+	template<typename K, typename V>
+	struct branchless_comparable : std::integral_constant<bool,
+			std::is_arithmetic<K>::value && std::is_arithmetic<V>::value>
+	{ };
+
+	// porządek leksykograficzny na (a, b): najpierw a, przy równych a - b
+	template<typename A, typename B>
+	bool lexicographic_less(const A& a1, const B& b1, const A& a2, const B& b2, std::false_type)
+	{
+		if (!(a1 == a2))
+			return a1 < a2;
+		return b1 < b2;
+	}
+
+	// dla równych a1 i a2 a1 < a2 jest fałszem, więc wynik jest taki sam jak wyżej (także dla NaN)
+	template<typename A, typename B>
+	bool lexicographic_less(const A& a1, const B& b1, const A& a2, const B& b2, std::true_type) noexcept
+	{
+		return (a1 < a2) | ((a1 == a2) & (b1 < b2));
+	}
+
+	// porównanie jednej składowej pary: Compare - trójwartościowe porównanie z polityki (wynik < 0, 0
+	// albo > 0, jak a < b, a == b, a > b), void - operator <
+	template<typename Compare>
+	struct component_order
+	{
+		template<typename T>
+		static int compare(const T& a, const T& b)
+		{
+			return Compare()(a, b);
+		}
+
+		template<typename T>
+		static bool less(const T& a, const T& b)
+		{
+			return Compare()(a, b) < 0;
+		}
+	};
+
+	template<>
+	struct component_order<void>
+	{
+		template<typename T>
+		static bool less(const T& a, const T& b)
+		{
+			return a < b;
+		}
+	};
+
+	// porządek leksykograficzny na (a, b) z porównaniami CompareA i CompareB (patrz component_order);
+	// z trójwartościowym CompareA jedno porównanie a rozstrzyga, czy a1 < a2 i czy a1 == a2
+	template<typename CompareA, typename CompareB>
+	struct pair_order
+	{
+		template<typename A, typename B>
+		static bool less(const A& a1, const B& b1, const A& a2, const B& b2)
+		{
+			int order = component_order<CompareA>::compare(a1, a2);
+			if (order != 0)
+				return order < 0;
+			return component_order<CompareB>::less(b1, b2);
+		}
+	};
+
+	template<typename CompareB>
+	struct pair_order<void, CompareB>
+	{
+		template<typename A, typename B>
+		static bool less(const A& a1, const B& b1, const A& a2, const B& b2)
+		{
+			if (!(a1 == a2))
+				return a1 < a2;
+			return component_order<CompareB>::less(b1, b2);
+		}
+	};
+
+	template<>
+	struct pair_order<void, void>
+	{
+		template<typename A, typename B>
+		static bool less(const A& a1, const B& b1, const A& a2, const B& b2)
+		{
+			return lexicographic_less(a1, b1, a2, b2, branchless_comparable<A, B>());
+		}
+	};
+
+	// trójwartościowe porównania z polityki: typedef ... key_compare; i typedef ... value_compare;
+	// (void, gdy polityka ich nie ma albo Policy to void)
+	template<typename Policy, typename = void>
+	struct key_comparator
+	{
+		typedef void type;
+	};
+
+	template<typename Policy>
+	struct key_comparator<Policy, decltype(void(std::declval<typename Policy::key_compare*>()))>
+	{
+		typedef typename Policy::key_compare type;
+	};
+
+	template<typename Policy, typename = void>
+	struct value_comparator
+	{
+		typedef void type;
+	};
+
+	template<typename Policy>
+	struct value_comparator<Policy, decltype(void(std::declval<typename Policy::value_compare*>()))>
+	{
+		typedef typename Policy::value_compare type;
+	};
+
+	// czy == i < typu T nie rzucają; typ bez nich (porównywany tylko przez key_compare albo
+	// value_compare z polityki) ich nie wywoła, więc też nie rzuci
+	template<typename T, typename = void>
+	struct nothrow_operators : std::true_type
+	{ };
+
+	template<typename T>
+	struct nothrow_operators<T, decltype(void(std::declval<const T&>() == std::declval<const T&>()),
+			void(std::declval<const T&>() < std::declval<const T&>()))> : std::integral_constant<bool,
+			noexcept(std::declval<const T&>() == std::declval<const T&>()) &&
+			noexcept(std::declval<const T&>() < std::declval<const T&>())>
+	{ };
+
+	// czy trójwartościowe porównanie Compare typu T nie rzuca wtedy, gdy nie rzucają == i < typu T
+	// (od tego zależy, czy silniki prowadzą dzienniki cofania, patrz nothrow_comparable)
+	template<typename Compare, typename T>
+	struct compare_keeps_nothrow : std::integral_constant<bool,
+			noexcept(Compare()(std::declval<const T&>(), std::declval<const T&>())) ||
+			!nothrow_operators<T>::value>
+	{ };
+
+	template<typename T>
+	struct compare_keeps_nothrow<void, T> : std::true_type
+	{ };
+
+	// liczniki kolejki, której operacja właśnie trwa w tym wątku (nullptr poza operacjami)
+	// kolejka z polityką collect_stats ustawia je na czas każdej zmiany, patrz stats_holder
+	inline PriorityQueueStats*& active_stats() noexcept
+	{
+		static thread_local PriorityQueueStats* active = nullptr;
+		return active;
+	}
+
+	// zliczenie zdarzenia w trwającej operacji; dla Enabled == false znika przy kompilacji
+	template<bool Enabled>
+	inline void count_event(std::uint64_t PriorityQueueStats::* counter) noexcept
+	{
+		if (!Enabled)
+			return;
+		if (PriorityQueueStats* stats = active_stats())
+			++(stats->*counter);
+	}
+
+	// po kluczu
+	// Stats - czy zliczać wywołania (polityka collect_stats); Policy - polityka kolejki z ewentualnymi
+	// key_compare i value_compare (void - porządek z == i <)
+	template<typename K, typename V, bool Stats = false, typename Policy = void>
+	struct CompByFst
+	{
+		typedef typename key_comparator<Policy>::type key_compare;
+		typedef typename value_comparator<Policy>::type value_compare;
+		static_assert(compare_keeps_nothrow<key_compare, K>::value,
+				"key_compare must be noexcept when == and < of the key type are!");
+		static_assert(compare_keeps_nothrow<value_compare, V>::value,
+				"value_compare must be noexcept when == and < of the value type are!");
+
+		static bool less(const K& ak, const V& av, const K& bk, const V& bv)
+		{
+			count_event<Stats>(&PriorityQueueStats::comparisons);
+			return pair_order<key_compare, value_compare>::less(ak, av, bk, bv);
+		}
+
+		bool operator()(const std::pair<K, V>& a, const std::pair<K, V>& b) const
+		{
+			return less(a.first, a.second, b.first, b.second);
+		}
+	};
+
+	// po wartości
+	template<typename K, typename V, bool Stats = false, typename Policy = void>
+	struct CompBySnd
+	{
+		typedef typename key_comparator<Policy>::type key_compare;
+		typedef typename value_comparator<Policy>::type value_compare;
+		static_assert(compare_keeps_nothrow<key_compare, K>::value,
+				"key_compare must be noexcept when == and < of the key type are!");
+		static_assert(compare_keeps_nothrow<value_compare, V>::value,
+				"value_compare must be noexcept when == and < of the value type are!");
+
+		static bool less(const K& ak, const V& av, const K& bk, const V& bv)
+		{
+			count_event<Stats>(&PriorityQueueStats::comparisons);
+			return pair_order<value_compare, key_compare>::less(av, ak, bv, bk);
+		}
+
+		bool operator()(const std::pair<K, V>& a, const std::pair<K, V>& b) const
+		{
+			return less(a.first, a.second, b.first, b.second);
+		}
+	};
+
+	// iteratory, których elementy mają składowe first i second (jak std::pair<K, V>);
+	// odróżnia insert(first, last) od insert(key, value)
+	template<typename InputIt>
+	using pair_iterator_check = decltype(
+			void(std::declval<typename std::iterator_traits<InputIt>::reference>().first),
+			void(std::declval<typename std::iterator_traits<InputIt>::reference>().second));
+
+	// czy kontener może przejąć alokator innego kontenera (przy przypisaniu albo swap)
+	template<typename Alloc>
+	struct propagates_allocator : std::integral_constant<bool,
+			std::allocator_traits<Alloc>::propagate_on_container_copy_assignment::value ||
+			std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value ||
+			std::allocator_traits<Alloc>::propagate_on_container_swap::value>
+	{ };
+
+	// zamiana alokatorów; niepropagowane alokatory (np. std::pmr::polymorphic_allocator)
+	// mogą nie być przypisywalne, a PriorityQueue zamienia wtedy zawartość tylko przy równych alokatorach
+	template<typename A>
+	void swap_allocators(A& a, A& b, std::true_type) noexcept
+	{
+		using std::swap;
+		swap(a, b);
+	}
+
+	template<typename A>
+	void swap_allocators(A&, A&, std::false_type) noexcept
+	{ }
+
+	// czy polityka włącza szukanie po kluczu argumentem innego typu niż K
+	template<typename Policy, typename = void>
+	struct is_transparent : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct is_transparent<Policy, decltype(void(std::declval<typename Policy::is_transparent*>()))> : std::true_type
+	{ };
+
+	// czy polityka włącza tryb count_duplicates (jedna pozycja na różną parę z licznikiem kopii)
+	template<typename Policy, typename = void>
+	struct counts_duplicates : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct counts_duplicates<Policy, decltype(void(Policy::count_duplicates))> :
+			std::integral_constant<bool, Policy::count_duplicates>
+	{ };
+
+	// czy polityka włącza tryb lazy_deletion (deleteMin i deleteMax odkładają usunięcie węzła z drzewa po kluczu)
+	template<typename Policy, typename = void>
+	struct deletes_lazily : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct deletes_lazily<Policy, decltype(void(Policy::lazy_deletion))> :
+			std::integral_constant<bool, Policy::lazy_deletion>
+	{ };
+
+	// czy polityka zamienia strong guarantee na basic guarantee w kosztownych operacjach (basic_guarantee)
+	template<typename Policy, typename = void>
+	struct relaxes_guarantee : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct relaxes_guarantee<Policy, decltype(void(Policy::basic_guarantee))> :
+			std::integral_constant<bool, Policy::basic_guarantee>
+	{ };
+
+	// czy polityka włącza zbieranie liczników (collect_stats)
+	template<typename Policy, typename = void>
+	struct collects_stats : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct collects_stats<Policy, decltype(void(Policy::collect_stats))> :
+			std::integral_constant<bool, Policy::collect_stats>
+	{ };
+
+	// czy polityka deklaruje kolejkę monotoniczną (monotone): wartości wstawiane i nadawane nie są
+	// mniejsze od ostatnio usuniętego minimum
+	template<typename Policy, typename = void>
+	struct pops_monotonically : std::false_type
+	{ };
+
+	template<typename Policy>
+	struct pops_monotonically<Policy, decltype(void(Policy::monotone))> :
+			std::integral_constant<bool, Policy::monotone>
+	{ };
+
+	// rzut klucza na prefiks zapamiętywany w węzłach (typedef ... key_prefix;), void gdy go nie ma
+	template<typename Policy, typename = void>
+	struct key_projection
+	{
+		typedef void type;
+	};
+
+	template<typename Policy>
+	struct key_projection<Policy, decltype(void(std::declval<typename Policy::key_prefix*>()))>
+	{
+		typedef typename Policy::key_prefix type;
+	};
+
+	// liczniki kolejki; bez collect_stats pusta klasa bazowa, więc kolejka nie jest większa
+	// scope - obiekt na czas jednej zmiany kolejki: mierzy jej czas i kieruje do liczników kolejki
+	// zdarzenia zliczane przez count_event (także w zagnieżdżonych wywołaniach)
+	template<bool Enabled>
+	class stats_holder
+	{
+	protected:
+		class scope
+		{
+		public:
+			scope(stats_holder&, PriorityQueueStats::operation PriorityQueueStats::*) noexcept
+			{ }
+		};
+	};
+
+	template<>
+	class stats_holder<true>
+	{
+	protected:
+		class scope
+		{
+		public:
+			scope(stats_holder& holder, PriorityQueueStats::operation PriorityQueueStats::* kind) noexcept :
+					stats(holder.collected), kind(kind), previous(active_stats()),
+					start(std::chrono::steady_clock::now())
+			{
+				active_stats() = &stats;
+			}
+
+			scope(const scope&) = delete;
+			scope& operator=(const scope&) = delete;
+
+			~scope()
+			{
+				auto elapsed = std::chrono::steady_clock::now() - start;
+				++(stats.*kind).calls;
+				(stats.*kind).nanoseconds += static_cast<std::uint64_t>(
+						std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+				active_stats() = previous;
+			}
+
+		private:
+			PriorityQueueStats& stats;
+			PriorityQueueStats::operation PriorityQueueStats::* kind;
+			PriorityQueueStats* previous;
+			std::chrono::steady_clock::time_point start;
+		};
+
+		const PriorityQueueStats& collectedStats() const noexcept
+		{
+			return collected;
+		}
+
+		void resetCollectedStats() noexcept
+		{
+			collected = PriorityQueueStats();
+		}
+
+	private:
+		PriorityQueueStats collected;
+	};
+
+	// czy porównania == i < typów K i V są no-throw (patrz nothrow_operators)
+	template<typename K, typename V>
+	struct nothrow_comparable : std::integral_constant<bool,
+			nothrow_operators<K>::value && nothrow_operators<V>::value>
+	{ };
+
+	// pary z typów całkowitych bez bajtów wypełnienia są równe dokładnie wtedy, gdy równe są ich bajty
+	// (dla typów zmiennoprzecinkowych nie: -0.0 == 0.0, a NaN != NaN)
+	template<typename K, typename V>
+	struct bytewise_comparable : std::integral_constant<bool,
+			std::is_integral<K>::value && std::is_integral<V>::value &&
+			sizeof(std::pair<K, V>) == sizeof(K) + sizeof(V)>
+	{ };
+
+	// czy count par od a i od b jest równych; memcmp z biblioteki standardowej porównuje całe
+	// bloki pamięci instrukcjami wektorowymi, a w pozostałych przypadkach porównujemy bez skoków
+	template<typename K, typename V>
+	bool block_equal(const std::pair<K, V>* a, const std::pair<K, V>* b, size_t count, std::true_type) noexcept
+	{
+		return std::memcmp(a, b, count * sizeof(std::pair<K, V>)) == 0;
+	}
+
+	template<typename K, typename V>
+	bool block_equal(const std::pair<K, V>* a, const std::pair<K, V>* b, size_t count, std::false_type) noexcept
+	{
+		unsigned differ = 0;
+		for (size_t j = 0; j < count; ++j)
+			differ |= unsigned(a[j].first != b[j].first) | unsigned(a[j].second != b[j].second);
+		return differ == 0;
+	}
+
+	// indeks pierwszej pozycji, na której tablice a i b (po n par arytmetycznych) się różnią, albo n
+	// porównujemy całe bloki, a różniący się blok przeglądamy już po kolei
+	template<typename K, typename V>
+	size_t first_mismatch(const std::pair<K, V>* a, const std::pair<K, V>* b, size_t n) noexcept
+	{
+		const size_t block = 64;
+		size_t i = 0;
+		for (; i + block <= n; i += block)
+			if (!block_equal(a + i, b + i, block, bytewise_comparable<K, V>()))
+				break;
+		for (; i < n; ++i)
+			if (a[i].first != b[i].first || a[i].second != b[i].second)
+				return i;
+		return n;
+	}
+
+	// porównania zawartości silników tego samego typu i rozmiaru w porządku (klucz, wartość),
+	// po kolei przez key_cursor albo (contiguous_key_order) na tablicach z key_array
+	template<typename Engine>
+	bool equal_in_key_order(const Engine& lhs, const Engine& rhs, std::false_type)
+	{
+		typename Engine::key_cursor it1(lhs);
+		typename Engine::key_cursor it2(rhs);
+
+		// jeśli na którejś pozycji kolejki się różnią, zwracamy false
+		for (; !it1.done(); it1.advance(), it2.advance())
+		{
+			const auto& pair1 = it1.get();
+			const auto& pair2 = it2.get();
+			if (!(pair1.first == pair2.first && //po kluczu
+				pair1.second == pair2.second)) //po wartości
+				return false;
+		}
+
+		return true;
+	}
+
+	template<typename Engine>
+	bool equal_in_key_order(const Engine& lhs, const Engine& rhs, std::true_type)
+	{
+		typename Engine::key_array a(lhs);
+		typename Engine::key_array b(rhs);
+		return first_mismatch(a.data(), b.data(), lhs.size()) == lhs.size();
+	}
+
+	// dla niepustych silników
+	template<typename Engine>
+	bool less_in_key_order(const Engine& lhs, const Engine& rhs, std::false_type)
+	{
+		typename Engine::key_cursor it1(lhs);
+		typename Engine::key_cursor it2(rhs);
+
+		assert(!it1.done() && !it2.done());
+
+		while (!it1.done() && !it2.done())
+		{
+			const auto& pair1 = it1.get();
+			const auto& pair2 = it2.get();
+			if (!(pair1.first == pair2.first)) //po kluczu
+				return pair1.first < pair2.first;
+			if (!(pair1.second == pair2.second)) //po wartosci
+				return pair1.second < pair2.second;
+
+			it1.advance();
+			it2.advance();
+		}
+		//skonczyla sie ktoras z kolejek
+		//zwracam true jesli skonczyla sie tylko pierwsza kolejka, wpp. false
+		//poniewaz albo sa rowne, albo pierwsza jest dluzsza, w obu przypadkach pierwsza nie jest mniejsza.
+		return (it1.done() && !it2.done());
+	}
+
+	template<typename Engine>
+	bool less_in_key_order(const Engine& lhs, const Engine& rhs, std::true_type)
+	{
+		typename Engine::key_array a(lhs);
+		typename Engine::key_array b(rhs);
+		size_t common = std::min(lhs.size(), rhs.size());
+		size_t i = first_mismatch(a.data(), b.data(), common);
+		if (i == common)
+			return lhs.size() < rhs.size();
+		if (!(a.data()[i].first == b.data()[i].first))
+			return a.data()[i].first < b.data()[i].first;
+		return a.data()[i].second < b.data()[i].second;
+	}
+
+	// typ uchwytu dla silników, w których elementy nie mają stałego miejsca w pamięci
+	struct no_handle
+	{ };
+
+	// typ iteratora dla silników bez porządku po kluczu i po wartości
+	struct no_iterator
+	{ };
+
+	// para iteratorów [first, last) do przejścia pętlą for po zakresie
+	template<typename It>
+	class range_view
+	{
+	public:
+		range_view(It first, It last) : first(first), last(last)
+		{ }
+
+		It begin() const
+		{
+			return first;
+		}
+
+		It end() const
+		{
+			return last;
+		}
+
+		bool empty() const
+		{
+			return first == last;
+		}
+
+	private:
+		It first;
+		It last;
+	};
+
+	// plik kolejki (PriorityQueue::save i mapFrom), kolejno:
+	//   queue_file_header
+	//   od entries_offset: count par file_entry<K, V> w porządku (wartość, klucz)
+	//   od key_order_offset: count liczb std::uint64_t - numer (w porządku po wartości) kolejnej pary
+	//   w porządku (klucz, wartość)
+	// pary i liczby są w reprezentacji maszyny, która zapisała plik; nagłówek pozwala odrzucić plik
+	// z maszyny o innej kolejności bajtów albo zapisany dla innych typów
+	struct queue_file_header
+	{
+		char magic[8];
+		std::uint32_t byte_order;
+		std::uint32_t entry_size;
+		std::uint32_t key_size;
+		std::uint32_t value_size;
+		std::uint64_t count;
+		std::uint64_t entries_offset;
+		std::uint64_t key_order_offset;
+	};
+
+	static const char queue_file_magic[8] = {'P', 'Q', 'U', 'E', 'U', 'E', '0', '1'};
+	static const std::uint32_t queue_file_byte_order = 0x01020304;
+
+	// para w pliku: w przeciwieństwie do std::pair<K, V> trywialnie kopiowalna dla takich K i V
+	template<typename K, typename V>
+	struct file_entry
+	{
+		K key;
+		V value;
+	};
+
+	inline std::uint64_t align_up(std::uint64_t offset, std::uint64_t alignment) noexcept
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// nagłówek pliku z count parami; obie tablice są wyrównane do swoich typów
+	template<typename K, typename V>
+	queue_file_header make_queue_file_header(std::uint64_t count) noexcept
+	{
+		typedef file_entry<K, V> entry;
+		queue_file_header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, queue_file_magic, sizeof(header.magic));
+		header.byte_order = queue_file_byte_order;
+		header.entry_size = sizeof(entry);
+		header.key_size = sizeof(K);
+		header.value_size = sizeof(V);
+		header.count = count;
+		header.entries_offset = align_up(sizeof(queue_file_header), alignof(entry));
+		header.key_order_offset = align_up(header.entries_offset + count * sizeof(entry), alignof(std::uint64_t));
+		return header;
+	}
+
+	// zawartość pliku w pamięci, tylko do odczytu: w systemach POSIX zmapowana, wpp. wczytana
+	// rzuca std::system_error (std::ios_base::failure), gdy pliku nie da się otworzyć albo przeczytać
+	class mapped_file
+	{
+	public:
+		explicit mapped_file(const std::string& path) : bytes(nullptr), length(0)
+		{
+#if PRIORITY_QUEUE_MMAP
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw std::system_error(errno, std::generic_category(), path);
+			struct stat info;
+			if (::fstat(fd, &info) != 0)
+			{
+				int error = errno;
+				::close(fd);
+				throw std::system_error(error, std::generic_category(), path);
+			}
+			length = static_cast<std::size_t>(info.st_size);
+			if (length != 0)
+			{
+				void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (address == MAP_FAILED)
+				{
+					int error = errno;
+					::close(fd);
+					throw std::system_error(error, std::generic_category(), path);
+				}
+				bytes = static_cast<const unsigned char*>(address);
+				//plik czytamy cały, poza tym tablica po kluczu sięga do par w dowolnej kolejności
+				::madvise(address, length, MADV_WILLNEED);
+			}
+			::close(fd);
+#else
+			std::ifstream in;
+			in.exceptions(std::ios::failbit | std::ios::badbit);
+			in.open(path, std::ios::binary);
+			in.seekg(0, std::ios::end);
+			buffer.resize(static_cast<std::size_t>(in.tellg()));
+			in.seekg(0, std::ios::beg);
+			in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+			bytes = buffer.data();
+			length = buffer.size();
+#endif
+		}
+
+		mapped_file(const mapped_file&) = delete;
+		mapped_file& operator=(const mapped_file&) = delete;
+
+		~mapped_file()
+		{
+#if PRIORITY_QUEUE_MMAP
+			if (bytes != nullptr)
+				::munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+		}
+
+		const unsigned char* data() const noexcept
+		{
+			return bytes;
+		}
+
+		std::size_t size() const noexcept
+		{
+			return length;
+		}
+
+	private:
+		const unsigned char* bytes;
+		std::size_t length;
+#if !PRIORITY_QUEUE_MMAP
+		std::vector<unsigned char> buffer;
+#endif
+	};
+
+	// sprawdzenie par z zewnątrz (pliku, strumienia), z których silnik zbuduje drzewa bez porównań:
+	// entry_at(i) - i-ta para w porządku (wartość, klucz), key_position(i) - numer (w tym porządku)
+	// i-tej pary w porządku (klucz, wartość); key_position musi być permutacją, a oba porządki - niemalejące
+	// rzuca PQFormatEx, O(n) porównań; seen - bufor na n flag
+	template<typename K, typename V, typename EntryAt, typename KeyPosition, typename BoolVector>
+	void check_sorted_contents(std::size_t n, EntryAt entry_at, KeyPosition key_position, BoolVector& seen)
+	{
+		seen.assign(n, false);
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			std::uint64_t position = key_position(i);
+			if (position >= n || seen[static_cast<std::size_t>(position)])
+				throw PQFormatEx;
+			seen[static_cast<std::size_t>(position)] = true;
+		}
+		for (std::size_t i = 1; i < n; ++i)
+		{
+			const auto& a = entry_at(i - 1);
+			const auto& b = entry_at(i);
+			if (CompBySnd<K, V>::less(b.key, b.value, a.key, a.value))
+				throw PQFormatEx;
+			const auto& c = entry_at(static_cast<std::size_t>(key_position(i - 1)));
+			const auto& d = entry_at(static_cast<std::size_t>(key_position(i)));
+			if (CompByFst<K, V>::less(d.key, d.value, c.key, c.value))
+				throw PQFormatEx;
+		}
+	}
+
+	// plik kolejki otwarty do odczytu; konstruktor sprawdza nagłówek i rozmiar pliku,
+	// checkContents - oba porządki i permutację, więc silnik może zbudować drzewa bez porównań
+	// pary i liczby kopiujemy z pliku (memcpy), bo jego bajty nie są obiektami K i V
+	// rzuca PQFormatEx, gdy plik nie jest poprawnym plikiem kolejki dla K i V
+	template<typename K, typename V>
+	class queue_file_reader
+	{
+	public:
+		typedef file_entry<K, V> entry;
+
+		explicit queue_file_reader(const std::string& path) : file(path)
+		{
+			if (file.size() < sizeof(queue_file_header))
+				throw PQFormatEx;
+			queue_file_header header;
+			std::memcpy(&header, file.data(), sizeof(header));
+			if (std::memcmp(header.magic, queue_file_magic, sizeof(header.magic)) != 0 ||
+					header.byte_order != queue_file_byte_order || header.entry_size != sizeof(entry) ||
+					header.key_size != sizeof(K) || header.value_size != sizeof(V))
+				throw PQFormatEx;
+			//count z uszkodzonego pliku nie może przepełnić obliczeń poniżej
+			if (header.count > file.size() / (sizeof(entry) + sizeof(std::uint64_t)))
+				throw PQFormatEx;
+			queue_file_header expected = make_queue_file_header<K, V>(header.count);
+			if (header.entries_offset != expected.entries_offset || header.key_order_offset != expected.key_order_offset ||
+					file.size() < header.key_order_offset + header.count * sizeof(std::uint64_t))
+				throw PQFormatEx;
+			entries = file.data() + header.entries_offset;
+			key_order = file.data() + header.key_order_offset;
+			n = static_cast<std::size_t>(header.count);
+		}
+
+		std::size_t size() const noexcept
+		{
+			return n;
+		}
+
+		entry at(std::size_t i) const noexcept
+		{
+			entry e;
+			std::memcpy(&e, entries + i * sizeof(entry), sizeof(entry));
+			return e;
+		}
+
+		std::size_t keyPosition(std::size_t i) const noexcept
+		{
+			std::uint64_t position;
+			std::memcpy(&position, key_order + i * sizeof(std::uint64_t), sizeof(position));
+			return static_cast<std::size_t>(position);
+		}
+
+		// O(n) porównań; seen - bufor na n flag (z alokatora kolejki)
+		template<typename BoolVector>
+		void checkContents(BoolVector& seen) const
+		{
+			check_sorted_contents<K, V>(n, [this](std::size_t i) { return at(i); },
+					[this](std::size_t i) { std::uint64_t position;
+							std::memcpy(&position, key_order + i * sizeof(std::uint64_t), sizeof(position));
+							return position; }, seen);
+		}
+
+	private:
+		mapped_file file;
+		const unsigned char* entries;
+		const unsigned char* key_order;
+		std::size_t n;
+	};
+
+	// zapis pliku kolejki do out: by_key - wskaźniki par w porządku (klucz, wartość),
+	// by_value - numery (w porządku po kluczu) kolejnych par w porządku (wartość, klucz)
+	// Alloc - alokator kolejki, na bufory pomocnicze
+	template<typename K, typename V, typename Alloc, typename PointerVector, typename IndexVector>
+	void write_queue_file(std::ostream& out, const PointerVector& by_key, const IndexVector& by_value,
+			const Alloc& alloc)
+	{
+		typedef file_entry<K, V> entry;
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<std::uint64_t> index_allocator;
+		std::size_t n = by_key.size();
+		std::vector<std::uint64_t, index_allocator> key_position(n, 0, index_allocator(alloc));
+		for (std::size_t j = 0; j < n; ++j)
+			key_position[by_value[j]] = j;
+
+		queue_file_header header = make_queue_file_header<K, V>(n);
+		static const char padding[64] = {};
+		static_assert(alignof(entry) <= sizeof(padding), "Saved queues don't support over-aligned pairs!");
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(padding, static_cast<std::streamsize>(header.entries_offset - sizeof(header)));
+		for (std::size_t j = 0; j < n; ++j)
+		{
+			//bajty dopełnienia w entry też trafiają do pliku - zerujemy je
+			entry e;
+			std::memset(&e, 0, sizeof(e));
+			e.key = by_key[by_value[j]]->first;
+			e.value = by_key[by_value[j]]->second;
+			out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+		}
+		out.write(padding, static_cast<std::streamsize>(
+				header.key_order_offset - header.entries_offset - n * sizeof(entry)));
+		out.write(reinterpret_cast<const char*>(key_position.data()),
+				static_cast<std::streamsize>(n * sizeof(std::uint64_t)));
+	}
+
+	// strumień kolejki (PriorityQueue::serialize i deserialize), kolejno:
+	//   queue_stream_header
+	//   count rekordów w porządku (wartość, klucz): długość reszty rekordu (std::uint64_t),
+	//   numer pary w porządku (klucz, wartość) (std::uint64_t), klucz i wartość (PriorityQueueSerializer)
+	// liczby są w reprezentacji maszyny, która zapisała strumień
+	struct queue_stream_header
+	{
+		char magic[8];
+		std::uint32_t byte_order;
+		std::uint32_t reserved;
+		std::uint64_t count;
+	};
+
+	static const char queue_stream_magic[8] = {'P', 'Q', 'S', 'T', 'R', 'M', '0', '1'};
+
+	// odczyt length bajtów rekordu strumienia kolejki do record; bufor rośnie razem z odczytanymi danymi,
+	// więc uszkodzona długość kończy się PQFormatEx na końcu strumienia, a nie ogromną alokacją
+	inline void read_stream_record(std::istream& in, std::string& record, std::uint64_t length)
+	{
+		const std::uint64_t chunk = 1 << 16;
+		record.clear();
+		while (record.size() < length)
+		{
+			std::size_t done = record.size();
+			std::size_t step = static_cast<std::size_t>(std::min<std::uint64_t>(chunk, length - done));
+			record.resize(done + step);
+			if (!in.read(&record[done], static_cast<std::streamsize>(step)))
+				throw PQFormatEx;
+		}
+	}
+
+	// wykonanie równoległe (PriorityQueueParallel)
+	// każdy wątek dostaje co najmniej parallel_grain par: mniejsze kawałki nie zwracają kosztu wątku
+	static const std::size_t parallel_grain = std::size_t(1) << 14;
+
+	// liczba wątków dla operacji na n parach: requested (0 - liczba wątków sprzętowych), ale nie więcej,
+	// niż starczy par dla każdego z nich; 1 - operacja wykonywana sekwencyjnie
+	inline std::size_t parallel_threads(unsigned requested, std::size_t n) noexcept
+	{
+		std::size_t threads = requested != 0 ? requested : std::thread::hardware_concurrency();
+		return std::max<std::size_t>(std::min(threads, n / parallel_grain), 1);
+	}
+
+	// wykonanie zadań task(0), ..., task(count - 1) na osobnych wątkach (task(0) - na wątku wywołującym)
+	// pamięć pomocniczą przydziela reserve, więc run nie alokuje poza tym, co alokuje std::thread,
+	// a zadanie, dla którego nie udało się uruchomić wątku, wykonuje wątek wywołujący - dla zadań no-throw
+	// run jest no-throw; po zakończeniu wszystkich zadań run rzuca pierwszy (według numeru) wyjątek zadania
+	// zdarzenia collect_stats zliczone w zadaniach trafiają do liczników trwającej operacji
+	template<typename Alloc>
+	class parallel_runner
+	{
+		typedef std::allocator_traits<Alloc> alloc_traits;
+		typedef typename alloc_traits::template rebind_alloc<std::thread> thread_allocator;
+		typedef typename alloc_traits::template rebind_alloc<std::exception_ptr> error_allocator;
+		typedef typename alloc_traits::template rebind_alloc<PriorityQueueStats> stats_allocator;
+
+		std::vector<std::thread, thread_allocator> threads;
+		std::vector<std::exception_ptr, error_allocator> errors;
+		std::vector<PriorityQueueStats, stats_allocator> counters;
+
+	public:
+		explicit parallel_runner(const Alloc& alloc) noexcept :
+				threads(thread_allocator(alloc)), errors(error_allocator(alloc)), counters(stats_allocator(alloc))
+		{ }
+
+		// miejsce na count zadań jednego run
+		void reserve(std::size_t count)
+		{
+			threads.reserve(count);
+			errors.resize(std::max(errors.size(), count));
+			counters.resize(std::max(counters.size(), count));
+		}
+
+		template<typename Task>
+		void run(std::size_t count, const Task& task)
+		{
+			assert(count <= errors.size());
+			auto body = [this, &task](std::size_t i) noexcept
+			{
+				PriorityQueueStats*& active = active_stats();
+				PriorityQueueStats* caller = active;
+				active = &counters[i];
+				try
+				{
+					task(i);
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+				active = caller;
+			};
+			for (std::size_t i = 1; i < count; ++i)
+			{
+				try
+				{
+					threads.emplace_back(body, i);
+				}
+				catch (...)
+				{
+					body(i);
+				}
+			}
+			body(0);
+			for (std::thread& t : threads)
+				t.join();
+			threads.clear();
+
+			std::exception_ptr error;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (PriorityQueueStats* stats = active_stats())
+				{
+					stats->comparisons += counters[i].comparisons;
+					stats->allocations += counters[i].allocations;
+					stats->rollbacks += counters[i].rollbacks;
+				}
+				counters[i] = PriorityQueueStats();
+				if (errors[i] && !error)
+					error = errors[i];
+				errors[i] = nullptr;
+			}
+			if (error)
+				std::rethrow_exception(error);
+		}
+	};
+
+	// sortowanie v na threads wątkach: równe kawałki sortujemy równolegle, a potem scalamy parami
+	// przez bufor (scalenia jednej rundy też równolegle); rzuca to, co porównania i alokacja,
+	// a przerwane wyjątkiem może zdublować element - sortujemy więc tylko kopie
+	template<typename T, typename A, typename Less>
+	void parallel_sort(std::vector<T, A>& v, const Less& less, std::size_t threads)
+	{
+		std::size_t n = v.size();
+		if (threads <= 1 || n < 2)
+		{
+			std::sort(v.begin(), v.end(), less);
+			return;
+		}
+		std::vector<T, A> buffer(n, T(), v.get_allocator());
+		parallel_runner<A> runner(v.get_allocator());
+		runner.reserve(threads);
+		auto bound = [n, threads](std::size_t i) { return n / threads * i + n % threads * i / threads; };
+		runner.run(threads, [&](std::size_t i) { std::sort(v.begin() + bound(i), v.begin() + bound(i + 1), less); });
+		for (std::size_t width = 1; width < threads; width *= 2)
+		{
+			runner.run((threads + 2 * width - 1) / (2 * width), [&](std::size_t j)
+			{
+				std::size_t lo = bound(2 * j * width);
+				std::size_t mid = bound(std::min(threads, (2 * j + 1) * width));
+				std::size_t hi = bound(std::min(threads, (2 * j + 2) * width));
+				std::merge(v.begin() + lo, v.begin() + mid, v.begin() + mid, v.begin() + hi, buffer.begin() + lo, less);
+				std::copy(buffer.begin() + lo, buffer.begin() + hi, v.begin() + lo);
+			});
+		}
+	}
+
+	// scalenie posortowanych a[0..na) i b[0..nb) do out jak std::merge (przy równych najpierw a),
+	// na threads wątkach: a dzielimy na równe kawałki, a granice kawałków w b wyznacza wyszukiwanie binarne
+	// rzuca to, co porównania i alloc
+	template<typename T, typename Less, typename Alloc>
+	void parallel_merge(const T* a, std::size_t na, const T* b, std::size_t nb, T* out, const Less& less,
+			std::size_t threads, const Alloc& alloc)
+	{
+		if (threads <= 1 || na == 0)
+		{
+			std::merge(a, a + na, b, b + nb, out, less);
+			return;
+		}
+		auto b_bound = [&](std::size_t i) -> std::size_t
+		{
+			if (i == 0)
+				return 0;
+			if (i == threads)
+				return nb;
+			return std::lower_bound(b, b + nb, a[na / threads * i + na % threads * i / threads], less) - b;
+		};
+		parallel_runner<Alloc> runner(alloc);
+		runner.reserve(threads);
+		runner.run(threads, [&](std::size_t i)
+		{
+			std::size_t a_lo = na / threads * i + na % threads * i / threads;
+			std::size_t a_hi = na / threads * (i + 1) + na % threads * (i + 1) / threads;
+			std::size_t b_lo = b_bound(i);
+			std::merge(a + a_lo, a + a_hi, b + b_lo, b + b_bound(i + 1), out + a_lo + b_lo, less);
+		});
+	}
+
+	// Silniki przechowujące pary kolejki. PriorityQueue sprawdza warunki brzegowe (pusta kolejka,
+	// brak klucza) i deleguje do silnika; każdy silnik udostępnia:
+	//   konstruktory: (alokator), (silnik, alokator) - kopia, przenoszący; swap(silnik, czy_z_alokatorami)
+	//   size, emplace, minEntry, maxEntry, deleteMin, deleteMax (dla niepustego silnika),
+	//   changeValue(klucz, wartość) - false, gdy klucza nie ma; merge, clear
+	//   key_cursor - przejście po parach w porządku (klucz, wartość), dla operatorów porównania
+	//   has_handles - czy emplace zwraca uchwyty, z którymi działają erase/changeValue/entry
+	//   has_ordered_iterators - czy key_iterator i value_iterator przechodzą pary w porządku (klucz, wartość)
+	//     i (wartość, klucz): keyBegin, keyEnd, keyLowerBound, valueBegin, valueEnd, valueLowerBound
+	//   contiguous_key_order - czy key_array daje pary w porządku (klucz, wartość) w jednej tablicy;
+	//     operatory porównania porównują wtedy całe tablice zamiast przechodzić key_cursor
+	//   assignSorted(n, entry_at, key_position) - wypełnienie pustego silnika parami w znanych już
+	//     obu porządkach (z pliku kolejki), bez wstawiania ich pojedynczo
+	//   parallel_bulk - czy kopia, insertRange i merge mają wersje z liczbą wątków (PriorityQueueParallel):
+	//     konstruktor (silnik, alokator, wątki), insertRange(first, last, wątki), merge(silnik, wątki)
+
+
+	// silnik domyślny: każda para to jeden węzeł wpięty w dwa drzewa czerwono-czarne
+	// w trybie count_duplicates węzeł przechowuje wszystkie kopie równej pary (klucz, wartość) i ich liczbę;
+	// size() liczy kopie, a deleteMin, deleteMax i erase usuwają po jednej kopii
+	// w trybie lazy_deletion deleteMin, deleteMax i popMinN wypinają węzeł tylko z drzewa po wartości;
+	// w drzewie po kluczu zostaje jako martwy (pomijany przy szukaniu i przechodzeniu) do compact(),
+	// wywoływanego samoczynnie, gdy martwych węzłów jest więcej niż par
+	template<typename K, typename V, typename Alloc, typename Policy>
+	class tree_engine
+	{
+		static const bool counted = counts_duplicates<Policy>::value;
+		static const bool lazy = deletes_lazily<Policy>::value;
+		static const bool stats = collects_stats<Policy>::value;
+		static const bool basic = relaxes_guarantee<Policy>::value;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef dual_node<K, V, counted, typename key_projection<Policy>::type> node;
+		typedef typename node::prefix_type prefix_type;
+		typedef rb_hook hook;
+		typedef CompByFst<K, V, stats, Policy> by_key_order;
+		typedef CompBySnd<K, V, stats, Policy> by_value_order;
+
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node> node_allocator;
+		typedef std::allocator_traits<node_allocator> node_alloc_traits;
+
+	public:
+		typedef size_t size_type;
+
+		static const bool has_handles = true;
+		static const bool has_ordered_iterators = true;
+		static const bool contiguous_key_order = false;
+		static const bool parallel_bulk = true;
+
+		// uchwyt do pary: wskaźnik na jej węzeł (w trybie count_duplicates - wspólny dla wszystkich kopii pary)
+		class handle
+		{
+		public:
+			handle() noexcept : target(nullptr)
+			{ }
+
+			explicit operator bool() const noexcept
+			{
+				return target != nullptr;
+			}
+
+			bool operator==(const handle& other) const noexcept
+			{
+				return target == other.target;
+			}
+
+			bool operator!=(const handle& other) const noexcept
+			{
+				return target != other.target;
+			}
+
+		private:
+			friend class tree_engine;
+
+			explicit handle(node* n) noexcept : target(n)
+			{ }
+
+			node* target;
+		};
+
+		// przejście po parach w porządku (klucz, wartość), każda kopia pary osobno
+		class key_cursor
+		{
+		public:
+			explicit key_cursor(const tree_engine& engine) noexcept :
+					current(skipDead(engine.impl.by_key.first())), repeated(0)
+			{ }
+
+			bool done() const noexcept
+			{
+				return current == nullptr;
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return node::from_key(current)->entry;
+			}
+
+			void advance() noexcept
+			{
+				if (++repeated < node::from_key(current)->copies())
+					return;
+				current = skipDead(rb_tree::next(current));
+				repeated = 0;
+			}
+
+		private:
+			hook* current;
+			size_type repeated;
+		};
+
+		// dwukierunkowy iterator tylko do odczytu po drzewie po kluczu (ByValue == false) albo po wartości;
+		// każdą kopię pary odwiedza osobno, martwe węzły pomija
+		template<bool ByValue>
+		class ordered_iterator
+		{
+		public:
+			typedef std::bidirectional_iterator_tag iterator_category;
+			typedef key_value_pair value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const key_value_pair* pointer;
+			typedef const key_value_pair& reference;
+
+			ordered_iterator() noexcept : tree(nullptr), current(nullptr), repeated(0)
+			{ }
+
+			reference operator*() const noexcept
+			{
+				return from(current)->entry;
+			}
+
+			pointer operator->() const noexcept
+			{
+				return &from(current)->entry;
+			}
+
+			ordered_iterator& operator++() noexcept
+			{
+				if (++repeated < from(current)->copies())
+					return *this;
+				current = ByValue ? rb_tree::next(current) : skipDead(rb_tree::next(current));
+				repeated = 0;
+				return *this;
+			}
+
+			ordered_iterator operator++(int) noexcept
+			{
+				ordered_iterator result(*this);
+				++*this;
+				return result;
+			}
+
+			ordered_iterator& operator--() noexcept
+			{
+				if (repeated > 0)
+				{
+					--repeated;
+					return *this;
+				}
+				current = current == nullptr ? tree->last() : rb_tree::prev(current);
+				while (!ByValue && isDead(current))
+					current = rb_tree::prev(current);
+				repeated = from(current)->copies() - 1;
+				return *this;
+			}
+
+			ordered_iterator operator--(int) noexcept
+			{
+				ordered_iterator result(*this);
+				--*this;
+				return result;
+			}
+
+			bool operator==(const ordered_iterator& other) const noexcept
+			{
+				return current == other.current && repeated == other.repeated;
+			}
+
+			bool operator!=(const ordered_iterator& other) const noexcept
+			{
+				return !(*this == other);
+			}
+
+		private:
+			friend class tree_engine;
+
+			ordered_iterator(const rb_tree& tree, hook* current) noexcept :
+					tree(&tree), current(ByValue ? current : skipDead(current)), repeated(0)
+			{ }
+
+			static const node* from(hook* h) noexcept
+			{
+				return ByValue ? node::from_value(h) : node::from_key(h);
+			}
+
+			const rb_tree* tree;
+			hook* current;
+			size_type repeated;
+		};
+
+		typedef ordered_iterator<false> key_iterator;
+		typedef ordered_iterator<true> value_iterator;
+
+		explicit tree_engine(const Alloc& alloc) noexcept : impl(node_allocator(alloc))
+		{ }
+
+		// kopia z podanym alokatorem
+		// kopiujemy węzły w kolejności po wartości (dopinanie na koniec drzewa nie wymaga porównań),
+		// a porządek po kluczu odtwarzamy przez odwzorowanie stary węzeł -> nowy węzeł
+		// zlozonosc: O(n log n) operacji na wskaźnikach, bez porównań K i V
+		tree_engine(const tree_engine& engine, const Alloc& alloc) : impl(node_allocator(alloc))
+		{
+			copyNodes(engine);
+		}
+
+		// kopia na najwyżej threads wątkach (PriorityQueueParallel): oba porządki oryginału wypisujemy
+		// równolegle, pamięć na węzły przydzielamy na wątku wywołującym, pary kopiujemy kawałkami
+		// na wszystkich wątkach, a odwzorowanie stary węzeł -> nowy węzeł sortujemy równolegle;
+		// na koniec oba drzewa budujemy naraz
+		// zlozonosc: O(n log n / threads + n) operacji na wskaźnikach, bez porównań K i V
+		tree_engine(const tree_engine& engine, const Alloc& alloc, unsigned threads) : impl(node_allocator(alloc))
+		{
+			size_type workers = parallel_threads(threads, engine.impl.elements);
+			if (workers == 1)
+				copyNodes(engine);
+			else
+				copyNodes(engine, workers);
+		}
+
+		tree_engine(tree_engine&& engine) noexcept : impl(engine.impl.allocator())
+		{
+			swap(engine, false);
+		}
+
+		tree_engine& operator=(const tree_engine&) = delete;
+
+		~tree_engine()
+		{
+			destroySubtree(impl.by_key.top(), &node::from_key);
+		}
+
+		Alloc getAllocator() const noexcept
+		{
+			return Alloc(impl.allocator());
+		}
+
+		// zamiana drzew, a jeśli with_allocators - także alokatorów, no-throw
+		void swap(tree_engine& engine, bool with_allocators) noexcept
+		{
+			impl.by_key.swap(engine.impl.by_key);
+			impl.by_value.swap(engine.impl.by_value);
+			std::swap(impl.elements, engine.impl.elements);
+			std::swap(impl.dead, engine.impl.dead);
+			if (with_allocators)
+				swap_allocators(impl.allocator(), engine.impl.allocator(), propagates_allocator<Alloc>());
+		}
+
+		void clear() noexcept
+		{
+			tree_engine tmp(getAllocator());
+			swap(tmp, false);
+		}
+
+		size_type size() const noexcept
+		{
+			return impl.elements;
+		}
+
+		key_iterator keyBegin() const noexcept
+		{
+			return key_iterator(impl.by_key, impl.by_key.first());
+		}
+
+		key_iterator keyEnd() const noexcept
+		{
+			return key_iterator(impl.by_key, nullptr);
+		}
+
+		value_iterator valueBegin() const noexcept
+		{
+			return value_iterator(impl.by_value, impl.by_value.first());
+		}
+
+		value_iterator valueEnd() const noexcept
+		{
+			return value_iterator(impl.by_value, nullptr);
+		}
+
+		// pierwsza para o kluczu nie mniejszym od key (o wartości nie mniejszej od value), O(log n)
+		template<typename KeyLike>
+		key_iterator keyLowerBound(const KeyLike& key) const
+		{
+			return key_iterator(impl.by_key, keyBound(key));
+		}
+
+		value_iterator valueLowerBound(const V& value) const
+		{
+			return value_iterator(impl.by_value,
+					impl.by_value.lower_bound([&value](hook* x) { return node::from_value(x)->entry.second < value; }));
+		}
+
+		// jedna alokacja na parę, konstruowaną od razu w węźle z args (argumentów konstruktora pary);
+		// porównania wykonujemy przed wpięciem węzła w drzewa
+		// w trybie count_duplicates węzeł równej pary, która już jest w kolejce, jest od razu zwalniany
+		// strong guarantee, O(log n)
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			return handle(linkNode(createNode(std::forward<Args>(args)...)));
+		}
+
+		// wstawienie pary (key, value); w trybie count_duplicates równej pary szukamy, zanim
+		// powstanie węzeł, więc kolejna kopia pary nie wymaga alokacji ani kopiowania K i V
+		// strong guarantee, O(log n)
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			if (!counted)
+				return emplace(std::forward<KK>(key), std::forward<VV>(value));
+
+			node* equal = findPair(key, value);
+			if (equal != nullptr)
+			{
+				addCopies(equal, 1);
+				return handle(equal);
+			}
+			return emplace(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// wstawienie par z zakresu [first, last): najpierw tworzymy wszystkie węzły,
+		// małą partię wpinamy pojedynczo (przy wyjątku wypinamy już wpięte węzły),
+		// a dużą sortujemy raz w każdym z porządków, scalamy z drzewami i budujemy drzewa od nowa
+		// strong guarantee, O(m log (n + m)) albo O(n + m log m)
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			try
+			{
+				for (; first != last; ++first)
+				{
+					fresh.push_back(nullptr);
+					const auto& kv = *first;
+					fresh.back() = createNode(kv.first, kv.second);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			insertNodes(fresh);
+		}
+
+		// insertRange na najwyżej threads wątkach (PriorityQueueParallel): węzły tworzymy na wątku wywołującym,
+		// a dużą partię sortujemy i scalamy z drzewami w obu porządkach równolegle, patrz rebuildWith
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last, unsigned threads)
+		{
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			try
+			{
+				for (; first != last; ++first)
+				{
+					fresh.push_back(nullptr);
+					const auto& kv = *first;
+					fresh.back() = createNode(kv.first, kv.second);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			size_type workers = parallel_threads(threads, impl.elements + fresh.size());
+			if (workers == 1 || fresh.empty() || counted || linkingIsCheaper(fresh.size()))
+				insertNodes(fresh);
+			else
+			{
+				compact();
+				rebuildWith(fresh, workers);
+			}
+		}
+
+		// wypełnienie pustego silnika n parami: entry_at(i) - i-ta para w porządku (wartość, klucz)
+		// (file_entry, wywoływane raz dla każdego i, może oddać parę do przeniesienia),
+		// key_position(i) - numer (w tym porządku) i-tej pary w porządku (klucz, wartość)
+		// drzewa powstają od razu zrównoważone (assign_sorted), bez porównań par; w trybie count_duplicates
+		// równe pary, sąsiednie w obu porządkach, łączymy w jeden węzeł (porównania == sąsiadów)
+		// strong guarantee, O(n)
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition key_position)
+		{
+			assert(impl.elements == 0 && impl.dead == 0);
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			//w trybie count_duplicates: węzeł każdej z n par
+			node_vector of_entry{node_pointer_allocator(impl.allocator())};
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			try
+			{
+				fresh.reserve(n);
+				if (counted)
+					of_entry.reserve(n);
+				for (size_type i = 0; i < n; ++i)
+				{
+					auto e = entry_at(i);
+					if (counted && !fresh.empty() && fresh.back()->entry.first == e.key &&
+							fresh.back()->entry.second == e.value)
+						fresh.back()->set_copies(fresh.back()->copies() + 1);
+					else
+						fresh.push_back(createNode(std::move(e.key), std::move(e.value)));
+					if (counted)
+						of_entry.push_back(fresh.back());
+				}
+				by_key_hooks.reserve(fresh.size());
+				by_value_hooks.reserve(fresh.size());
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			for (node* x : fresh)
+				by_value_hooks.push_back(x->value_link());
+			for (size_type i = 0; i < n; ++i)
+			{
+				hook* h = (counted ? of_entry : fresh)[key_position(i)]->key_link();
+				if (by_key_hooks.empty() || by_key_hooks.back() != h)
+					by_key_hooks.push_back(h);
+			}
+			impl.by_key.assign_sorted(by_key_hooks.data(), by_key_hooks.size());
+			impl.by_value.assign_sorted(by_value_hooks.data(), by_value_hooks.size());
+			impl.elements = n;
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return node::from_value(impl.by_value.first())->entry;
+		}
+
+		const key_value_pair& maxEntry() const noexcept
+		{
+			return node::from_value(impl.by_value.last())->entry;
+		}
+
+		// węzeł zna swoje miejsce w drzewie po kluczu, więc nie szukamy go ponownie
+		// nothrow, O(log n)
+		void deleteMin() noexcept
+		{
+			popCopies(node::from_value(impl.by_value.first()), 1);
+		}
+
+		void deleteMax() noexcept
+		{
+			popCopies(node::from_value(impl.by_value.last()), 1);
+		}
+
+		// zastąpienie pary o najmniejszej (największej) wartości parą (key, value), dla niepustego silnika
+		// strong guarantee, O(log n)
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			replaceEntry(node::from_value(impl.by_value.first()), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			replaceEntry(node::from_value(impl.by_value.last()), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// zwolnienie martwych węzłów (tryb lazy_deletion): jedno przejście drzewa po kluczu rozdziela
+		// zaczepy na żywe (od początku tablicy) i martwe (od końca), po czym drzewo budujemy od nowa
+		// z żywych, O(n + martwe); gdy brakuje pamięci na tablicę, wypinamy martwe pojedynczo
+		// nothrow
+		void compact() noexcept
+		{
+			if (impl.dead == 0)
+				return;
+			if (impl.elements == 0)
+			{
+				destroySubtree(impl.by_key.top(), &node::from_key);
+				impl.by_key.reset();
+				impl.dead = 0;
+				return;
+			}
+			hook_vector hooks{hook_pointer_allocator(impl.allocator())};
+			try
+			{
+				//węzłów jest nie więcej niż kopii par
+				hooks.resize(impl.elements + impl.dead);
+			}
+			catch (...)
+			{
+				for (hook* h = impl.by_key.first(); h != nullptr; )
+				{
+					hook* next = rb_tree::next(h);
+					if (isDead(h))
+					{
+						impl.by_key.erase(h);
+						destroyNode(node::from_key(h));
+					}
+					h = next;
+				}
+				impl.dead = 0;
+				return;
+			}
+
+			size_type live = 0;
+			size_type dead_from = hooks.size();
+			for (hook* h = impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+				if (isDead(h))
+					hooks[--dead_from] = h;
+				else
+					hooks[live++] = h;
+			//węzły zwalniamy dopiero po przejściu drzewa, bo next() chodzi po przodkach
+			for (size_type i = dead_from; i < hooks.size(); ++i)
+				destroyNode(node::from_key(hooks[i]));
+			impl.by_key.assign_sorted(hooks.data(), live);
+			impl.dead = 0;
+		}
+
+		// zapisanie do out min(n, size()) par o najmniejszych wartościach (rosnąco) i ich usunięcie
+		// pary są najpierw zapisywane, a dopiero potem usuwane; duża partia nie jest usuwana
+		// pojedynczo - pozostałe węzły zbieramy z obu drzew i budujemy drzewa od nowa
+		// (w trybie count_duplicates węzły są zawsze usuwane pojedynczo, ostatni może stracić tylko część kopii)
+		// strong guarantee, O(k log n) albo O(n), k = min(n, size())
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			size_type k = std::min(n, impl.elements);
+			size_type left = impl.elements - k;
+			bool rebuild = !counted && !lazy && !linkingIsCheaper(k);
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			if (rebuild)
+			{
+				by_key_hooks.reserve(left);
+				by_value_hooks.reserve(impl.elements);
+			}
+
+			hook* h = impl.by_value.first();
+			for (size_type written = 0; written < k; h = rb_tree::next(h))
+			{
+				const node* e = node::from_value(h);
+				for (size_type c = std::min(e->copies(), k - written); c > 0; --c, ++written)
+				{
+					*out = e->entry;
+					++out;
+				}
+			}
+
+			//od tego miejsca nic nie rzuca
+			if (!rebuild)
+			{
+				for (size_type removed = 0; removed < k; )
+				{
+					node* e = node::from_value(impl.by_value.first());
+					size_type c = std::min(e->copies(), k - removed);
+					popCopies(e, c);
+					removed += c;
+				}
+				return out;
+			}
+
+			//drzewo po wartości i tak budujemy od nowa, więc kolor jego zaczepu oznacza węzły do usunięcia
+			size_type position = 0;
+			for (h = impl.by_value.first(); h != nullptr; h = rb_tree::next(h), ++position)
+			{
+				h->red = position < k;
+				by_value_hooks.push_back(h);
+			}
+			for (h = impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+				if (!node::from_key(h)->value_link()->red)
+					by_key_hooks.push_back(h);
+			//węzły zwalniamy dopiero po przejściu drzew, bo next() chodzi po przodkach
+			for (size_type i = 0; i < k; ++i)
+				destroyNode(node::from_value(by_value_hooks[i]));
+			impl.by_key.assign_sorted(by_key_hooks.data(), left);
+			impl.by_value.assign_sorted(by_value_hooks.data() + k, left);
+			impl.elements = left;
+			return out;
+		}
+
+		// jedno wyszukanie po kluczu i przepięcie istniejącego węzła
+		// strong guarantee, O(log n)
+		// KeyLike - K albo typ porównywalny z K (K == KeyLike i K < KeyLike), np. std::string_view
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			//szukamy pary o danym kluczu (tej o najmniejszej wartości)
+			node* n = findKey(key);
+			if (n == nullptr)
+				return false;
+			changeNodeValue(n, value);
+			return true;
+		}
+
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			return findKey(key) != nullptr;
+		}
+
+		handle changeValue(handle h, const V& value)
+		{
+			return handle(changeNodeValue(h.target, value));
+		}
+
+		const key_value_pair& entry(handle h) const noexcept
+		{
+			return h.target->entry;
+		}
+
+		void erase(handle h) noexcept
+		{
+			removeCopies(h.target, 1);
+		}
+
+		// przeniesienie wszystkich par engine do *this, bez kopii zapasowej *this; strong guarantee
+		// przy równych alokatorach węzły engine są przepinane bez alokacji: pojedynczo, O(m log (n + m)),
+		// albo scaleniem drzew i zbudowaniem ich od nowa, O(n + m); przy różnych - kopiowane jak w insertRange
+		// w trybie count_duplicates węzły są przepinane zawsze pojedynczo, a kopie równych par łączone w jeden węzeł
+		void merge(tree_engine& engine)
+		{
+			if (engine.impl.elements == 0)
+				return;
+			if (!(impl.allocator() == engine.impl.allocator()))
+			{
+				if (basic && (counted || linkingIsCheaper(engine.impl.elements)))
+				{
+					copyEach(engine);
+					return;
+				}
+				node_vector fresh{node_pointer_allocator(impl.allocator())};
+				try
+				{
+					fresh.reserve(engine.impl.elements);
+					for (hook* h = skipDead(engine.impl.by_key.first()); h != nullptr; h = skipDead(rb_tree::next(h)))
+					{
+						const node* n = node::from_key(h);
+						fresh.push_back(createNode(n->entry.first, n->entry.second));
+						fresh.back()->set_copies(n->copies());
+					}
+				}
+				catch (...)
+				{
+					count_event<stats>(&PriorityQueueStats::rollbacks);
+					destroyNodes(fresh, 0);
+					throw;
+				}
+				insertNodes(fresh);
+				engine.clear();
+			}
+			else if (counted || linkingIsCheaper(engine.impl.elements))
+				spliceEach(engine);
+			else
+				spliceMerged(engine);
+		}
+
+		// merge na najwyżej threads wątkach (PriorityQueueParallel), gdy drzewa są budowane od nowa:
+		// przy równych alokatorach wypisujemy cztery drzewa i scalamy oba porządki równolegle, kawałkami;
+		// przy różnych najpierw kopiujemy engine równolegle (jak konstruktor kopiujący), a kopię przepinamy
+		// strong guarantee; pozostałe przypadki (także count_duplicates) - jak merge(engine)
+		void merge(tree_engine& engine, unsigned threads)
+		{
+			size_type workers = parallel_threads(threads, impl.elements + engine.impl.elements);
+			if (workers == 1 || counted || linkingIsCheaper(engine.impl.elements))
+				merge(engine);
+			else if (!(impl.allocator() == engine.impl.allocator()))
+			{
+				tree_engine copy(engine, getAllocator(), threads);
+				spliceMerged(copy, workers);
+				engine.clear();
+			}
+			else
+				spliceMerged(engine, workers);
+		}
+
+	private:
+		// każda para (klucz, wartość) to jeden węzeł, wpięty w oba drzewa naraz
+		// alokator węzłów jest klasą bazową, więc pusty alokator nie zajmuje miejsca
+		struct engine_impl : node_allocator
+		{
+			rb_tree by_key;   // porządek (klucz, wartość)
+			rb_tree by_value; // porządek (wartość, klucz)
+			size_type elements;
+			size_type dead;   // martwe węzły w drzewie po kluczu (tryb lazy_deletion)
+
+			explicit engine_impl(const node_allocator& alloc) noexcept :
+					node_allocator(alloc), elements(0), dead(0)
+			{ }
+
+			node_allocator& allocator() noexcept
+			{
+				return *this;
+			}
+
+			const node_allocator& allocator() const noexcept
+			{
+				return *this;
+			}
+		};
+
+		engine_impl impl;
+
+		// alokacja i zwolnienie pojedynczego węzła alokatorem kolejki
+		// args - argumenty konstruktora pary
+		template<typename... Args>
+		node* createNode(Args&&... args)
+		{
+			typename node_alloc_traits::pointer p = node_alloc_traits::allocate(impl.allocator(), 1);
+			count_event<stats>(&PriorityQueueStats::allocations);
+			node* n = std::addressof(*p);
+			try
+			{
+				node_alloc_traits::construct(impl.allocator(), n, std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				node_alloc_traits::deallocate(impl.allocator(), p, 1);
+				throw;
+			}
+			return n;
+		}
+
+		void destroyNode(node* n) noexcept
+		{
+			node_alloc_traits::destroy(impl.allocator(), n);
+			node_alloc_traits::deallocate(impl.allocator(),
+					std::pointer_traits<typename node_alloc_traits::pointer>::pointer_to(*n), 1);
+		}
+
+		// zwolnienie wszystkich węzłów poddrzewa, głębokość rekursji O(log n)
+		// from wybiera drzewo, przez którego zaczepy przechodzimy
+		void destroySubtree(hook* h, node* (*from)(hook*)) noexcept
+		{
+			if (!h)
+				return;
+			destroySubtree(h->left, from);
+			destroySubtree(h->right, from);
+			destroyNode(from(h));
+		}
+
+		// martwy węzeł (tryb lazy_deletion) jest wypięty z drzewa po wartości, a jego zaczep
+		// po wartości wskazuje na siebie - taki zaczep nie występuje w żadnym drzewie
+		static bool isDead(hook* key_link) noexcept
+		{
+			if (!lazy)
+				return false;
+			hook* value_link = node::from_key(key_link)->value_link();
+			return value_link->parent == value_link;
+		}
+
+		// pierwszy żywy węzeł od h w porządku po kluczu (h, gdy h żyje), albo nullptr
+		static hook* skipDead(hook* h) noexcept
+		{
+			while (h != nullptr && isDead(h))
+				h = rb_tree::next(h);
+			return h;
+		}
+
+		// porządek po kluczu pary (ak, av) o prefiksie klucza ap względem (bk, bv) o prefiksie bp:
+		// różne prefiksy (polityka key_prefix) rozstrzygają bez porównania par
+		static bool keyOrderLess(prefix_type ap, const K& ak, const V& av, prefix_type bp, const K& bk, const V& bv)
+		{
+			int order = node::prefix_order(ap, bp);
+			if (order != 0)
+				return order < 0;
+			return by_key_order::less(ak, av, bk, bv);
+		}
+
+		static bool keyOrderLess(const node* a, const node* b)
+		{
+			return keyOrderLess(a->key_prefix(), a->entry.first, a->entry.second,
+					b->key_prefix(), b->entry.first, b->entry.second);
+		}
+
+		// porządki na węzłach, dla sortowania i scalania
+		struct node_key_order
+		{
+			bool operator()(const node* a, const node* b) const
+			{
+				return keyOrderLess(a, b);
+			}
+		};
+
+		struct node_value_order
+		{
+			bool operator()(const node* a, const node* b) const
+			{
+				return by_value_order()(a->entry, b->entry);
+			}
+		};
+
+		// pierwszy węzeł drzewa po kluczu o kluczu nie mniejszym od key (także martwy), albo nullptr;
+		// dla key typu K najpierw porównujemy prefiksy
+		hook* keyBound(const K& key) const
+		{
+			prefix_type p = node::prefix_of(key);
+			return impl.by_key.lower_bound([&](hook* x)
+			{
+				const node* n = node::from_key(x);
+				int order = node::prefix_order(n->key_prefix(), p);
+				return order != 0 ? order < 0 : n->entry.first < key;
+			});
+		}
+
+		template<typename KeyLike>
+		hook* keyBound(const KeyLike& key) const
+		{
+			return impl.by_key.lower_bound([&key](hook* x) { return node::from_key(x)->entry.first < key; });
+		}
+
+		// miejsca w obu drzewach dla nowego węzła n, nie modyfikuje silnika
+		rb_spot keySpot(const node* n) const
+		{
+			return impl.by_key.find_spot([n](hook* h) { return keyOrderLess(n, node::from_key(h)); });
+		}
+
+		rb_spot valueSpot(const key_value_pair& kv) const
+		{
+			return impl.by_value.find_spot([&kv](hook* h) { return by_value_order()(kv, node::from_value(h)->entry); });
+		}
+
+		// w trybie count_duplicates: węzeł pary równej parze węzła n, która trafiłaby tuż przed key_spot
+		// (wynik keySpot - wszystkie pary nie większe od nowej są przed tym miejscem), nullptr gdy nie ma
+		node* equalBefore(const rb_spot& key_spot, const node* n) const
+		{
+			if (!counted || key_spot.parent == nullptr)
+				return nullptr;
+			hook* before = key_spot.left ? rb_tree::prev(key_spot.parent) : key_spot.parent;
+			while (before != nullptr && isDead(before))
+				before = rb_tree::prev(before);
+			if (before == nullptr)
+				return nullptr;
+			return keyOrderLess(node::from_key(before), n) ? nullptr : node::from_key(before);
+		}
+
+		// węzeł pary równej (key, value), nullptr gdy nie ma
+		node* findPair(const K& key, const V& value) const
+		{
+			prefix_type p = node::prefix_of(key);
+			hook* h = skipDead(impl.by_key.lower_bound([&](hook* x) { const node* n = node::from_key(x);
+					return keyOrderLess(n->key_prefix(), n->entry.first, n->entry.second, p, key, value); }));
+			if (h == nullptr)
+				return nullptr;
+			const node* n = node::from_key(h);
+			return keyOrderLess(p, key, value, n->key_prefix(), n->entry.first, n->entry.second) ?
+					nullptr : node::from_key(h);
+		}
+
+		// wpięcie gotowego węzła w oba drzewa; w trybie count_duplicates, jeśli równa para już jest
+		// w kolejce, jej węzeł przejmuje kopie n, a n jest zwalniany
+		// zwraca węzeł, w którym są teraz kopie n
+		// strong guarantee: wyjątek z porównań zwalnia n i nie zmienia silnika
+		node* linkNode(node* n)
+		{
+			rb_spot key_spot, value_spot;
+			node* equal;
+			try
+			{
+				key_spot = keySpot(n);
+				equal = equalBefore(key_spot, n);
+				if (equal == nullptr)
+					value_spot = valueSpot(n->entry);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(n);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			if (equal != nullptr)
+			{
+				addCopies(equal, n->copies());
+				destroyNode(n);
+				return equal;
+			}
+			impl.by_key.link(key_spot, n->key_link());
+			impl.by_value.link(value_spot, n->value_link());
+			impl.elements += n->copies();
+			return n;
+		}
+
+		// odpięcie węzła z obu drzew i jego zwolnienie (razem ze wszystkimi kopiami), no-throw
+		void eraseNode(node* n) noexcept
+		{
+			impl.by_key.erase(n->key_link());
+			impl.by_value.erase(n->value_link());
+			impl.elements -= n->copies();
+			destroyNode(n);
+		}
+
+		// dodanie (usunięcie) c kopii pary z węzła n; węzeł bez kopii jest usuwany, no-throw
+		void addCopies(node* n, size_type c) noexcept
+		{
+			n->set_copies(n->copies() + c);
+			impl.elements += c;
+		}
+
+		void removeCopies(node* n, size_type c) noexcept
+		{
+			if (n->copies() == c)
+				eraseNode(n);
+			else
+			{
+				n->set_copies(n->copies() - c);
+				impl.elements -= c;
+			}
+		}
+
+		// usunięcie c kopii przez deleteMin, deleteMax i popMinN; w trybie lazy_deletion węzeł bez kopii
+		// wypinamy tylko z drzewa po wartości i oznaczamy jako martwy, no-throw
+		void popCopies(node* n, size_type c) noexcept
+		{
+			if (!lazy || n->copies() != c)
+			{
+				removeCopies(n, c);
+				return;
+			}
+			impl.by_value.erase(n->value_link());
+			n->value_link()->parent = n->value_link();
+			impl.elements -= c;
+			++impl.dead;
+			if (impl.dead > 4 * impl.elements && impl.dead >= 32)
+				compact();
+		}
+
+		typedef typename node_alloc_traits::template rebind_alloc<node*> node_pointer_allocator;
+		typedef std::vector<node*, node_pointer_allocator> node_vector;
+		typedef typename node_alloc_traits::template rebind_alloc<hook*> hook_pointer_allocator;
+		typedef std::vector<hook*, hook_pointer_allocator> hook_vector;
+
+		// zwolnienie węzłów fresh[from..], puste miejsca (nullptr) są pomijane
+		void destroyNodes(const node_vector& fresh, size_type from) noexcept
+		{
+			for (size_type i = from; i < fresh.size(); ++i)
+				if (fresh[i] != nullptr)
+					destroyNode(fresh[i]);
+		}
+
+		// czy m pojedynczych wpięć (O(m log (n + m))) jest tańsze od zbudowania drzew od nowa (O(n + m))
+		bool linkingIsCheaper(size_type m) const noexcept
+		{
+			size_type total = impl.elements + m;
+			size_type depth = 1;
+			while ((size_type(1) << depth) < total)
+				++depth;
+			return m * depth < impl.elements;
+		}
+
+		// wpięcie nowych węzłów fresh (kolejka przejmuje je na własność), strong guarantee:
+		// przy wyjątku wszystkie węzły fresh są zwalniane, a kolejka się nie zmienia
+		// w trybie count_duplicates węzły są wpinane zawsze pojedynczo, bo budowanie drzew od nowa
+		// nie łączy kopii równych par
+		void insertNodes(const node_vector& fresh)
+		{
+			if (fresh.empty())
+				return;
+			if (counted || linkingIsCheaper(fresh.size()))
+				linkEach(fresh);
+			else
+			{
+				//drzewa budowane od nowa nie mają miejsca na martwe węzły
+				compact();
+				rebuildWith(fresh);
+			}
+		}
+
+		// wpięcie kolejnych węzłów fresh, strong guarantee
+		// w trybie count_duplicates zapamiętujemy, do którego węzła trafiły kopie każdego z nich,
+		// i przy wyjątku odejmujemy je od końca (linkNode rzuca tylko to, co porównania)
+		// w trybie basic_guarantee wpięte węzły zostają w kolejce, a zwalniamy tylko pozostałe
+		void linkEach(const node_vector& fresh)
+		{
+			typedef std::pair<node*, size_type> link_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<link_entry> link_allocator;
+			const bool logged = counted && !basic && !nothrow_comparable<K, V>::value;
+			std::vector<link_entry, link_allocator> linked{link_allocator(impl.allocator())};
+			try
+			{
+				if (logged)
+					linked.reserve(fresh.size());
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+
+			size_type i = 0;
+			try
+			{
+				for (; i < fresh.size(); ++i)
+				{
+					size_type copies = fresh[i]->copies();
+					node* target = linkNode(fresh[i]);
+					if (logged)
+						linked.emplace_back(target, copies);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				//fresh[i] zwolnił już linkNode
+				if (logged)
+					for (size_type j = linked.size(); j-- > 0; )
+						removeCopies(linked[j].first, linked[j].second);
+				else if (!basic)
+					for (size_type j = 0; j < i; ++j)
+						eraseNode(fresh[j]);
+				destroyNodes(fresh, i + 1);
+				throw;
+			}
+		}
+
+		// scalenie węzłów drzewa tree z posortowanymi węzłami fresh w jeden ciąg zaczepów
+		// przy równych parach stare węzły idą pierwsze, jak przy wstawianiu pojedynczo
+		// out ma zarezerwowane miejsce, więc rzuca tylko to, co porównania
+		template<typename Less, typename ToHook>
+		static void mergeSorted(const rb_tree& tree, node* (*from)(hook*), const node_vector& fresh,
+				Less less, ToHook to, hook_vector& out)
+		{
+			hook* h = tree.first();
+			size_type i = 0;
+			while (h != nullptr || i < fresh.size())
+			{
+				if (h == nullptr || (i < fresh.size() && less(fresh[i], from(h))))
+					out.push_back(to(fresh[i++]));
+				else
+				{
+					out.push_back(h);
+					h = rb_tree::next(h);
+				}
+			}
+		}
+
+		// wpięcie węzłów fresh przez zbudowanie obu drzew od nowa, strong guarantee
+		// porównania: sortowanie fresh w obu porządkach i scalenie z drzewami
+		void rebuildWith(const node_vector& fresh)
+		{
+			size_type total = impl.elements + fresh.size();
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			try
+			{
+				//sortujemy kopię - przerwane wyjątkiem sortowanie może zdublować wskaźnik
+				node_vector sorted(fresh);
+				by_key_hooks.reserve(total);
+				by_value_hooks.reserve(total);
+				std::sort(sorted.begin(), sorted.end(), node_key_order());
+				mergeSorted(impl.by_key, &node::from_key, sorted, node_key_order(),
+						[](node* n) { return n->key_link(); }, by_key_hooks);
+				std::sort(sorted.begin(), sorted.end(), node_value_order());
+				mergeSorted(impl.by_value, &node::from_value, sorted, node_value_order(),
+						[](node* n) { return n->value_link(); }, by_value_hooks);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_key.assign_sorted(by_key_hooks.data(), total);
+			impl.by_value.assign_sorted(by_value_hooks.data(), total);
+			impl.elements = total;
+		}
+
+		// przepięcie węzłów engine (o tym samym alokatorze) pojedynczo, od najmniejszej wartości
+		// miejsca w *this liczymy, zanim węzeł opuści engine; przy wyjątku cofamy przepięcia od końca,
+		// wstawiając węzły z powrotem przed ich dawnych następników w engine - bez porównań
+		// dziennik cofania nie jest potrzebny, gdy porównania K i V nie rzucają
+		// w trybie count_duplicates węzeł pary, która już jest w *this, oddaje jej węzłowi swoje kopie
+		// i jest zwalniany dopiero po przepięciu wszystkich (do tego czasu może wrócić do engine)
+		// strong guarantee, O(m log (n + m)), bez alokacji węzłów
+		// w trybie basic_guarantee nie ma dziennika: przy wyjątku przepięte węzły zostają w *this,
+		// a reszta w engine
+		void spliceEach(tree_engine& engine)
+		{
+			const bool undoable = !basic && !nothrow_comparable<K, V>::value;
+			struct undo_entry
+			{
+				node* moved;
+				hook* key_next;
+				hook* value_next;
+				node* absorbed_by;
+			};
+			typedef typename node_alloc_traits::template rebind_alloc<undo_entry> undo_allocator;
+			std::vector<undo_entry, undo_allocator> undo{undo_allocator(impl.allocator())};
+			if (undoable)
+				undo.reserve(engine.impl.elements);
+
+			try
+			{
+				while (engine.impl.elements != 0)
+				{
+					node* n = node::from_value(engine.impl.by_value.first());
+					rb_spot key_spot = keySpot(n);
+					node* equal = equalBefore(key_spot, n);
+					rb_spot value_spot = {nullptr, true};
+					if (equal == nullptr)
+						value_spot = valueSpot(n->entry);
+					//od tego miejsca do końca obrotu pętli nic nie rzuca
+					if (undoable)
+						undo.push_back(undo_entry{n, rb_tree::next(n->key_link()), rb_tree::next(n->value_link()), equal});
+					engine.impl.by_key.erase(n->key_link());
+					engine.impl.by_value.erase(n->value_link());
+					engine.impl.elements -= n->copies();
+					if (equal != nullptr)
+					{
+						addCopies(equal, n->copies());
+						if (!undoable)
+							destroyNode(n);
+						continue;
+					}
+					impl.by_key.link(key_spot, n->key_link());
+					impl.by_value.link(value_spot, n->value_link());
+					impl.elements += n->copies();
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				for (size_type i = undo.size(); i-- > 0; )
+				{
+					node* n = undo[i].moved;
+					if (undo[i].absorbed_by != nullptr)
+					{
+						undo[i].absorbed_by->set_copies(undo[i].absorbed_by->copies() - n->copies());
+						impl.elements -= n->copies();
+					}
+					else
+					{
+						impl.by_key.erase(n->key_link());
+						impl.by_value.erase(n->value_link());
+						impl.elements -= n->copies();
+					}
+					engine.impl.by_key.insert_before(undo[i].key_next, n->key_link());
+					engine.impl.by_value.insert_before(undo[i].value_next, n->value_link());
+					engine.impl.elements += n->copies();
+				}
+				throw;
+			}
+			for (const undo_entry& u : undo)
+				if (u.absorbed_by != nullptr)
+					destroyNode(u.moved);
+			//w engine zostały tylko martwe węzły
+			engine.compact();
+		}
+
+		// w trybie basic_guarantee: skopiowanie par engine (o innym alokatorze) pojedynczo, bez tablicy
+		// nowych węzłów - każda para trafia do *this i od razu znika z engine, więc przy wyjątku
+		// każda jest w dokładnie jednej z kolejek; O(m log (n + m))
+		void copyEach(tree_engine& engine)
+		{
+			hook* h = skipDead(engine.impl.by_key.first());
+			while (h != nullptr)
+			{
+				node* n = node::from_key(h);
+				node* fresh = createNode(n->entry.first, n->entry.second);
+				fresh->set_copies(n->copies());
+				linkNode(fresh);
+				h = skipDead(rb_tree::next(h));
+				engine.eraseNode(n);
+			}
+			//w engine zostały tylko martwe węzły
+			engine.clear();
+		}
+
+		// scalenie dwóch drzew tego samego rodzaju w jeden ciąg zaczepów, przy równych parach a idzie pierwsze
+		// out ma zarezerwowane miejsce, więc rzuca tylko to, co porównania
+		template<typename Less>
+		static void mergeTrees(const rb_tree& a, const rb_tree& b, node* (*from)(hook*), Less less,
+				hook_vector& out)
+		{
+			hook* x = a.first();
+			hook* y = b.first();
+			while (x != nullptr || y != nullptr)
+			{
+				if (x == nullptr || (y != nullptr && less(from(y), from(x))))
+				{
+					out.push_back(y);
+					y = rb_tree::next(y);
+				}
+				else
+				{
+					out.push_back(x);
+					x = rb_tree::next(x);
+				}
+			}
+		}
+
+		// przepięcie wszystkich węzłów engine (o tym samym alokatorze) przez scalenie drzew
+		// i zbudowanie ich od nowa; do końca porównań żadne drzewo nie jest zmieniane
+		// strong guarantee, O(n + m), bez alokacji węzłów
+		void spliceMerged(tree_engine& engine)
+		{
+			compact();
+			engine.compact();
+			size_type total = impl.elements + engine.impl.elements;
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			by_key_hooks.reserve(total);
+			by_value_hooks.reserve(total);
+			mergeTrees(impl.by_key, engine.impl.by_key, &node::from_key, node_key_order(), by_key_hooks);
+			mergeTrees(impl.by_value, engine.impl.by_value, &node::from_value, node_value_order(), by_value_hooks);
+
+			//od tego miejsca nic nie rzuca
+			impl.by_key.assign_sorted(by_key_hooks.data(), total);
+			impl.by_value.assign_sorted(by_value_hooks.data(), total);
+			impl.elements = total;
+			engine.impl.by_key.reset();
+			engine.impl.by_value.reset();
+			engine.impl.elements = 0;
+		}
+
+		// wypisanie zaczepów drzewa tree w kolejności drzewa na koniec out
+		static void appendTree(const rb_tree& tree, hook_vector& out)
+		{
+			for (hook* h = tree.first(); h != nullptr; h = rb_tree::next(h))
+				out.push_back(h);
+		}
+
+		// kopia węzłów engine do pustego *this, patrz konstruktory kopiujące
+		void copyNodes(const tree_engine& engine)
+		{
+			typedef std::pair<const node*, node*> copy_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<copy_entry> copy_allocator;
+			std::vector<copy_entry, copy_allocator> copies{copy_allocator(impl.allocator())};
+			copies.reserve(engine.size());
+			try
+			{
+				for (hook* h = engine.impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+				{
+					const node* original = node::from_value(h);
+					node* copy = createNode(original->entry.first, original->entry.second);
+					copy->set_copies(original->copies());
+					impl.by_value.insert_before(nullptr, copy->value_link());
+					impl.elements += copy->copies();
+					copies.emplace_back(original, copy);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				//częściowa kopia jest wpięta tylko w drzewo po wartości
+				destroySubtree(impl.by_value.top(), &node::from_value);
+				throw;
+			}
+
+			//od tego miejsca nic nie rzuca
+			std::less<const node*> address_less;
+			std::sort(copies.begin(), copies.end(),
+					[&address_less](const copy_entry& a, const copy_entry& b)
+					{ return address_less(a.first, b.first); });
+			for (hook* h = skipDead(engine.impl.by_key.first()); h != nullptr; h = skipDead(rb_tree::next(h)))
+			{
+				const node* original = node::from_key(h);
+				auto it = std::lower_bound(copies.begin(), copies.end(), original,
+						[&address_less](const copy_entry& a, const node* b)
+						{ return address_less(a.first, b); });
+				impl.by_key.insert_before(nullptr, it->second->key_link());
+			}
+		}
+
+		// kopia węzłów engine do pustego *this na workers wątkach
+		// pary kopiuje kawałkami workers zadań; kawałek, w którym konstruktor rzuci, sam zwalnia
+		// skopiowane pary, a built zapamiętuje kawałki skopiowane w całości - przy wyjątku zwalniamy
+		// ich węzły, a z pozostałych tylko pamięć
+		void copyNodes(const tree_engine& engine, size_type workers)
+		{
+			typedef std::pair<const node*, node*> copy_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<copy_entry> copy_allocator;
+			typedef typename node_alloc_traits::template rebind_alloc<char> flag_allocator;
+			typedef typename node_alloc_traits::pointer node_pointer;
+			auto bound = [workers](size_type n, size_type i) { return n / workers * i + n % workers * i / workers; };
+
+			hook_vector by_value_originals{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_key_originals{hook_pointer_allocator(impl.allocator())};
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			std::vector<copy_entry, copy_allocator> copies{copy_allocator(impl.allocator())};
+			std::vector<char, flag_allocator> built{flag_allocator(impl.allocator())};
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			parallel_runner<node_allocator> runner(impl.allocator());
+			try
+			{
+				runner.reserve(workers);
+				built.resize(workers);
+				by_value_originals.reserve(engine.impl.elements);
+				by_key_originals.reserve(engine.impl.elements);
+				runner.run(2, [&](size_type side)
+				{
+					if (side == 1)
+						appendTree(engine.impl.by_value, by_value_originals);
+					else
+						for (hook* h = skipDead(engine.impl.by_key.first()); h != nullptr; h = skipDead(rb_tree::next(h)))
+							by_key_originals.push_back(h);
+				});
+
+				size_type n = by_value_originals.size();
+				copies.resize(n);
+				by_key_hooks.resize(n);
+				by_value_hooks.resize(n);
+				fresh.reserve(n);
+				for (size_type i = 0; i < n; ++i)
+				{
+					fresh.push_back(std::addressof(*node_alloc_traits::allocate(impl.allocator(), 1)));
+					count_event<stats>(&PriorityQueueStats::allocations);
+				}
+
+				runner.run(workers, [&](size_type c)
+				{
+					size_type lo = bound(n, c);
+					size_type i = lo;
+					try
+					{
+						for (; i < bound(n, c + 1); ++i)
+						{
+							const node* original = node::from_value(by_value_originals[i]);
+							node_alloc_traits::construct(impl.allocator(), fresh[i],
+									original->entry.first, original->entry.second);
+							fresh[i]->set_copies(original->copies());
+							copies[i] = copy_entry(original, fresh[i]);
+							by_value_hooks[i] = fresh[i]->value_link();
+						}
+					}
+					catch (...)
+					{
+						while (i-- > lo)
+							node_alloc_traits::destroy(impl.allocator(), fresh[i]);
+						throw;
+					}
+					built[c] = 1;
+				});
+
+				std::less<const node*> address_less;
+				parallel_sort(copies, [&address_less](const copy_entry& a, const copy_entry& b)
+						{ return address_less(a.first, b.first); }, workers);
+				runner.run(workers, [&](size_type c)
+				{
+					for (size_type i = bound(n, c); i < bound(n, c + 1); ++i)
+					{
+						const node* original = node::from_key(by_key_originals[i]);
+						auto it = std::lower_bound(copies.begin(), copies.end(), original,
+								[&address_less](const copy_entry& a, const node* b)
+								{ return address_less(a.first, b); });
+						by_key_hooks[i] = it->second->key_link();
+					}
+				});
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				size_type n = by_value_originals.size();
+				for (size_type c = 0; c < built.size(); ++c)
+					for (size_type i = bound(n, c); i < bound(n, c + 1) && i < fresh.size(); ++i)
+					{
+						if (built[c])
+							node_alloc_traits::destroy(impl.allocator(), fresh[i]);
+						node_alloc_traits::deallocate(impl.allocator(),
+								std::pointer_traits<node_pointer>::pointer_to(*fresh[i]), 1);
+					}
+				throw;
+			}
+
+			//od tego miejsca nic nie rzuca
+			size_type n = by_value_hooks.size();
+			runner.run(2, [&](size_type side) noexcept
+			{
+				if (side == 1)
+					impl.by_value.assign_sorted(by_value_hooks.data(), n);
+				else
+					impl.by_key.assign_sorted(by_key_hooks.data(), n);
+			});
+			impl.elements = engine.impl.elements;
+		}
+
+		// mergeSorted na threads wątkach: kopię fresh (jako zaczepy) sortujemy równolegle i scalamy
+		// kawałkami z wypisanym drzewem tree; out ma już rozmiar wyniku, rzuca to, co porównania i alokacja
+		template<typename Less, typename ToHook>
+		static void mergeSorted(const rb_tree& tree, node* (*from)(hook*), const node_vector& fresh,
+				Less less, ToHook to, hook_vector& out, size_type threads)
+		{
+			hook_vector existing(out.get_allocator());
+			hook_vector sorted(out.get_allocator());
+			existing.reserve(out.size() - fresh.size());
+			sorted.reserve(fresh.size());
+			appendTree(tree, existing);
+			for (node* n : fresh)
+				sorted.push_back(to(n));
+			auto hook_less = [from, less](hook* a, hook* b) { return less(from(a), from(b)); };
+			parallel_sort(sorted, hook_less, threads);
+			parallel_merge(existing.data(), existing.size(), sorted.data(), sorted.size(), out.data(),
+					hook_less, threads, out.get_allocator());
+		}
+
+		// rebuildWith na workers wątkach: porządek po kluczu i po wartości liczą równolegle
+		// dwie grupy wątków, a potem oba drzewa budujemy naraz; strong guarantee
+		void rebuildWith(const node_vector& fresh, size_type workers)
+		{
+			size_type total = impl.elements + fresh.size();
+			size_type key_workers = workers / 2;
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			parallel_runner<node_allocator> runner(impl.allocator());
+			try
+			{
+				runner.reserve(2);
+				by_key_hooks.resize(total);
+				by_value_hooks.resize(total);
+				runner.run(2, [&](size_type side)
+				{
+					if (side == 1)
+						mergeSorted(impl.by_value, &node::from_value, fresh, node_value_order(),
+								[](node* n) { return n->value_link(); }, by_value_hooks, workers - key_workers);
+					else
+						mergeSorted(impl.by_key, &node::from_key, fresh, node_key_order(),
+								[](node* n) { return n->key_link(); }, by_key_hooks, key_workers);
+				});
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			runner.run(2, [&](size_type side) noexcept
+			{
+				if (side == 1)
+					impl.by_value.assign_sorted(by_value_hooks.data(), total);
+				else
+					impl.by_key.assign_sorted(by_key_hooks.data(), total);
+			});
+			impl.elements = total;
+		}
+
+		// spliceMerged na workers wątkach: cztery drzewa wypisujemy równolegle, oba porządki
+		// scalamy naraz (każdy kawałkami na połowie wątków), a potem oba drzewa budujemy naraz
+		// strong guarantee, O((n + m) / workers) porównań na wątek, bez alokacji węzłów
+		void spliceMerged(tree_engine& engine, size_type workers)
+		{
+			compact();
+			engine.compact();
+			size_type total = impl.elements + engine.impl.elements;
+			size_type key_workers = workers / 2;
+			hook_vector own_by_key{hook_pointer_allocator(impl.allocator())};
+			hook_vector own_by_value{hook_pointer_allocator(impl.allocator())};
+			hook_vector other_by_key{hook_pointer_allocator(impl.allocator())};
+			hook_vector other_by_value{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			parallel_runner<node_allocator> runner(impl.allocator());
+			runner.reserve(4);
+			own_by_key.reserve(impl.elements);
+			own_by_value.reserve(impl.elements);
+			other_by_key.reserve(engine.impl.elements);
+			other_by_value.reserve(engine.impl.elements);
+			by_key_hooks.resize(total);
+			by_value_hooks.resize(total);
+
+			const rb_tree* trees[4] = {&impl.by_key, &impl.by_value, &engine.impl.by_key, &engine.impl.by_value};
+			hook_vector* lists[4] = {&own_by_key, &own_by_value, &other_by_key, &other_by_value};
+			runner.run(4, [&](size_type i) { appendTree(*trees[i], *lists[i]); });
+			runner.run(2, [&](size_type side)
+			{
+				if (side == 1)
+				{
+					auto less = [](hook* a, hook* b)
+							{ return by_value_order()(node::from_value(a)->entry, node::from_value(b)->entry); };
+					parallel_merge(own_by_value.data(), own_by_value.size(), other_by_value.data(),
+							other_by_value.size(), by_value_hooks.data(), less, workers - key_workers,
+							by_value_hooks.get_allocator());
+				}
+				else
+				{
+					auto less = [](hook* a, hook* b)
+							{ return keyOrderLess(node::from_key(a), node::from_key(b)); };
+					parallel_merge(own_by_key.data(), own_by_key.size(), other_by_key.data(),
+							other_by_key.size(), by_key_hooks.data(), less, key_workers,
+							by_key_hooks.get_allocator());
+				}
+			});
+
+			//od tego miejsca nic nie rzuca
+			runner.run(2, [&](size_type side) noexcept
+			{
+				if (side == 1)
+					impl.by_value.assign_sorted(by_value_hooks.data(), total);
+				else
+					impl.by_key.assign_sorted(by_key_hooks.data(), total);
+			});
+			impl.elements = total;
+			engine.impl.by_key.reset();
+			engine.impl.by_value.reset();
+			engine.impl.elements = 0;
+		}
+
+		// węzeł o kluczu key i najmniejszej wartości spośród takich, nullptr gdy nie ma
+		template<typename KeyLike>
+		node* findKey(const KeyLike& key) const
+		{
+			hook* h = skipDead(keyBound(key));
+			if (h == nullptr || !(node::from_key(h)->entry.first == key))
+				return nullptr;
+			return node::from_key(h);
+		}
+
+		// nowe miejsce węzła self po zmianie jego wartości w drzewie tree:
+		// stay == true, gdy węzeł może zostać tam, gdzie jest (sprawdzamy tylko sąsiadów),
+		// wpp. węzeł trzeba przepiąć bezpośrednio przed before
+		// probe_less(h) - czy para po zmianie jest mniejsza od h; less_probe(h) - czy h jest mniejsze od niej
+		// rzuca tylko to, co porównania; drzewo nie jest zmieniane
+		struct relink_position
+		{
+			bool stay;
+			hook* before;
+		};
+
+		template<typename ProbeLess, typename LessProbe>
+		static relink_position relinkPosition(const rb_tree& tree, hook* self,
+				ProbeLess probe_less, LessProbe less_probe)
+		{
+			hook* prev = rb_tree::prev(self);
+			hook* next = rb_tree::next(self);
+			if ((prev == nullptr || !probe_less(prev)) && (next == nullptr || !less_probe(next)))
+				return relink_position{true, nullptr};
+
+			//pierwszy element większy od nowej pary, jak przy insert
+			hook* before = tree.lower_bound([&probe_less](hook* h) { return !probe_less(h); });
+			if (before == self)
+				before = next;
+			return relink_position{false, before};
+		}
+
+		// zamiana pary w węźle n na (key, value) bez alokacji: najpierw wszystkie porównania,
+		// potem assign() - przypisanie, które nie może rzucić - i przepięcie węzła w drzewach
+		// drzewo ruszamy tylko wtedy, gdy zmienia się kolejność w nim
+		// strong guarantee; w trybie basic_guarantee assign() może rzucić - węzeł z niepełnie
+		// przypisaną parą jest wtedy usuwany z kolejki
+		template<typename Assign>
+		void assignInPlace(node* n, const K& key, const V& value, Assign assign)
+		{
+			prefix_type p = node::prefix_of(key);
+			relink_position by_value_position = relinkPosition(impl.by_value, n->value_link(),
+					[&](hook* h) { const key_value_pair& e = node::from_value(h)->entry;
+							return by_value_order::less(key, value, e.first, e.second); },
+					[&](hook* h) { const key_value_pair& e = node::from_value(h)->entry;
+							return by_value_order::less(e.first, e.second, key, value); });
+			relink_position by_key_position = relinkPosition(impl.by_key, n->key_link(),
+					[&](hook* h) { const node* x = node::from_key(h);
+							return keyOrderLess(p, key, value, x->key_prefix(), x->entry.first, x->entry.second); },
+					[&](hook* h) { const node* x = node::from_key(h);
+							return keyOrderLess(x->key_prefix(), x->entry.first, x->entry.second, p, key, value); });
+
+			if (basic)
+			{
+				try
+				{
+					assign();
+				}
+				catch (...)
+				{
+					count_event<stats>(&PriorityQueueStats::rollbacks);
+					eraseNode(n);
+					throw;
+				}
+			}
+			else
+				assign();
+			//od tego miejsca nic nie rzuca
+			n->set_key_prefix(p);
+			if (!by_value_position.stay)
+			{
+				impl.by_value.erase(n->value_link());
+				impl.by_value.insert_before(by_value_position.before, n->value_link());
+			}
+			if (!by_key_position.stay)
+			{
+				impl.by_key.erase(n->key_link());
+				impl.by_key.insert_before(by_key_position.before, n->key_link());
+			}
+		}
+
+		// zastąpienie jednej kopii pary z węzła n parą (key, value), strong guarantee
+		// bez alokacji, jeśli przypisania K i V nie rzucają (ewentualnie po skopiowaniu key i value)
+		// albo w trybie basic_guarantee; wpp. i w trybie count_duplicates (nowa para może dołączyć
+		// do innego węzła) wstawiamy nową parę i usuwamy kopię starej
+		template<typename KK, typename VV>
+		void replaceEntry(node* n, KK&& key, VV&& value)
+		{
+			if (!counted && ((std::is_nothrow_copy_assignable<K>::value && std::is_nothrow_copy_assignable<V>::value) ||
+					basic))
+				assignInPlace(n, key, value, [&] { n->entry.first = key; n->entry.second = value; });
+			else if (!counted && std::is_nothrow_move_assignable<K>::value && std::is_nothrow_move_assignable<V>::value)
+			{
+				K key_copy(std::forward<KK>(key));
+				V value_copy(std::forward<VV>(value));
+				assignInPlace(n, key_copy, value_copy,
+						[&] { n->entry.first = std::move(key_copy); n->entry.second = std::move(value_copy); });
+			}
+			else
+			{
+				insert(std::forward<KK>(key), std::forward<VV>(value));
+				popCopies(n, 1);
+			}
+		}
+
+		// zmiana wartości istniejącego węzła, strong guarantee
+		// jeśli przypisanie V może rzucić, zamiast przepinania wstawiamy nowy węzeł i usuwamy stary
+		// (w trybie basic_guarantee przypisujemy w miejscu, patrz assignInPlace)
+		// w trybie count_duplicates zmieniamy jedną kopię: przenosimy ją do węzła równej pary, jeśli taki jest,
+		// albo do nowego węzła, gdy w n zostają inne kopie
+		// zwraca węzeł, w którym jest teraz para
+		node* changeNodeValue(node* n, const V& value)
+		{
+			if (counted)
+			{
+				node* equal = findPair(n->entry.first, value);
+				if (equal == n)
+					return n;
+				if (equal != nullptr)
+				{
+					addCopies(equal, 1);
+					removeCopies(n, 1);
+					return equal;
+				}
+				if (n->copies() > 1)
+				{
+					node* fresh = linkNode(createNode(n->entry.first, value));
+					removeCopies(n, 1);
+					return fresh;
+				}
+			}
+
+			if (std::is_nothrow_copy_assignable<V>::value || basic)
+				assignInPlace(n, n->entry.first, value, [&] { n->entry.second = value; });
+			else if (std::is_nothrow_move_assignable<V>::value)
+			{
+				V copy(value);
+				assignInPlace(n, n->entry.first, copy, [&] { n->entry.second = std::move(copy); });
+			}
+			else
+			{
+				//wstawiamy nową parę, wyjątek w tym miejscu nie zmienia stanu kolejki
+				node* fresh = createNode(n->entry.first, value);
+				linkNode(fresh);
+				//usuwamy starą parę (no-throw)
+				eraseNode(n);
+				return fresh;
+			}
+			return n;
+		}
+	};
+
+
+	// silnik kopcowy: pary w jednej tablicy, ułożone jak d-arny kopiec min-max
+	// (poziomy parzyste - min, nieparzyste - max), więc min i max są w O(1) i O(D),
+	// a insert, deleteMin i deleteMax w O(D^2 log_D n), bez wskaźników i bez alokacji na parę
+	// porządku po kluczu nie ma: changeValue szuka klucza liniowo, a operatory porównania sortują kopię
+	// wskaźników; uchwytów nie ma, bo pary przesuwają się w tablicy
+	// wszystkie operacje najpierw wykonują porównania (układając plan przesunięć), a dopiero potem
+	// przesuwają elementy, dlatego przy no-throw przenoszeniu K i V mamy strong guarantee
+	template<typename K, typename V, typename Alloc, typename Policy, unsigned D>
+	class heap_engine
+	{
+		static_assert(D >= 2, "Heap arity must be at least 2!");
+		static_assert(std::is_nothrow_move_constructible<K>::value && std::is_nothrow_move_assignable<K>::value,
+				"Heap engine requires no-throw movable keys!");
+		static_assert(std::is_nothrow_move_constructible<V>::value && std::is_nothrow_move_assignable<V>::value,
+				"Heap engine requires no-throw movable values!");
+		static_assert(!counts_duplicates<Policy>::value, "Heap engine doesn't support count_duplicates!");
+		static_assert(!deletes_lazily<Policy>::value, "Heap engine doesn't support lazy_deletion!");
+
+		static const bool stats = collects_stats<Policy>::value;
+		static const bool basic = relaxes_guarantee<Policy>::value;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef CompByFst<K, V, stats, Policy> by_key_order;
+		typedef CompBySnd<K, V, stats, Policy> by_value_order;
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<key_value_pair> entry_allocator;
+		typedef std::vector<key_value_pair, entry_allocator> entry_vector;
+
+	public:
+		typedef size_t size_type;
+		typedef no_handle handle;
+
+		static const bool has_handles = false;
+		static const bool has_ordered_iterators = false;
+		static const bool contiguous_key_order = branchless_comparable<K, V>::value;
+		static const bool parallel_bulk = false;
+
+		typedef no_iterator key_iterator;
+		typedef no_iterator value_iterator;
+
+		// kopia tablicy posortowana w porządku (klucz, wartość), dla arytmetycznych K i V
+		// konstrukcja: O(n log n), może rzucić (alokacja)
+		class key_array
+		{
+		public:
+			explicit key_array(const heap_engine& engine) : entries(engine.heap)
+			{
+				std::sort(entries.begin(), entries.end(), by_key_order());
+			}
+
+			const key_value_pair* data() const noexcept
+			{
+				return entries.data();
+			}
+
+		private:
+			entry_vector entries;
+		};
+
+		// przejście w porządku (klucz, wartość) po posortowanej tablicy wskaźników
+		// konstrukcja: O(n log n), może rzucić (alokacja, porównania)
+		class key_cursor
+		{
+			typedef typename std::allocator_traits<Alloc>::template rebind_alloc<const key_value_pair*> pointer_allocator;
+
+		public:
+			explicit key_cursor(const heap_engine& engine) :
+					order(pointer_allocator(engine.heap.get_allocator())), position(0)
+			{
+				order.reserve(engine.heap.size());
+				for (const key_value_pair& e : engine.heap)
+					order.push_back(&e);
+				std::sort(order.begin(), order.end(),
+						[](const key_value_pair* a, const key_value_pair* b) { return by_key_order()(*a, *b); });
+			}
+
+			bool done() const noexcept
+			{
+				return position == order.size();
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return *order[position];
+			}
+
+			void advance() noexcept
+			{
+				++position;
+			}
+
+		private:
+			std::vector<const key_value_pair*, pointer_allocator> order;
+			size_type position;
+		};
+
+		explicit heap_engine(const Alloc& alloc) noexcept : heap(entry_allocator(alloc))
+		{ }
+
+		heap_engine(const heap_engine& engine, const Alloc& alloc) : heap(engine.heap, entry_allocator(alloc))
+		{
+			countGrowth(0);
+		}
+
+		heap_engine(heap_engine&& engine) noexcept : heap(std::move(engine.heap))
+		{
+			engine.heap.clear();
+		}
+
+		heap_engine& operator=(const heap_engine&) = delete;
+
+		Alloc getAllocator() const noexcept
+		{
+			return Alloc(heap.get_allocator());
+		}
+
+		void swap(heap_engine& engine, bool with_allocators) noexcept
+		{
+			if (with_allocators && propagates_allocator<Alloc>::value)
+			{
+				//std::vector::swap zamienia alokatory tylko przy propagate_on_container_swap
+				entry_vector tmp(std::move(heap));
+				heap.~entry_vector();
+				new (&heap) entry_vector(std::move(engine.heap));
+				engine.heap.~entry_vector();
+				new (&engine.heap) entry_vector(std::move(tmp));
+			}
+			else
+				heap.swap(engine.heap);
+		}
+
+		void clear() noexcept
+		{
+			heap.clear();
+		}
+
+		size_type size() const noexcept
+		{
+			return heap.size();
+		}
+
+		// pary w porządku po wartości tworzą kopiec minimum, ale nie min-max - budujemy go metodą Floyda
+		// key_position nie jest potrzebne; strong guarantee, O(n)
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition)
+		{
+			assert(heap.empty());
+			try
+			{
+				heap.reserve(n);
+				countGrowth(0);
+				for (size_type i = 0; i < n; ++i)
+				{
+					auto e = entry_at(i);
+					heap.emplace_back(std::move(e.key), std::move(e.value));
+				}
+				heapify();
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				heap.clear();
+				throw;
+			}
+		}
+
+		// para konstruowana od razu na końcu tablicy
+		// strong guarantee, O(log_D n)
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			size_type capacity = heap.capacity();
+			heap.emplace_back(std::forward<Args>(args)...);
+			countGrowth(capacity);
+			try
+			{
+				siftUpLast();
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				heap.pop_back();
+				throw;
+			}
+			return handle();
+		}
+
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			return emplace(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// kopiec usuwa pary od razu, nie ma czego zwalniać
+		void compact() noexcept
+		{ }
+
+		// zastąpienie pary o najmniejszej (największej) wartości parą (key, value) w tym samym miejscu
+		// tablicy, dla niepustego kopca; strong guarantee, O(D^2 log_D n)
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			key_value_pair replacement(std::forward<KK>(key), std::forward<VV>(value));
+			replaceAt(0, replacement);
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			size_type i = maxIndex();
+			key_value_pair replacement(std::forward<KK>(key), std::forward<VV>(value));
+			replaceAt(i, replacement);
+		}
+
+		// nowe pary dopisujemy na koniec i budujemy kopiec metodą Floyda;
+		// w niepustym kopcu pracujemy na kopii tablicy, żeby wyjątek nie zostawił jej pomieszanej
+		// strong guarantee, O(n + m)
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			if (heap.empty())
+			{
+				try
+				{
+					appendRange(first, last);
+					heapify();
+				}
+				catch (...)
+				{
+					count_event<stats>(&PriorityQueueStats::rollbacks);
+					heap.clear();
+					throw;
+				}
+				return;
+			}
+			heap_engine tmp(*this, getAllocator());
+			tmp.appendRange(first, last);
+			tmp.heapify();
+			//od tego miejsca nic nie rzuca
+			heap.swap(tmp.heap);
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return heap[0];
+		}
+
+		// strong guarantee (porównania), O(D)
+		const key_value_pair& maxEntry() const
+		{
+			return heap[maxIndex()];
+		}
+
+		// strong guarantee, O(D^2 log_D n)
+		void deleteMin()
+		{
+			removeAt(0, false);
+		}
+
+		void deleteMax()
+		{
+			removeAt(maxIndex(), true);
+		}
+
+		// wyjmowanie kolejnych minimów z kopii roboczej - przerwane wyjątkiem nie może zmienić kopca
+		// strong guarantee, O(n + k D^2 log_D n), k = min(n, size())
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			heap_engine tmp(*this, getAllocator());
+			for (size_type i = 0; i < n && !tmp.heap.empty(); ++i)
+			{
+				*out = tmp.heap[0];
+				++out;
+				tmp.deleteMin();
+			}
+			//od tego miejsca nic nie rzuca
+			heap.swap(tmp.heap);
+			return out;
+		}
+
+		// liniowe szukanie pary o kluczu key i najmniejszej wartości, potem zmiana w miejscu
+		// strong guarantee, O(n)
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			size_type found = heap.size();
+			for (size_type i = 0; i < heap.size(); ++i)
+			{
+				if (heap[i].first == key && (found == heap.size() || heap[i].second < heap[found].second))
+					found = i;
+			}
+			if (found == heap.size())
+				return false;
+
+			//klucz przenosimy ze starej pary (bez kopii), a przy wyjątku oddajemy go z powrotem
+			V new_value(value);
+			key_value_pair replacement(std::move(heap[found].first), std::move(new_value));
+			try
+			{
+				replaceAt(found, replacement);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				//replaceAt przywrócił starą parę na pozycję found
+				heap[found].first = std::move(replacement.first);
+				throw;
+			}
+			return true;
+		}
+
+		// strong guarantee, O(n)
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			for (const key_value_pair& e : heap)
+				if (e.first == key)
+					return true;
+			return false;
+		}
+
+		// strong guarantee, O(n + m): kopia obu tablic i budowa kopca metodą Floyda
+		// gdy porównania K i V nie rzucają, budowa kopca się nie przerwie, więc pary engine
+		// przenosimy na koniec tablicy *this i budujemy kopiec w miejscu, bez kopii
+		// w trybie basic_guarantee (przy porównaniach, które mogą rzucić) przenosimy pary pojedynczo
+		void merge(heap_engine& engine)
+		{
+			if (nothrow_comparable<K, V>::value)
+			{
+				mergeInPlace(engine);
+				return;
+			}
+			if (basic)
+			{
+				transferEach(engine);
+				return;
+			}
+			heap_engine tmp(getAllocator());
+			tmp.heap.reserve(heap.size() + engine.heap.size());
+			tmp.countGrowth(0);
+			tmp.heap.insert(tmp.heap.end(), heap.begin(), heap.end());
+			tmp.heap.insert(tmp.heap.end(), engine.heap.begin(), engine.heap.end());
+			tmp.heapify();
+			//od tego miejsca nic nie rzuca
+			heap.swap(tmp.heap);
+			engine.clear();
+		}
+
+	private:
+		entry_vector heap;
+
+		// ścieżki mają długość co najwyżej liczby poziomów kopca
+		static const size_type max_path = 2 * sizeof(size_type) * 8 + 2;
+
+		// plan zejścia elementu w dół kopca: kolejne pozycje, z których elementy idą do dziury,
+		// i czy w danym kroku niesiony element zamienia się z ojcem nowej dziury
+		struct descent_plan
+		{
+			size_type steps;
+			size_type from[max_path];
+			bool parent_swap[max_path];
+		};
+
+		static size_type parent(size_type i) noexcept
+		{
+			return (i - 1) / D;
+		}
+
+		static bool onMinLevel(size_type i) noexcept
+		{
+			bool min_level = true;
+			while (i > 0)
+			{
+				i = parent(i);
+				min_level = !min_level;
+			}
+			return min_level;
+		}
+
+		static bool less(const key_value_pair& a, const key_value_pair& b)
+		{
+			return by_value_order()(a, b);
+		}
+
+		// czy a powinno stać wyżej niż b na poziomie danego typu
+		static bool before(const key_value_pair& a, const key_value_pair& b, bool max_level)
+		{
+			return max_level ? less(b, a) : less(a, b);
+		}
+
+		// pozycja największego elementu: korzeń albo któryś z jego synów
+		size_type maxIndex() const
+		{
+			size_type best = 0;
+			size_type end = std::min<size_type>(D + 1, heap.size());
+			for (size_type i = 1; i < end; ++i)
+			{
+				if (best == 0 || less(heap[best], heap[i]))
+					best = i;
+			}
+			return best;
+		}
+
+		// plan zejścia elementu *x od dziury hole (na poziomie typu max_level) w kopcu
+		// złożonym z pierwszych n elementów; nic nie zmienia, rzuca tylko to, co porównania
+		void planDescent(size_type hole, bool max_level, const key_value_pair* x, size_type n,
+				descent_plan& plan) const
+		{
+			plan.steps = 0;
+			for (;;)
+			{
+				size_type child = D * hole + 1;
+				if (child >= n)
+					break;
+
+				//najlepszy spośród synów i wnuków dziury
+				size_type best = child;
+				size_type child_end = std::min<size_type>(child + D, n);
+				for (size_type c = child + 1; c < child_end; ++c)
+					if (before(heap[c], heap[best], max_level))
+						best = c;
+				size_type grandchild = D * child + 1;
+				size_type grandchild_end = std::min<size_type>(D * (child + D - 1) + D + 1, n);
+				for (size_type g = grandchild; g < grandchild_end; ++g)
+					if (before(heap[g], heap[best], max_level))
+						best = g;
+
+				if (!before(heap[best], *x, max_level))
+					break;
+
+				bool swap_parent = false;
+				if (best >= grandchild)
+				{
+					//wnuk: niesiony element może należeć do poziomu ojca nowej dziury
+					swap_parent = before(heap[parent(best)], *x, max_level);
+					if (swap_parent)
+						x = &heap[parent(best)];
+				}
+				plan.from[plan.steps] = best;
+				plan.parent_swap[plan.steps] = swap_parent;
+				++plan.steps;
+				hole = best;
+				if (best < grandchild)
+					break;
+			}
+		}
+
+		// wykonanie planu: dziura na pozycji hole, niesiony element w carried, no-throw
+		void applyDescent(size_type hole, key_value_pair& carried, const descent_plan& plan) noexcept
+		{
+			for (size_type s = 0; s < plan.steps; ++s)
+			{
+				size_type from = plan.from[s];
+				heap[hole] = std::move(heap[from]);
+				hole = from;
+				if (plan.parent_swap[s])
+				{
+					using std::swap;
+					swap(carried, heap[parent(from)]);
+				}
+			}
+			heap[hole] = std::move(carried);
+		}
+
+		// przepchnięcie ostatniego elementu w górę; przy wyjątku z porównań zostaje on na końcu tablicy
+		// (reszta jest nadal kopcem), a usuwa go wywołujący
+		void siftUpLast()
+		{
+			size_type path[max_path];
+			size_type len = 0;
+			size_type i = heap.size() - 1;
+			if (i > 0)
+			{
+				const key_value_pair& x = heap[i];
+				bool max_level = !onMinLevel(i);
+				size_type p = parent(i);
+				path[len++] = i;
+				//element może należeć do poziomu ojca
+				if (max_level ? less(x, heap[p]) : less(heap[p], x))
+				{
+					path[len++] = p;
+					max_level = !max_level;
+				}
+				//wspinaczka po dziadkach tego samego typu
+				while (path[len - 1] > D)
+				{
+					size_type g = parent(parent(path[len - 1]));
+					if (!before(x, heap[g], max_level))
+						break;
+					path[len++] = g;
+				}
+			}
+			//od tego miejsca nic nie rzuca
+			//element z końca idzie na szczyt ścieżki, reszta schodzi o jeden krok
+			if (len > 1)
+				rotateUp(path, len);
+		}
+
+		// usunięcie elementu z pozycji top (korzeń albo syn korzenia), na jego miejsce schodzi ostatni
+		void removeAt(size_type top, bool max_level)
+		{
+			size_type last = heap.size() - 1;
+			if (top == last)
+			{
+				heap.pop_back();
+				return;
+			}
+			descent_plan plan;
+			planDescent(top, max_level, &heap[last], last, plan);
+			//od tego miejsca nic nie rzuca
+			key_value_pair carried(std::move(heap[last]));
+			heap.pop_back();
+			applyDescent(top, carried, plan);
+		}
+
+		// zastąpienie elementu na dowolnej pozycji i:
+		// najpierw bez porównań wynosimy go na szczyt jego łańcucha dziadków (korzeń lub syn korzenia),
+		// co zachowuje własność kopca, a potem podmieniamy szczyt jak przy usuwaniu
+		void replaceAt(size_type i, key_value_pair& replacement)
+		{
+			bool max_level = !onMinLevel(i);
+			size_type chain[max_path];
+			size_type len = 0;
+			chain[len++] = i;
+			while (max_level ? chain[len - 1] > D : chain[len - 1] != 0)
+			{
+				chain[len] = parent(parent(chain[len - 1]));
+				++len;
+			}
+			size_type top = chain[len - 1];
+			//stary element na szczyt, przodkowie schodzą o dwa poziomy
+			rotateUp(chain, len);
+
+			descent_plan plan;
+			bool root_swap = false;
+			try
+			{
+				const key_value_pair* x = &replacement;
+				//na poziomie max nowy element może być mniejszy od korzenia
+				if (max_level && less(replacement, heap[0]))
+				{
+					root_swap = true;
+					x = &heap[0];
+				}
+				planDescent(top, max_level, x, heap.size(), plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				rotateDown(chain, len);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			key_value_pair carried(std::move(replacement));
+			if (root_swap)
+			{
+				using std::swap;
+				swap(carried, heap[0]);
+			}
+			applyDescent(top, carried, plan);
+		}
+
+		// chain[0] idzie na chain[len - 1], pozostałe schodzą o jedno miejsce w łańcuchu
+		void rotateUp(const size_type* chain, size_type len) noexcept
+		{
+			key_value_pair carried(std::move(heap[chain[0]]));
+			for (size_type k = 1; k < len; ++k)
+				heap[chain[k - 1]] = std::move(heap[chain[k]]);
+			heap[chain[len - 1]] = std::move(carried);
+		}
+
+		// odwrotność rotateUp
+		void rotateDown(const size_type* chain, size_type len) noexcept
+		{
+			key_value_pair carried(std::move(heap[chain[len - 1]]));
+			for (size_type k = len - 1; k > 0; --k)
+				heap[chain[k]] = std::move(heap[chain[k - 1]]);
+			heap[chain[0]] = std::move(carried);
+		}
+
+		template<typename InputIt>
+		void appendRange(InputIt first, InputIt last)
+		{
+			for (; first != last; ++first)
+			{
+				const auto& kv = *first;
+				size_type capacity = heap.capacity();
+				heap.emplace_back(kv.first, kv.second);
+				countGrowth(capacity);
+			}
+		}
+
+		// przeniesienie par engine na koniec tablicy i budowa kopca Floyda w miejscu
+		// strong guarantee tylko dla porównań no-throw (wyjątek może rzucić jedynie rezerwacja)
+		void mergeInPlace(heap_engine& engine)
+		{
+			size_type capacity = heap.capacity();
+			heap.reserve(heap.size() + engine.heap.size());
+			countGrowth(capacity);
+			//od tego miejsca nic nie rzuca
+			heap.insert(heap.end(), std::make_move_iterator(engine.heap.begin()),
+					std::make_move_iterator(engine.heap.end()));
+			engine.clear();
+			heapify();
+		}
+
+		// przeniesienie par engine pojedynczo, od końca jej tablicy (usunięcie ostatniego elementu
+		// nie psuje kopca), O(m log_D (n + m)); przy wyjątku z porównań para wraca na koniec engine,
+		// więc każda para jest w dokładnie jednej z kolejek - basic guarantee
+		void transferEach(heap_engine& engine)
+		{
+			size_type capacity = heap.capacity();
+			heap.reserve(heap.size() + engine.heap.size());
+			countGrowth(capacity);
+			while (!engine.heap.empty())
+			{
+				//miejsce jest zarezerwowane, a przeniesienia nie rzucają
+				heap.push_back(std::move(engine.heap.back()));
+				engine.heap.pop_back();
+				try
+				{
+					siftUpLast();
+				}
+				catch (...)
+				{
+					count_event<stats>(&PriorityQueueStats::rollbacks);
+					engine.heap.push_back(std::move(heap.back()));
+					heap.pop_back();
+					throw;
+				}
+			}
+		}
+
+		// zliczenie alokacji tablicy (collect_stats), jeśli zmieniła się jej pojemność
+		void countGrowth(size_type old_capacity) const noexcept
+		{
+			if (heap.capacity() != old_capacity)
+				count_event<stats>(&PriorityQueueStats::allocations);
+		}
+
+		// budowa kopca min-max z dowolnej tablicy, O(n)
+		// rzuca tylko to, co porównania (wtedy tablica jest permutacją, ale nie kopcem)
+		void heapify()
+		{
+			if (heap.size() < 2)
+				return;
+			for (size_type i = parent(heap.size() - 1) + 1; i-- > 0; )
+			{
+				descent_plan plan;
+				planDescent(i, !onMinLevel(i), &heap[i], heap.size(), plan);
+				key_value_pair carried(std::move(heap[i]));
+				applyDescent(i, carried, plan);
+			}
+		}
+	};
+
+	// silnik parujący: porządek po wartości to kopiec parujący (las z porządkiem kopca, którego
+	// korzeń ma najmniejszą wartość; przy usuwaniu węzła jego synów łączymy parami), a porządek
+	// po kluczu - osobne drzewo czerwono-czarne uporządkowane po samym kluczu (pary o równym kluczu
+	// leżą obok siebie w dowolnej kolejności), więc zmiana wartości nie rusza drzewa po kluczu
+	// w kopcu insert, merge i zmniejszenie wartości to jedno porównanie z korzeniem i O(1) przepięć,
+	// a deleteMin, erase i zwiększenie wartości - O(log n) zamortyzowane; insert dokłada
+	// O(log n) porównań kluczy w drzewie po kluczu
+	// maksimum nie jest utrzymywane: maxEntry, deleteMax i replaceMax przeglądają liście kopca, O(n),
+	// porównując pary, więc (przy rzucających porównaniach) mogą rzucić
+	// przebudowa kopca najpierw wykonuje wszystkie porównania (decyzje zapisuje w polu plan węzłów),
+	// a dopiero potem przepina wskaźniki, więc wyjątek z porównań niczego nie zmienia
+	// polityka basic_guarantee nic tu nie zmienia - wszystkie operacje mają strong guarantee
+	template<typename K, typename V, typename Alloc, typename Policy>
+	class pairing_engine
+	{
+		static_assert(!counts_duplicates<Policy>::value, "Pairing engine doesn't support count_duplicates!");
+		static_assert(!deletes_lazily<Policy>::value, "Pairing engine doesn't support lazy_deletion!");
+
+		static const bool stats = collects_stats<Policy>::value;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef pairing_node<K, V> node;
+		typedef rb_hook hook;
+		typedef CompByFst<K, V, stats, Policy> by_key_order;
+		typedef CompBySnd<K, V, stats, Policy> by_value_order;
+
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node> node_allocator;
+		typedef std::allocator_traits<node_allocator> node_alloc_traits;
+		typedef typename node_alloc_traits::template rebind_alloc<node*> node_pointer_allocator;
+		typedef std::vector<node*, node_pointer_allocator> node_vector;
+		typedef typename node_alloc_traits::template rebind_alloc<hook*> hook_pointer_allocator;
+		typedef std::vector<hook*, hook_pointer_allocator> hook_vector;
+
+	public:
+		typedef size_t size_type;
+
+		static const bool has_handles = true;
+		static const bool has_ordered_iterators = false;
+		static const bool contiguous_key_order = false;
+		static const bool parallel_bulk = false;
+
+		typedef no_iterator key_iterator;
+		typedef no_iterator value_iterator;
+
+		// uchwyt do pary: wskaźnik na jej węzeł
+		class handle
+		{
+		public:
+			handle() noexcept : target(nullptr)
+			{ }
+
+			explicit operator bool() const noexcept
+			{
+				return target != nullptr;
+			}
+
+			bool operator==(const handle& other) const noexcept
+			{
+				return target == other.target;
+			}
+
+			bool operator!=(const handle& other) const noexcept
+			{
+				return target != other.target;
+			}
+
+		private:
+			friend class pairing_engine;
+
+			explicit handle(node* n) noexcept : target(n)
+			{ }
+
+			node* target;
+		};
+
+		// przejście w porządku (klucz, wartość): drzewo po kluczu, w którym pary o równym kluczu
+		// sortujemy po wartości; konstrukcja: O(n + suma r log r), r - liczba par o danym kluczu,
+		// może rzucić (alokacja, porównania)
+		class key_cursor
+		{
+			typedef typename std::allocator_traits<Alloc>::template rebind_alloc<const key_value_pair*> pointer_allocator;
+
+		public:
+			explicit key_cursor(const pairing_engine& engine) :
+					order(pointer_allocator(engine.impl.allocator())), position(0)
+			{
+				order.reserve(engine.impl.elements);
+				for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+					order.push_back(&node::from_key(h)->entry);
+				for (size_type run = 0; run < order.size(); )
+				{
+					size_type end = run + 1;
+					while (end < order.size() && order[end]->first == order[run]->first)
+						++end;
+					if (end - run > 1)
+						std::sort(order.begin() + run, order.begin() + end,
+								[](const key_value_pair* a, const key_value_pair* b) { return by_key_order()(*a, *b); });
+					run = end;
+				}
+			}
+
+			bool done() const noexcept
+			{
+				return position == order.size();
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return *order[position];
+			}
+
+			void advance() noexcept
+			{
+				++position;
+			}
+
+		private:
+			std::vector<const key_value_pair*, pointer_allocator> order;
+			size_type position;
+		};
+
+		explicit pairing_engine(const Alloc& alloc) noexcept : impl(node_allocator(alloc))
+		{ }
+
+		// kopia kopca węzeł po węźle (ten sam kształt, bez porównań), potem drzewo po kluczu
+		// w kolejności oryginału; strong guarantee, O(n log n) bez porównań K i V
+		pairing_engine(const pairing_engine& engine, const Alloc& alloc) : impl(node_allocator(alloc))
+		{
+			if (engine.impl.root == nullptr)
+				return;
+			typedef std::pair<const node*, node*> copy_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<copy_entry> copy_allocator;
+			std::vector<copy_entry, copy_allocator> copies{copy_allocator(impl.allocator())};
+			copies.reserve(engine.impl.elements);
+			try
+			{
+				//przejście kopca w porządku prefiksowym, równolegle po oryginale (o) i kopii (c)
+				const node* o = engine.impl.root;
+				node* c = copyNode(o, copies);
+				impl.root = c;
+				for (;;)
+				{
+					if (o->child != nullptr)
+					{
+						c->child = copyNode(o->child, copies);
+						c->child->prev = c;
+						o = o->child;
+						c = c->child;
+						continue;
+					}
+					//wracamy do najbliższego przodka (albo siebie), który ma prawego brata
+					while (o != engine.impl.root && o->next == nullptr)
+					{
+						while (o->prev->child != o)
+						{
+							o = o->prev;
+							c = c->prev;
+						}
+						o = o->prev;
+						c = c->prev;
+					}
+					if (o == engine.impl.root)
+						break;
+					c->next = copyNode(o->next, copies);
+					c->next->prev = c;
+					o = o->next;
+					c = c->next;
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				for (const copy_entry& e : copies)
+					destroyNode(e.second);
+				impl.root = nullptr;
+				throw;
+			}
+
+			//od tego miejsca nic nie rzuca
+			std::less<const node*> address_less;
+			std::sort(copies.begin(), copies.end(),
+					[&address_less](const copy_entry& a, const copy_entry& b)
+					{ return address_less(a.first, b.first); });
+			for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+			{
+				const node* original = node::from_key(h);
+				auto it = std::lower_bound(copies.begin(), copies.end(), original,
+						[&address_less](const copy_entry& a, const node* b)
+						{ return address_less(a.first, b); });
+				impl.by_key.insert_before(nullptr, it->second->key_link());
+			}
+			impl.elements = engine.impl.elements;
+		}
+
+		pairing_engine(pairing_engine&& engine) noexcept : impl(engine.impl.allocator())
+		{
+			swap(engine, false);
+		}
+
+		pairing_engine& operator=(const pairing_engine&) = delete;
+
+		~pairing_engine()
+		{
+			destroySubtree(impl.by_key.top());
+		}
+
+		Alloc getAllocator() const noexcept
+		{
+			return Alloc(impl.allocator());
+		}
+
+		// zamiana zawartości, a jeśli with_allocators - także alokatorów, no-throw
+		void swap(pairing_engine& engine, bool with_allocators) noexcept
+		{
+			impl.by_key.swap(engine.impl.by_key);
+			std::swap(impl.root, engine.impl.root);
+			std::swap(impl.elements, engine.impl.elements);
+			if (with_allocators)
+				swap_allocators(impl.allocator(), engine.impl.allocator(), propagates_allocator<Alloc>());
+		}
+
+		void clear() noexcept
+		{
+			pairing_engine tmp(getAllocator());
+			swap(tmp, false);
+		}
+
+		size_type size() const noexcept
+		{
+			return impl.elements;
+		}
+
+		// pary w porządku po wartości to gotowy kopiec: każda jest jedynym synem poprzedniej,
+		// więc kolejne deleteMin nie porównują niczego; drzewo po kluczu z key_position
+		// strong guarantee, O(n)
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition key_position)
+		{
+			assert(impl.elements == 0);
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			try
+			{
+				fresh.reserve(n);
+				by_key_hooks.reserve(n);
+				for (size_type i = 0; i < n; ++i)
+				{
+					auto e = entry_at(i);
+					fresh.push_back(createNode(std::move(e.key), std::move(e.value)));
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			if (n == 0)
+				return;
+			for (size_type i = n - 1; i > 0; --i)
+				link(fresh[i - 1], fresh[i]);
+			impl.root = fresh[0];
+			for (size_type i = 0; i < n; ++i)
+				by_key_hooks.push_back(fresh[static_cast<size_type>(key_position(i))]->key_link());
+			impl.by_key.assign_sorted(by_key_hooks.data(), n);
+			impl.elements = n;
+		}
+
+		// jedna alokacja na parę; porównania (miejsce w drzewie po kluczu i z korzeniem kopca)
+		// wykonujemy przed wpięciem węzła
+		// strong guarantee, O(log n) (w kopcu O(1))
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			node* n = createNode(std::forward<Args>(args)...);
+			try
+			{
+				linkNode(n);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(n);
+				throw;
+			}
+			return handle(n);
+		}
+
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			return emplace(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// kopiec usuwa pary od razu, nie ma czego zwalniać
+		void compact() noexcept
+		{ }
+
+		// zastąpienie pary o najmniejszej (największej) wartości parą (key, value), dla niepustego silnika
+		// strong guarantee, O(log n) zamortyzowane (replaceMax - O(n))
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			replaceEntry(impl.root, std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			replaceEntry(maxNode(), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// nowe węzły powstają przed zmianą kolejki; potem planujemy ich miejsca w drzewie po kluczu
+		// i układamy je w kopiec (make_heap na tablicy wskaźników), który łączymy z kopcem kolejki
+		// strong guarantee, O(m log (n + m))
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			try
+			{
+				for (; first != last; ++first)
+				{
+					fresh.push_back(nullptr);
+					const auto& kv = *first;
+					fresh.back() = createNode(kv.first, kv.second);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			insertNodes(fresh);
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return impl.root->entry;
+		}
+
+		// strong guarantee (porównania), O(n)
+		const key_value_pair& maxEntry() const
+		{
+			return maxNode()->entry;
+		}
+
+		// strong guarantee, O(log n) zamortyzowane
+		void deleteMin()
+		{
+			eraseNode(impl.root);
+		}
+
+		// największa para jest liściem kopca, więc usunięcie nie porównuje już niczego
+		// strong guarantee, O(n)
+		void deleteMax()
+		{
+			eraseNode(maxNode());
+		}
+
+		// k najmniejszych par wybieramy przeglądaniem kopca od korzenia (kandydaci - synowie już
+		// wybranych - w kopcu binarnym wskaźników), zapisujemy do out i dopiero wtedy usuwamy;
+		// kopiec kandydatów (jego tablica) staje się kopcem kolejki bez kolejnych porównań
+		// strong guarantee, O(d log d), d - liczba wybranych par i ich synów
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			size_type k = std::min(n, impl.elements);
+			if (k == 0)
+				return out;
+			auto after = [](const node* a, const node* b) { return before(b, a); };
+			node_vector selected{node_pointer_allocator(impl.allocator())};
+			node_vector candidates{node_pointer_allocator(impl.allocator())};
+			selected.reserve(k);
+			candidates.push_back(impl.root);
+			while (selected.size() < k)
+			{
+				std::pop_heap(candidates.begin(), candidates.end(), after);
+				selected.push_back(candidates.back());
+				candidates.pop_back();
+				for (node* c = selected.back()->child; c != nullptr; c = c->next)
+				{
+					candidates.push_back(c);
+					std::push_heap(candidates.begin(), candidates.end(), after);
+				}
+			}
+			for (const node* m : selected)
+			{
+				*out = m->entry;
+				++out;
+			}
+
+			//od tego miejsca nic nie rzuca
+			linkHeapArray(candidates);
+			impl.root = candidates.empty() ? nullptr : candidates[0];
+			for (node* m : selected)
+			{
+				impl.by_key.erase(m->key_link());
+				destroyNode(m);
+			}
+			impl.elements -= k;
+			return out;
+		}
+
+		// szukanie po kluczu w drzewie, wśród par o tym kluczu - tej o najmniejszej wartości;
+		// potem zmiana wartości w kopcu
+		// strong guarantee, O(log n + r) zamortyzowane, r - liczba par o kluczu key
+		// KeyLike - K albo typ porównywalny z K (K == KeyLike i K < KeyLike), np. std::string_view
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			node* n = findKey(key);
+			if (n == nullptr)
+				return false;
+			changeNodeValue(n, value);
+			return true;
+		}
+
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			hook* h = findFirst(key);
+			return h != nullptr;
+		}
+
+		// bez szukania po kluczu: zmniejszenie wartości to O(1) (jedno porównanie z korzeniem),
+		// zwiększenie - O(log n) zamortyzowane
+		handle changeValue(handle h, const V& value)
+		{
+			return handle(changeNodeValue(h.target, value));
+		}
+
+		const key_value_pair& entry(handle h) const noexcept
+		{
+			return h.target->entry;
+		}
+
+		// rzuca tylko to, co porównania przy łączeniu synów usuwanej pary
+		void erase(handle h) noexcept(nothrow_comparable<K, V>::value)
+		{
+			eraseNode(h.target);
+		}
+
+		// przeniesienie wszystkich par engine do *this, strong guarantee
+		// przy równych alokatorach węzły engine są przepinane bez alokacji: kopce łączymy jednym
+		// porównaniem korzeni, a węzły wpinamy w drzewo po kluczu pojedynczo, O(m log (n + m)),
+		// albo scaleniem obu drzew i zbudowaniem drzewa od nowa, O(n + m)
+		// przy różnych - najpierw kopia engine alokatorem *this
+		void merge(pairing_engine& engine)
+		{
+			if (engine.impl.elements == 0)
+				return;
+			if (!(impl.allocator() == engine.impl.allocator()))
+			{
+				pairing_engine copy(engine, getAllocator());
+				merge(copy);
+				engine.clear();
+				return;
+			}
+			node_vector sorted{node_pointer_allocator(impl.allocator())};
+			sorted.reserve(engine.impl.elements);
+			for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+				sorted.push_back(node::from_key(h));
+			key_links links{hook_vector(hook_pointer_allocator(impl.allocator())), false};
+			planKeyLinks(sorted, links);
+			bool engine_first = impl.root != nullptr && before(engine.impl.root, impl.root);
+
+			//od tego miejsca nic nie rzuca
+			node* other = engine.impl.root;
+			engine.impl.by_key.reset();
+			engine.impl.root = nullptr;
+			engine.impl.elements = 0;
+			applyKeyLinks(sorted, links);
+			meldRoot(other, engine_first);
+			impl.elements += sorted.size();
+		}
+
+	private:
+		// pary w drzewie po kluczu i korzeń kopca parującego
+		// alokator węzłów jest klasą bazową, więc pusty alokator nie zajmuje miejsca
+		struct engine_impl : node_allocator
+		{
+			rb_tree by_key; // porządek po kluczu
+			node* root;     // para o najmniejszej wartości, nullptr w pustym silniku
+			size_type elements;
+
+			explicit engine_impl(const node_allocator& alloc) noexcept :
+					node_allocator(alloc), root(nullptr), elements(0)
+			{ }
+
+			node_allocator& allocator() noexcept
+			{
+				return *this;
+			}
+
+			const node_allocator& allocator() const noexcept
+			{
+				return *this;
+			}
+		};
+
+		engine_impl impl;
+
+		// plan zmiany pary węzła w kopcu (patrz planHeapMove)
+		struct heap_move
+		{
+			int direction; // -1 - para maleje, 1 - rośnie, 0 - jej miejsce w kopcu się nie zmienia
+			bool new_root; // maleje: czy staje się korzeniem; rośnie (w korzeniu): czy korzeniem stają się jej synowie
+		};
+
+		// nowe miejsce węzła w drzewie po kluczu po zmianie klucza (patrz planKeyMove)
+		struct key_move
+		{
+			bool stay;
+			hook* before;
+		};
+
+		// miejsca w drzewie po kluczu dla węzłów posortowanych po kluczu (patrz planKeyLinks)
+		struct key_links
+		{
+			hook_vector hooks;
+			bool rebuild;
+		};
+
+		// alokacja i zwolnienie pojedynczego węzła alokatorem kolejki
+		// args - argumenty konstruktora pary
+		template<typename... Args>
+		node* createNode(Args&&... args)
+		{
+			typename node_alloc_traits::pointer p = node_alloc_traits::allocate(impl.allocator(), 1);
+			count_event<stats>(&PriorityQueueStats::allocations);
+			node* n = std::addressof(*p);
+			try
+			{
+				node_alloc_traits::construct(impl.allocator(), n, std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				node_alloc_traits::deallocate(impl.allocator(), p, 1);
+				throw;
+			}
+			return n;
+		}
+
+		void destroyNode(node* n) noexcept
+		{
+			node_alloc_traits::destroy(impl.allocator(), n);
+			node_alloc_traits::deallocate(impl.allocator(),
+					std::pointer_traits<typename node_alloc_traits::pointer>::pointer_to(*n), 1);
+		}
+
+		void destroyNodes(const node_vector& fresh) noexcept
+		{
+			for (node* n : fresh)
+				if (n != nullptr)
+					destroyNode(n);
+		}
+
+		// zwolnienie wszystkich węzłów poddrzewa drzewa po kluczu, głębokość rekursji O(log n)
+		void destroySubtree(hook* h) noexcept
+		{
+			if (!h)
+				return;
+			destroySubtree(h->left);
+			destroySubtree(h->right);
+			destroyNode(node::from_key(h));
+		}
+
+		// kopia pary węzła o (bez miejsca w kopcu), zapamiętana w copies (z zarezerwowanym miejscem)
+		template<typename CopyVector>
+		node* copyNode(const node* o, CopyVector& copies)
+		{
+			node* c = createNode(o->entry.first, o->entry.second);
+			copies.emplace_back(o, c);
+			return c;
+		}
+
+		static bool keyLess(const K& a, const K& b)
+		{
+			count_event<stats>(&PriorityQueueStats::comparisons);
+			return a < b;
+		}
+
+		// czy para a jest w kopcu przed b
+		static bool before(const node* a, const node* b)
+		{
+			return by_value_order::less(a->entry.first, a->entry.second, b->entry.first, b->entry.second);
+		}
+
+		// b (korzeń osobnego drzewa) zostaje najbardziej lewym synem a, no-throw
+		static void link(node* a, node* b) noexcept
+		{
+			b->next = a->child;
+			if (a->child != nullptr)
+				a->child->prev = b;
+			b->prev = a;
+			a->child = b;
+		}
+
+		// odcięcie poddrzewa węzła x (nie korzenia) od kopca, no-throw
+		static void cut(node* x) noexcept
+		{
+			if (x->prev->child == x)
+				x->prev->child = x->next;
+			else
+				x->prev->next = x->next;
+			if (x->next != nullptr)
+				x->next->prev = x->prev;
+			x->prev = nullptr;
+			x->next = nullptr;
+		}
+
+		// połączenie drzewa tree z kopcem kolejki; tree_first - czy jego korzeń jest przed korzeniem kopca
+		void meldRoot(node* tree, bool tree_first) noexcept
+		{
+			if (impl.root == nullptr)
+				impl.root = tree;
+			else if (tree_first)
+			{
+				link(tree, impl.root);
+				impl.root = tree;
+			}
+			else
+				link(impl.root, tree);
+		}
+
+		// plan połączenia listy braci od first w jedno drzewo (dwa przejścia kopca parującego):
+		// najpierw pary sąsiadów od lewej (plan & 1 w pierwszym z pary - czy wygrywa drugi),
+		// potem zwycięzcy par od prawej, każdy z dotychczasowym zwycięzcą (plan & 2 w pierwszym
+		// z pary - czy wygrywa zwycięzca tej pary); zwraca przyszły korzeń
+		// niczego nie przepina, rzuca tylko to, co porównania
+		static node* planCombine(node* first)
+		{
+			node* last_head = first;
+			for (node* a = first; a != nullptr && a->next != nullptr; a = a->next->next)
+			{
+				a->plan = before(a->next, a) ? 1 : 0;
+				last_head = a;
+				if (a->next->next != nullptr)
+					last_head = a->next->next;
+			}
+			node* winner = pairWinner(last_head);
+			for (node* head = last_head; head != first; )
+			{
+				head = head->prev->prev;
+				node* w = pairWinner(head);
+				bool wins = before(w, winner);
+				head->plan = static_cast<unsigned char>((head->plan & 1) | (wins ? 2 : 0));
+				if (wins)
+					winner = w;
+			}
+			return winner;
+		}
+
+		static node* pairWinner(node* head) noexcept
+		{
+			if (head->next == nullptr || !(head->plan & 1))
+				return head;
+			return head->next;
+		}
+
+		// wykonanie planu z planCombine(first) (Planned) albo, gdy porównania nie rzucają, połączenie
+		// z porównaniami po drodze, bez drugiego przejścia listy; zwraca korzeń połączonego drzewa
+		template<bool Planned>
+		static node* applyCombine(node* first) noexcept(Planned || nothrow_comparable<K, V>::value)
+		{
+			//zwycięzcy par tworzą nową listę (przez prev i next); plan przechodzi na zwycięzcę
+			node* previous = nullptr;
+			for (node* a = first; a != nullptr; )
+			{
+				node* b = a->next;
+				node* rest = b == nullptr ? nullptr : b->next;
+				node* w = a;
+				if (b != nullptr)
+				{
+					if (Planned ? (a->plan & 1) != 0 : before(b, a))
+					{
+						w = b;
+						b->plan = a->plan;
+						link(b, a);
+					}
+					else
+						link(a, b);
+				}
+				w->prev = previous;
+				w->next = nullptr;
+				if (previous != nullptr)
+					previous->next = w;
+				previous = w;
+				a = rest;
+			}
+			node* winner = previous;
+			for (node* w = winner->prev; w != nullptr; )
+			{
+				node* left = w->prev;
+				if (Planned ? (w->plan & 2) != 0 : before(w, winner))
+				{
+					link(w, winner);
+					winner = w;
+				}
+				else
+					link(winner, w);
+				w = left;
+			}
+			winner->prev = nullptr;
+			winner->next = nullptr;
+			return winner;
+		}
+
+		// węzły z tablicy ułożonej jak kopiec binarny (std::make_heap, najmniejszy na początku)
+		// stają się jednym drzewem kopca parującego: syn w kopcu binarnym - synem w drzewie, no-throw
+		// poddrzewa węzłów (ich synowie) zostają bez zmian
+		static void linkHeapArray(const node_vector& heap) noexcept
+		{
+			for (node* n : heap)
+			{
+				n->prev = nullptr;
+				n->next = nullptr;
+			}
+			for (size_type i = heap.size(); i-- > 1; )
+				link(heap[(i - 1) / 2], heap[i]);
+		}
+
+		// usunięcie węzła x: jego synów łączymy w jedno drzewo, które zajmuje miejsce x
+		// (dla korzenia) albo zostaje synem korzenia
+		// strong guarantee (rzuca tylko to, co porównania), O(log n) zamortyzowane
+		void eraseNode(node* x) noexcept(nothrow_comparable<K, V>::value)
+		{
+			node* sub = nullptr;
+			if (x->child != nullptr)
+			{
+				if (nothrow_comparable<K, V>::value)
+					sub = applyCombine<false>(x->child);
+				else
+				{
+					planCombine(x->child);
+					sub = applyCombine<true>(x->child);
+				}
+			}
+			//od tego miejsca nic nie rzuca
+			if (x == impl.root)
+				impl.root = sub;
+			else
+			{
+				cut(x);
+				if (sub != nullptr)
+					link(impl.root, sub);
+			}
+			impl.by_key.erase(x->key_link());
+			destroyNode(x);
+			--impl.elements;
+		}
+
+		// największa para: któryś z liści kopca (węzłów bez synów), O(n) wędrówki i porównań
+		node* maxNode() const
+		{
+			node* best = nullptr;
+			for (hook* h = impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+			{
+				node* n = node::from_key(h);
+				if (n->child == nullptr && (best == nullptr || before(best, n)))
+					best = n;
+			}
+			return best;
+		}
+
+		// pierwszy węzeł drzewa po kluczu o kluczu key, albo nullptr
+		template<typename KeyLike>
+		hook* findFirst(const KeyLike& key) const
+		{
+			hook* h = impl.by_key.lower_bound([&key](hook* x) { return node::from_key(x)->entry.first < key; });
+			if (h == nullptr || !(node::from_key(h)->entry.first == key))
+				return nullptr;
+			return h;
+		}
+
+		// para o kluczu key i najmniejszej wartości
+		template<typename KeyLike>
+		node* findKey(const KeyLike& key) const
+		{
+			hook* h = findFirst(key);
+			if (h == nullptr)
+				return nullptr;
+			node* best = node::from_key(h);
+			for (h = rb_tree::next(h); h != nullptr && node::from_key(h)->entry.first == key; h = rb_tree::next(h))
+			{
+				node* n = node::from_key(h);
+				if (by_key_order()(n->entry, best->entry))
+					best = n;
+			}
+			return best;
+		}
+
+		// wpięcie nowego węzła n w drzewo po kluczu (za równymi kluczami) i w kopiec
+		// rzuca tylko to, co porównania - wtedy n zostaje niewpięty
+		void linkNode(node* n)
+		{
+			rb_spot spot = impl.by_key.find_spot(
+					[n](hook* h) { return keyLess(n->entry.first, node::from_key(h)->entry.first); });
+			bool first = impl.root != nullptr && before(n, impl.root);
+			//od tego miejsca nic nie rzuca
+			impl.by_key.link(spot, n->key_link());
+			meldRoot(n, first);
+			++impl.elements;
+		}
+
+		// wpięcie nowych węzłów fresh (kolejka przejmuje je na własność), strong guarantee:
+		// przy wyjątku wszystkie węzły fresh są zwalniane, a kolejka się nie zmienia
+		// sortujemy kopie fresh, bo przerwane wyjątkiem sortowanie może zgubić lub powtórzyć wskaźnik
+		void insertNodes(const node_vector& fresh)
+		{
+			if (fresh.empty())
+				return;
+			node_vector sorted{node_pointer_allocator(impl.allocator())};
+			node_vector heap_order{node_pointer_allocator(impl.allocator())};
+			key_links links{hook_vector(hook_pointer_allocator(impl.allocator())), false};
+			bool fresh_first = false;
+			try
+			{
+				sorted = fresh;
+				std::sort(sorted.begin(), sorted.end(),
+						[](const node* a, const node* b) { return keyLess(a->entry.first, b->entry.first); });
+				planKeyLinks(sorted, links);
+				heap_order = fresh;
+				std::make_heap(heap_order.begin(), heap_order.end(),
+						[](const node* a, const node* b) { return before(b, a); });
+				fresh_first = impl.root != nullptr && before(heap_order[0], impl.root);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			applyKeyLinks(sorted, links);
+			linkHeapArray(heap_order);
+			meldRoot(heap_order[0], fresh_first);
+			impl.elements += fresh.size();
+		}
+
+		// czy m pojedynczych wpięć w drzewo po kluczu (O(m log (n + m))) jest tańsze
+		// od zbudowania go od nowa (O(n + m))
+		bool linkingIsCheaper(size_type m) const noexcept
+		{
+			size_type total = impl.elements + m;
+			size_type depth = 1;
+			while ((size_type(1) << depth) < total)
+				++depth;
+			return m * depth < impl.elements;
+		}
+
+		// plan wpięcia węzłów sorted (posortowanych po kluczu, spoza drzewa) w drzewo po kluczu:
+		// dla każdego pierwszy węzeł drzewa o większym kluczu (przed nim wpinamy) albo, gdy tak taniej,
+		// cała nowa kolejność drzewa ze scalenia; rzuca tylko to, co porównania i alokacja
+		void planKeyLinks(const node_vector& sorted, key_links& links)
+		{
+			links.rebuild = !linkingIsCheaper(sorted.size());
+			if (!links.rebuild)
+			{
+				links.hooks.reserve(sorted.size());
+				for (const node* n : sorted)
+					links.hooks.push_back(impl.by_key.lower_bound(
+							[n](hook* h) { return !keyLess(n->entry.first, node::from_key(h)->entry.first); }));
+				return;
+			}
+			links.hooks.reserve(impl.elements + sorted.size());
+			hook* h = impl.by_key.first();
+			for (node* n : sorted)
+			{
+				while (h != nullptr && !keyLess(n->entry.first, node::from_key(h)->entry.first))
+				{
+					links.hooks.push_back(h);
+					h = rb_tree::next(h);
+				}
+				links.hooks.push_back(n->key_link());
+			}
+			for (; h != nullptr; h = rb_tree::next(h))
+				links.hooks.push_back(h);
+		}
+
+		void applyKeyLinks(const node_vector& sorted, const key_links& links) noexcept
+		{
+			if (links.rebuild)
+			{
+				impl.by_key.assign_sorted(links.hooks.data(), links.hooks.size());
+				return;
+			}
+			//węzły o wspólnym następniku wpinamy przed nim w kolejności sorted
+			for (size_type i = 0; i < sorted.size(); ++i)
+				impl.by_key.insert_before(links.hooks[i], sorted[i]->key_link());
+		}
+
+		// plan zmiany pary węzła n na (key, value) w kopcu; niczego nie przepina, rzuca tylko to, co porównania
+		// maleje: poddrzewo n łączymy z kopcem (jedno porównanie z korzeniem); rośnie: synów n łączymy
+		// w jedno drzewo (planCombine), a w korzeniu porównujemy je jeszcze z nową parą
+		heap_move planHeapMove(node* n, const K& key, const V& value)
+		{
+			heap_move move{0, false};
+			const key_value_pair& old = n->entry;
+			if (by_value_order::less(key, value, old.first, old.second))
+			{
+				move.direction = -1;
+				if (n != impl.root)
+					move.new_root = by_value_order::less(key, value, impl.root->entry.first, impl.root->entry.second);
+			}
+			else if (by_value_order::less(old.first, old.second, key, value))
+			{
+				move.direction = 1;
+				if (n->child != nullptr)
+				{
+					node* sub = planCombine(n->child);
+					if (n == impl.root)
+						move.new_root = by_value_order::less(sub->entry.first, sub->entry.second, key, value);
+				}
+			}
+			return move;
+		}
+
+		// wykonanie planu z planHeapMove dla węzła n (już z nową parą), no-throw
+		// węzeł, którego para rośnie, zostaje na miejscu (nadal nie jest przed ojcem), a połączeni synowie
+		// trafiają pod korzeń
+		void applyHeapMove(node* n, const heap_move& move) noexcept
+		{
+			if (move.direction < 0 && n != impl.root)
+			{
+				cut(n);
+				meldRoot(n, move.new_root);
+			}
+			else if (move.direction > 0 && n->child != nullptr)
+			{
+				node* sub = applyCombine<true>(n->child);
+				n->child = nullptr;
+				if (n != impl.root)
+					link(impl.root, sub);
+				else if (move.new_root)
+				{
+					link(sub, n);
+					impl.root = sub;
+				}
+				else
+					link(n, sub);
+			}
+		}
+
+		// nowe miejsce węzła n w drzewie po kluczu po zmianie klucza na key: stay == true, gdy może zostać
+		// (sprawdzamy tylko sąsiadów), wpp. trzeba go przepiąć przed before; rzuca tylko to, co porównania
+		key_move planKeyMove(node* n, const K& key) const
+		{
+			hook* self = n->key_link();
+			hook* prev = rb_tree::prev(self);
+			hook* next = rb_tree::next(self);
+			if ((prev == nullptr || !keyLess(key, node::from_key(prev)->entry.first)) &&
+					(next == nullptr || !keyLess(node::from_key(next)->entry.first, key)))
+				return key_move{true, nullptr};
+			hook* before = impl.by_key.lower_bound(
+					[&key](hook* h) { return !keyLess(key, node::from_key(h)->entry.first); });
+			if (before == self)
+				before = next;
+			return key_move{false, before};
+		}
+
+		void applyKeyMove(node* n, const key_move& move) noexcept
+		{
+			if (move.stay)
+				return;
+			impl.by_key.erase(n->key_link());
+			impl.by_key.insert_before(move.before, n->key_link());
+		}
+
+		// fresh zajmuje miejsce n w obu strukturach (ten sam klucz), no-throw
+		void substitute(node* n, node* fresh) noexcept
+		{
+			impl.by_key.insert_before(n->key_link(), fresh->key_link());
+			impl.by_key.erase(n->key_link());
+			fresh->child = n->child;
+			fresh->next = n->next;
+			fresh->prev = n->prev;
+			if (n->child != nullptr)
+				n->child->prev = fresh;
+			if (n->next != nullptr)
+				n->next->prev = fresh;
+			if (n->prev != nullptr)
+			{
+				if (n->prev->child == n)
+					n->prev->child = fresh;
+				else
+					n->prev->next = fresh;
+			}
+			if (impl.root == n)
+				impl.root = fresh;
+		}
+
+		// zamiana pary węzła n na parę nowego węzła fresh (kolejka przejmuje go na własność)
+		// key_changes - czy klucz fresh może być inny niż klucz n
+		// strong guarantee: przy wyjątku z porównań fresh jest zwalniany; zwraca fresh
+		node* replaceWith(node* n, node* fresh, bool key_changes)
+		{
+			key_move key_position{true, nullptr};
+			heap_move heap_position;
+			try
+			{
+				if (key_changes)
+					key_position = planKeyMove(n, fresh->entry.first);
+				heap_position = planHeapMove(n, fresh->entry.first, fresh->entry.second);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			substitute(n, fresh);
+			destroyNode(n);
+			applyKeyMove(fresh, key_position);
+			applyHeapMove(fresh, heap_position);
+			return fresh;
+		}
+
+		// zamiana pary w węźle n na (key, value) bez alokacji: najpierw wszystkie porównania,
+		// potem assign() - przypisanie, które nie może rzucić - i przepięcie węzła
+		template<typename Assign>
+		void assignInPlace(node* n, const K& key, const V& value, Assign assign)
+		{
+			key_move key_position = planKeyMove(n, key);
+			heap_move heap_position = planHeapMove(n, key, value);
+			assign();
+			//od tego miejsca nic nie rzuca
+			applyKeyMove(n, key_position);
+			applyHeapMove(n, heap_position);
+		}
+
+		// to samo bez zmiany klucza
+		template<typename Assign>
+		void assignValueInPlace(node* n, const V& value, Assign assign)
+		{
+			heap_move heap_position = planHeapMove(n, n->entry.first, value);
+			assign();
+			//od tego miejsca nic nie rzuca
+			applyHeapMove(n, heap_position);
+		}
+
+		// zastąpienie pary z węzła n parą (key, value), strong guarantee
+		// bez alokacji, jeśli przypisania K i V nie rzucają (ewentualnie po skopiowaniu key i value);
+		// wpp. nowy węzeł zajmuje miejsce n
+		template<typename KK, typename VV>
+		void replaceEntry(node* n, KK&& key, VV&& value)
+		{
+			if (std::is_nothrow_copy_assignable<K>::value && std::is_nothrow_copy_assignable<V>::value)
+				assignInPlace(n, key, value, [&] { n->entry.first = key; n->entry.second = value; });
+			else if (std::is_nothrow_move_assignable<K>::value && std::is_nothrow_move_assignable<V>::value)
+			{
+				K key_copy(std::forward<KK>(key));
+				V value_copy(std::forward<VV>(value));
+				assignInPlace(n, key_copy, value_copy,
+						[&] { n->entry.first = std::move(key_copy); n->entry.second = std::move(value_copy); });
+			}
+			else
+				replaceWith(n, createNode(std::forward<KK>(key), std::forward<VV>(value)), true);
+		}
+
+		// zmiana wartości węzła n, strong guarantee; jeśli przypisanie V może rzucić,
+		// nowy węzeł zajmuje miejsce n; zwraca węzeł, w którym jest teraz para
+		node* changeNodeValue(node* n, const V& value)
+		{
+			if (std::is_nothrow_copy_assignable<V>::value)
+				assignValueInPlace(n, value, [&] { n->entry.second = value; });
+			else if (std::is_nothrow_move_assignable<V>::value)
+			{
+				V copy(value);
+				assignValueInPlace(n, copy, [&] { n->entry.second = std::move(copy); });
+			}
+			else
+				return replaceWith(n, createNode(n->entry.first, value), false);
+			return n;
+		}
+	};
+
+	// silnik pozycyjny (radix heap) dla całkowitych wartości bez znaku i kolejek monotonicznych
+	// (polityka z monotone): pary o najmniejszej wartości level leżą w drzewie po kluczu (kubełek 0,
+	// pierwsza z nich to minimum), a pozostałe - na cyklicznych listach kubełków: para o wartości v
+	// jest w kubełku i + 1, i - najstarszy bit, którym v różni się od level; bity maski occupied
+	// mówią, które listy są niepuste
+	// insert i zmiana wartości to w porządku po wartości O(1) (bez porównań), a deleteMin przenosi
+	// pary najmłodszego niepustego kubełka (każda para schodzi do niższego kubełka najwyżej tyle razy,
+	// ile bitów ma V), więc kosztuje O(B) zamortyzowane, B - liczba bitów V, plus porównania kluczy
+	// porządkujące pary o nowej najmniejszej wartości; drzewo po kluczu jak w silniku parującym
+	// maksimum nie jest utrzymywane: maxEntry, deleteMax i replaceMax przeglądają najstarszy kubełek,
+	// O(r), r - jego długość, porównując pary, więc (przy rzucających porównaniach) mogą rzucić
+	// monotone to umowa: wartości wstawiane i nadawane (insert, changeValue, merge, replaceMin)
+	// nie są mniejsze od ostatnio usuniętego minimum; bez NDEBUG sprawdza to asercja, a z NDEBUG
+	// mniejsza wartość jest obsługiwana poprawnie, tylko drożej (level maleje, O(n) w najgorszym razie)
+	// wszystkie operacje najpierw porównują klucze (bez zmian), a dopiero potem przepinają węzły,
+	// więc mają strong guarantee; polityka basic_guarantee nic tu nie zmienia
+	template<typename K, typename V, typename Alloc, typename Policy>
+	class radix_engine
+	{
+		static_assert(std::is_integral<V>::value && std::is_unsigned<V>::value && !std::is_same<V, bool>::value,
+				"Radix engine requires an unsigned integer value type!");
+		static_assert(std::numeric_limits<V>::digits <= 64, "Radix engine supports values of at most 64 bits!");
+		static_assert(pops_monotonically<Policy>::value, "Radix engine requires a policy with monotone = true!");
+		static_assert(!counts_duplicates<Policy>::value, "Radix engine doesn't support count_duplicates!");
+		static_assert(!deletes_lazily<Policy>::value, "Radix engine doesn't support lazy_deletion!");
+
+		static const bool stats = collects_stats<Policy>::value;
+		static const unsigned bits = std::numeric_limits<V>::digits;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef radix_node<K, V> node;
+		typedef rb_hook hook;
+		typedef CompByFst<K, V, stats, Policy> by_key_order;
+		typedef CompBySnd<K, V, stats, Policy> by_value_order;
+
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node> node_allocator;
+		typedef std::allocator_traits<node_allocator> node_alloc_traits;
+		typedef typename node_alloc_traits::template rebind_alloc<node*> node_pointer_allocator;
+		typedef std::vector<node*, node_pointer_allocator> node_vector;
+		typedef typename node_alloc_traits::template rebind_alloc<hook*> hook_pointer_allocator;
+		typedef std::vector<hook*, hook_pointer_allocator> hook_vector;
+
+	public:
+		typedef size_t size_type;
+
+		static const bool has_handles = true;
+		static const bool has_ordered_iterators = false;
+		static const bool contiguous_key_order = false;
+		static const bool parallel_bulk = false;
+
+		typedef no_iterator key_iterator;
+		typedef no_iterator value_iterator;
+
+		// uchwyt do pary: wskaźnik na jej węzeł
+		class handle
+		{
+		public:
+			handle() noexcept : target(nullptr)
+			{ }
+
+			explicit operator bool() const noexcept
+			{
+				return target != nullptr;
+			}
+
+			bool operator==(const handle& other) const noexcept
+			{
+				return target == other.target;
+			}
+
+			bool operator!=(const handle& other) const noexcept
+			{
+				return target != other.target;
+			}
+
+		private:
+			friend class radix_engine;
+
+			explicit handle(node* n) noexcept : target(n)
+			{ }
+
+			node* target;
+		};
+
+		// przejście w porządku (klucz, wartość): drzewo po kluczu, w którym pary o równym kluczu
+		// sortujemy po wartości; konstrukcja: O(n + suma r log r), r - liczba par o danym kluczu,
+		// może rzucić (alokacja, porównania)
+		class key_cursor
+		{
+			typedef typename std::allocator_traits<Alloc>::template rebind_alloc<const key_value_pair*> pointer_allocator;
+
+		public:
+			explicit key_cursor(const radix_engine& engine) :
+					order(pointer_allocator(engine.impl.allocator())), position(0)
+			{
+				order.reserve(engine.impl.elements);
+				for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+					order.push_back(&node::from_key(h)->entry);
+				for (size_type run = 0; run < order.size(); )
+				{
+					size_type end = run + 1;
+					while (end < order.size() && order[end]->first == order[run]->first)
+						++end;
+					if (end - run > 1)
+						std::sort(order.begin() + run, order.begin() + end,
+								[](const key_value_pair* a, const key_value_pair* b) { return by_key_order()(*a, *b); });
+					run = end;
+				}
+			}
+
+			bool done() const noexcept
+			{
+				return position == order.size();
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return *order[position];
+			}
+
+			void advance() noexcept
+			{
+				++position;
+			}
+
+		private:
+			std::vector<const key_value_pair*, pointer_allocator> order;
+			size_type position;
+		};
+
+		explicit radix_engine(const Alloc& alloc) noexcept : impl(node_allocator(alloc))
+		{ }
+
+		// kopia węzeł po węźle w te same kubełki (bez porównań), potem drzewo po kluczu
+		// w kolejności oryginału; strong guarantee, O(n log n) bez porównań K i V
+		radix_engine(const radix_engine& engine, const Alloc& alloc) : impl(node_allocator(alloc))
+		{
+			if (engine.impl.elements == 0)
+				return;
+			typedef std::pair<const node*, node*> copy_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<copy_entry> copy_allocator;
+			std::vector<copy_entry, copy_allocator> copies{copy_allocator(impl.allocator())};
+			copies.reserve(engine.impl.elements);
+			impl.level = engine.impl.level;
+			try
+			{
+				for (hook* h = engine.impl.current.first(); h != nullptr; h = rb_tree::next(h))
+					impl.current.insert_before(nullptr, copyNode(node::from_value(h), copies)->value_link());
+				for (unsigned i = 0; i < bits; ++i)
+				{
+					const node* head = engine.impl.buckets[i];
+					if (head == nullptr)
+						continue;
+					const node* o = head;
+					do
+						pushBucket(copyNode(o, copies));
+					while ((o = o->next) != head);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				for (const copy_entry& e : copies)
+					destroyNode(e.second);
+				resetValues();
+				throw;
+			}
+
+			//od tego miejsca nic nie rzuca
+			std::less<const node*> address_less;
+			std::sort(copies.begin(), copies.end(),
+					[&address_less](const copy_entry& a, const copy_entry& b)
+					{ return address_less(a.first, b.first); });
+			for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+			{
+				const node* original = node::from_key(h);
+				auto it = std::lower_bound(copies.begin(), copies.end(), original,
+						[&address_less](const copy_entry& a, const node* b)
+						{ return address_less(a.first, b); });
+				impl.by_key.insert_before(nullptr, it->second->key_link());
+			}
+			impl.floor = engine.impl.floor;
+			impl.elements = engine.impl.elements;
+		}
+
+		radix_engine(radix_engine&& engine) noexcept : impl(engine.impl.allocator())
+		{
+			swap(engine, false);
+		}
+
+		radix_engine& operator=(const radix_engine&) = delete;
+
+		~radix_engine()
+		{
+			destroySubtree(impl.by_key.top());
+		}
+
+		Alloc getAllocator() const noexcept
+		{
+			return Alloc(impl.allocator());
+		}
+
+		// zamiana zawartości, a jeśli with_allocators - także alokatorów, no-throw
+		void swap(radix_engine& engine, bool with_allocators) noexcept
+		{
+			impl.by_key.swap(engine.impl.by_key);
+			impl.current.swap(engine.impl.current);
+			for (unsigned i = 0; i < bits; ++i)
+				std::swap(impl.buckets[i], engine.impl.buckets[i]);
+			std::swap(impl.occupied, engine.impl.occupied);
+			std::swap(impl.level, engine.impl.level);
+			std::swap(impl.floor, engine.impl.floor);
+			std::swap(impl.elements, engine.impl.elements);
+			if (with_allocators)
+				swap_allocators(impl.allocator(), engine.impl.allocator(), propagates_allocator<Alloc>());
+		}
+
+		void clear() noexcept
+		{
+			radix_engine tmp(getAllocator());
+			swap(tmp, false);
+		}
+
+		size_type size() const noexcept
+		{
+			return impl.elements;
+		}
+
+		// pary w porządku po wartości: najmniejsza wartość to level, pary o niej wpinamy po kolei
+		// w kubełek 0 (mają rosnące klucze), pozostałe - na listy; drzewo po kluczu z key_position
+		// strong guarantee, O(n)
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition key_position)
+		{
+			assert(impl.elements == 0);
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			hook_vector by_key_hooks{hook_pointer_allocator(impl.allocator())};
+			try
+			{
+				fresh.reserve(n);
+				by_key_hooks.reserve(n);
+				for (size_type i = 0; i < n; ++i)
+				{
+					auto e = entry_at(i);
+					fresh.push_back(createNode(std::move(e.key), std::move(e.value)));
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			if (n == 0)
+				return;
+			impl.level = fresh[0]->entry.second;
+			for (node* x : fresh)
+				linkValue(x);
+			for (size_type i = 0; i < n; ++i)
+				by_key_hooks.push_back(fresh[static_cast<size_type>(key_position(i))]->key_link());
+			impl.by_key.assign_sorted(by_key_hooks.data(), n);
+			impl.elements = n;
+		}
+
+		// jedna alokacja na parę; porównania (miejsce w drzewie po kluczu i - dla wartości level -
+		// w kubełku 0) wykonujemy przed wpięciem węzła
+		// strong guarantee, O(log n) (w porządku po wartości O(1), dla wartości level - O(log r),
+		// r - liczba par o wartości level)
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			node* n = createNode(std::forward<Args>(args)...);
+			rb_spot spot;
+			value_plan plan;
+			try
+			{
+				spot = impl.by_key.find_spot(
+						[n](hook* h) { return keyLess(n->entry.first, node::from_key(h)->entry.first); });
+				planValue(n, n->entry.first, n->entry.second, plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(n);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_key.link(spot, n->key_link());
+			applyValue(n, plan);
+			++impl.elements;
+			return handle(n);
+		}
+
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			return emplace(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// kubełki usuwają pary od razu, nie ma czego zwalniać
+		void compact() noexcept
+		{ }
+
+		// zastąpienie pary o najmniejszej (największej) wartości parą (key, value), dla niepustego silnika;
+		// replaceMin usuwa minimum, więc value nie powinno być mniejsze od niego (monotone)
+		// strong guarantee, O(log n) zamortyzowane (replaceMax - O(r), r - długość najstarszej listy)
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			V floor = impl.floor;
+			impl.floor = impl.level;
+			try
+			{
+				replaceEntry(minNode(), std::forward<KK>(key), std::forward<VV>(value));
+			}
+			catch (...)
+			{
+				impl.floor = floor;
+				throw;
+			}
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			replaceEntry(maxNode(), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// nowe węzły powstają przed zmianą kolejki; potem planujemy ich miejsca w drzewie po kluczu
+		// i w kubełku 0 (tylko pary o najmniejszej wartości), pozostałe trafiają na listy bez porównań
+		// strong guarantee, O(m log (n + m))
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			try
+			{
+				for (; first != last; ++first)
+				{
+					fresh.push_back(nullptr);
+					const auto& kv = *first;
+					fresh.back() = createNode(kv.first, kv.second);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			insertNodes(fresh);
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return minNode()->entry;
+		}
+
+		// strong guarantee (porównania), O(r), r - długość najstarszej niepustej listy
+		const key_value_pair& maxEntry() const
+		{
+			return maxNode()->entry;
+		}
+
+		// strong guarantee, O(B) zamortyzowane plus porównania kluczy par o nowej najmniejszej wartości
+		void deleteMin()
+		{
+			V removed = impl.level;
+			eraseNode(minNode());
+			impl.floor = removed;
+		}
+
+		// strong guarantee, O(r), r - długość najstarszej niepustej listy
+		void deleteMax()
+		{
+			eraseNode(maxNode());
+		}
+
+		// k najmniejszych par to kubełek 0, kolejne listy w całości i początek ostatniej przeglądanej
+		// listy, posortowanej po (wartość, klucz); reszta tej listy to gotowy nowy kubełek 0 (jej pary
+		// o najmniejszej wartości mają już rosnące klucze) i pary do rozdzielenia między niższe listy
+		// pary zapisujemy do out i dopiero wtedy usuwamy
+		// strong guarantee, O(k + r log r), r - łączna długość przeglądanych list
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			size_type k = std::min(n, impl.elements);
+			if (k == 0)
+				return out;
+			node_vector selected{node_pointer_allocator(impl.allocator())};
+			node_vector tail{node_pointer_allocator(impl.allocator())};
+			selected.reserve(k);
+			hook* h = impl.current.first();
+			for (; h != nullptr && selected.size() < k; h = rb_tree::next(h))
+				selected.push_back(node::from_value(h));
+			bool current_left = h != nullptr;
+			std::uint64_t rest = impl.occupied;
+			unsigned last_bucket = bits;
+			size_type tail_used = 0;
+			while (selected.size() < k)
+			{
+				last_bucket = lowest_bit(rest);
+				rest &= rest - 1;
+				tail.clear();
+				node* head = impl.buckets[last_bucket];
+				node* x = head;
+				do
+					tail.push_back(x);
+				while ((x = x->next) != head);
+				std::sort(tail.begin(), tail.end(), before);
+				tail_used = std::min(tail.size(), k - selected.size());
+				selected.insert(selected.end(), tail.begin(), tail.begin() + tail_used);
+			}
+			//gdy z przejrzanych par nic nie zostaje, nowy kubełek 0 pochodzi z najmłodszej nieprzejrzanej listy
+			value_plan plan;
+			bool refill = !current_left && tail_used == tail.size() && rest != 0;
+			if (refill)
+				planRefill(nullptr, nullptr, V(), rest, plan);
+			for (const node* m : selected)
+			{
+				*out = m->entry;
+				++out;
+			}
+
+			//od tego miejsca nic nie rzuca
+			if (last_bucket == bits)
+				for (node* m : selected)
+					impl.current.erase(m->value_link());
+			else
+			{
+				impl.current.reset();
+				for (std::uint64_t done = impl.occupied & ~rest; done != 0; done &= done - 1)
+					impl.buckets[lowest_bit(done)] = nullptr;
+				impl.occupied = rest;
+				if (tail_used < tail.size())
+				{
+					impl.level = tail[tail_used]->entry.second;
+					for (size_type i = tail_used; i < tail.size(); ++i)
+						linkValue(tail[i]);
+				}
+			}
+			if (refill)
+				applyRefill(plan);
+			impl.floor = selected.back()->entry.second;
+			for (node* m : selected)
+			{
+				impl.by_key.erase(m->key_link());
+				destroyNode(m);
+			}
+			impl.elements -= k;
+			return out;
+		}
+
+		// szukanie po kluczu w drzewie, wśród par o tym kluczu - tej o najmniejszej wartości;
+		// potem zmiana jej wartości w kubełkach
+		// strong guarantee, O(log n + r) zamortyzowane, r - liczba par o kluczu key
+		// KeyLike - K albo typ porównywalny z K (K == KeyLike i K < KeyLike), np. std::string_view
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			node* n = findKey(key);
+			if (n == nullptr)
+				return false;
+			changeNodeValue(n, value);
+			return true;
+		}
+
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			hook* h = findFirst(key);
+			return h != nullptr;
+		}
+
+		// bez szukania po kluczu: para zmienia kubełek w O(1), chyba że to jedyna para kubełka 0
+		// rosnąca ponad level (wtedy jak deleteMin)
+		handle changeValue(handle h, const V& value)
+		{
+			changeNodeValue(h.target, value);
+			return h;
+		}
+
+		const key_value_pair& entry(handle h) const noexcept
+		{
+			return h.target->entry;
+		}
+
+		// rzuca tylko to, co porównania kluczy przy nowym kubełku 0
+		void erase(handle h) noexcept(nothrow_comparable<K, V>::value)
+		{
+			eraseNode(h.target);
+		}
+
+		// przeniesienie wszystkich par engine do *this, strong guarantee
+		// przy równych alokatorach węzły engine są przepinane bez alokacji: w drzewo po kluczu
+		// pojedynczo, O(m log (n + m)), albo scaleniem obu drzew i zbudowaniem drzewa od nowa, O(n + m),
+		// a w porządku po wartości - jak w insertRange
+		// przy różnych - najpierw kopia engine alokatorem *this
+		void merge(radix_engine& engine)
+		{
+			if (engine.impl.elements == 0)
+				return;
+			if (!(impl.allocator() == engine.impl.allocator()))
+			{
+				radix_engine copy(engine, getAllocator());
+				merge(copy);
+				engine.clear();
+				return;
+			}
+			node_vector sorted{node_pointer_allocator(impl.allocator())};
+			sorted.reserve(engine.impl.elements);
+			for (hook* h = engine.impl.by_key.first(); h != nullptr; h = rb_tree::next(h))
+				sorted.push_back(node::from_key(h));
+			key_links links{hook_vector(hook_pointer_allocator(impl.allocator())), false};
+			planKeyLinks(sorted, links);
+			value_batch batch{V(), node_vector(node_pointer_allocator(impl.allocator())),
+					hook_vector(hook_pointer_allocator(impl.allocator()))};
+			planBatch(sorted, batch);
+
+			//od tego miejsca nic nie rzuca
+			engine.impl.by_key.reset();
+			engine.resetValues();
+			engine.impl.elements = 0;
+			applyKeyLinks(sorted, links);
+			applyBatch(sorted, batch);
+			impl.elements += sorted.size();
+		}
+
+	private:
+		// pary w drzewie po kluczu i w kubełkach porządku po wartości
+		// alokator węzłów jest klasą bazową, więc pusty alokator nie zajmuje miejsca
+		struct engine_impl : node_allocator
+		{
+			rb_tree by_key;            // porządek po kluczu
+			rb_tree current;           // kubełek 0: pary o wartości level, po kluczu; pusty tylko w pustym silniku
+			node* buckets[bits];       // buckets[i] - lista kubełka i + 1 (dowolny jej węzeł) albo nullptr
+			std::uint64_t occupied;    // bit i ustawiony, gdy buckets[i] != nullptr
+			V level;                   // najmniejsza wartość w silniku
+			V floor;                   // wartość ostatnio usuniętego minimum, dla asercji monotone
+			size_type elements;
+
+			explicit engine_impl(const node_allocator& alloc) noexcept :
+					node_allocator(alloc), buckets(), occupied(0), level(), floor(), elements(0)
+			{ }
+
+			node_allocator& allocator() noexcept
+			{
+				return *this;
+			}
+
+			const node_allocator& allocator() const noexcept
+			{
+				return *this;
+			}
+		};
+
+		engine_impl impl;
+
+		// plan wpięcia węzła w porządek po wartości (patrz planValue)
+		struct value_plan
+		{
+			enum { to_current, to_bucket, below, refill, alone } kind = alone;
+			rb_spot spot;     // to_current: miejsce w kubełku 0
+			rb_tree refilled; // refill: nowy kubełek 0, z list (i ewentualnie z wpinanym węzłem)
+			V level = V();    // refill: nowa najmniejsza wartość
+			unsigned source = 0; // refill: lista, z której pochodzi nowy kubełek 0
+		};
+
+		// miejsce węzła wypiętego z porządku po wartości (patrz detachValue)
+		struct value_undo
+		{
+			bool in_current;
+			hook* next; // następnik w kubełku 0
+		};
+
+		// plan wpięcia wielu węzłów w porządek po wartości (patrz planBatch)
+		struct value_batch
+		{
+			V level;           // najmniejsza wartość po wpięciu
+			node_vector low;   // wpinane węzły o wartości level, po kluczu
+			hook_vector spots; // dla low: następnik w obecnym kubełku 0, gdy level się nie zmienia
+		};
+
+		// nowe miejsce węzła w drzewie po kluczu po zmianie klucza (patrz planKeyMove)
+		struct key_move
+		{
+			bool stay;
+			hook* before;
+		};
+
+		// miejsca w drzewie po kluczu dla węzłów posortowanych po kluczu (patrz planKeyLinks)
+		struct key_links
+		{
+			hook_vector hooks;
+			bool rebuild;
+		};
+
+		// alokacja i zwolnienie pojedynczego węzła alokatorem kolejki
+		// args - argumenty konstruktora pary
+		template<typename... Args>
+		node* createNode(Args&&... args)
+		{
+			typename node_alloc_traits::pointer p = node_alloc_traits::allocate(impl.allocator(), 1);
+			count_event<stats>(&PriorityQueueStats::allocations);
+			node* n = std::addressof(*p);
+			try
+			{
+				node_alloc_traits::construct(impl.allocator(), n, std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				node_alloc_traits::deallocate(impl.allocator(), p, 1);
+				throw;
+			}
+			return n;
+		}
+
+		void destroyNode(node* n) noexcept
+		{
+			node_alloc_traits::destroy(impl.allocator(), n);
+			node_alloc_traits::deallocate(impl.allocator(),
+					std::pointer_traits<typename node_alloc_traits::pointer>::pointer_to(*n), 1);
+		}
+
+		void destroyNodes(const node_vector& fresh) noexcept
+		{
+			for (node* n : fresh)
+				if (n != nullptr)
+					destroyNode(n);
+		}
+
+		// zwolnienie wszystkich węzłów poddrzewa drzewa po kluczu, głębokość rekursji O(log n)
+		void destroySubtree(hook* h) noexcept
+		{
+			if (!h)
+				return;
+			destroySubtree(h->left);
+			destroySubtree(h->right);
+			destroyNode(node::from_key(h));
+		}
+
+		// kopia pary węzła o (bez miejsc w drzewach), zapamiętana w copies (z zarezerwowanym miejscem)
+		template<typename CopyVector>
+		node* copyNode(const node* o, CopyVector& copies)
+		{
+			node* c = createNode(o->entry.first, o->entry.second);
+			copies.emplace_back(o, c);
+			return c;
+		}
+
+		static bool keyLess(const K& a, const K& b)
+		{
+			count_event<stats>(&PriorityQueueStats::comparisons);
+			return a < b;
+		}
+
+		// czy para a jest w porządku po wartości przed b
+		static bool before(const node* a, const node* b)
+		{
+			return by_value_order::less(a->entry.first, a->entry.second, b->entry.first, b->entry.second);
+		}
+
+		node* minNode() const noexcept
+		{
+			return node::from_value(impl.current.first());
+		}
+
+		// największa para: w kubełku 0, jeśli list nie ma, wpp. na najstarszej liście
+		node* maxNode() const
+		{
+			if (impl.occupied == 0)
+				return node::from_value(impl.current.last());
+			node* head = impl.buckets[highest_bit(impl.occupied)];
+			node* best = head;
+			for (node* x = head->next; x != head; x = x->next)
+				if (before(best, x))
+					best = x;
+			return best;
+		}
+
+		// numer listy węzła o wartości value != level
+		unsigned bucketOf(V value) const noexcept
+		{
+			return highest_bit(static_cast<std::uint64_t>(value) ^ static_cast<std::uint64_t>(impl.level));
+		}
+
+		// dopięcie węzła x (o wartości różnej od level) do jego listy, no-throw
+		void pushBucket(node* x) noexcept
+		{
+			unsigned i = bucketOf(x->entry.second);
+			node* head = impl.buckets[i];
+			if (head == nullptr)
+			{
+				x->prev = x->next = x;
+				impl.buckets[i] = x;
+				impl.occupied |= std::uint64_t(1) << i;
+				return;
+			}
+			x->next = head;
+			x->prev = head->prev;
+			head->prev->next = x;
+			head->prev = x;
+		}
+
+		void unlinkBucket(node* x) noexcept
+		{
+			unsigned i = bucketOf(x->entry.second);
+			if (x->next == x)
+			{
+				impl.buckets[i] = nullptr;
+				impl.occupied &= ~(std::uint64_t(1) << i);
+				return;
+			}
+			x->prev->next = x->next;
+			x->next->prev = x->prev;
+			if (impl.buckets[i] == x)
+				impl.buckets[i] = x->next;
+		}
+
+		// odpięcie całej listy i; zwraca jej węzeł albo nullptr, no-throw
+		node* takeBucket(unsigned i) noexcept
+		{
+			node* head = impl.buckets[i];
+			impl.buckets[i] = nullptr;
+			impl.occupied &= ~(std::uint64_t(1) << i);
+			return head;
+		}
+
+		// dołączenie listy (węzła) list do listy i, no-throw
+		void spliceBucket(node* list, unsigned i) noexcept
+		{
+			if (list == nullptr)
+				return;
+			node* head = impl.buckets[i];
+			if (head == nullptr)
+			{
+				impl.buckets[i] = list;
+				impl.occupied |= std::uint64_t(1) << i;
+				return;
+			}
+			node* head_tail = head->prev;
+			node* list_tail = list->prev;
+			head_tail->next = list;
+			list->prev = head_tail;
+			list_tail->next = head;
+			head->prev = list_tail;
+		}
+
+		// rozdzielenie węzłów odpiętej listy list (już bez tych o wartości level) między listy, no-throw
+		void scatterBucket(node* list) noexcept
+		{
+			if (list == nullptr)
+				return;
+			node* x = list;
+			do
+			{
+				node* next = x->next;
+				if (x->entry.second != impl.level)
+					pushBucket(x);
+				x = next;
+			}
+			while (x != list);
+		}
+
+		// wpięcie węzła x na koniec kubełka 0 (wartość level; wywołujący dba o porządek kluczy)
+		// albo na jego listę, no-throw
+		void linkValue(node* x) noexcept
+		{
+			if (x->entry.second == impl.level)
+				impl.current.insert_before(nullptr, x->value_link());
+			else
+				pushBucket(x);
+		}
+
+		void resetValues() noexcept
+		{
+			impl.current.reset();
+			for (unsigned i = 0; i < bits; ++i)
+				impl.buckets[i] = nullptr;
+			impl.occupied = 0;
+		}
+
+		// zmniejszenie level do value (wartość mniejsza od wszystkich w silniku): kubełek 0 i listy
+		// 0 .. h - 1 (h - najstarszy bit różnicy) trafiają na listę h, a dawna lista h - na niższe listy;
+		// kubełek 0 zostaje pusty; no-throw, O(r + B), r - liczba par kubełka 0 i dawnej listy h
+		void lower(V value) noexcept
+		{
+			unsigned h = bucketOf(value);
+			node* old = takeBucket(h);
+			impl.level = value;
+			for (unsigned i = 0; i < h; ++i)
+				spliceBucket(takeBucket(i), h);
+			for (hook* x = impl.current.first(); x != nullptr; )
+			{
+				hook* next = rb_tree::next(x);
+				pushBucket(node::from_value(x));
+				x = next;
+			}
+			impl.current.reset();
+			scatterBucket(old);
+		}
+
+		// plan wpięcia węzła x (spoza porządku po wartości) z kluczem key i wartością value:
+		// do kubełka 0 (miejsce po kluczu), na listę, do kubełka 0 po zmniejszeniu level, jako jedyny
+		// węzeł albo - gdy kubełek 0 jest pusty, a listy nie - z nowym kubełkiem 0 (planRefill)
+		// niczego nie zmienia, rzuca tylko to, co porównania kluczy
+		void planValue(node* x, const K& key, V value, value_plan& plan)
+		{
+			//monotone: nie mniej niż ostatnio usunięte minimum
+			assert(!(value < impl.floor));
+			if (!impl.current.empty())
+			{
+				if (value == impl.level)
+				{
+					plan.kind = value_plan::to_current;
+					plan.spot = impl.current.find_spot(
+							[&key](hook* h) { return keyLess(key, node::from_value(h)->entry.first); });
+				}
+				else
+					plan.kind = value < impl.level ? value_plan::below : value_plan::to_bucket;
+			}
+			else if (impl.occupied == 0)
+				plan.kind = value_plan::alone;
+			else if (value < impl.level)
+				plan.kind = value_plan::below;
+			else
+				planRefill(x, &key, value, impl.occupied, plan);
+		}
+
+		// plan nowego kubełka 0 z najmłodszej listy maski occupied (kubełek 0 i młodsze listy są puste
+		// albo zostaną usunięte): węzły o najmniejszej wartości m tej listy w drzewie po kluczu plan.refilled;
+		// x (jeśli nie nullptr) - wpinany węzeł o kluczu *key i wartości value, który też może tam trafić
+		// (a gdy value < m, jest tam sam); zmienia tylko zaczepy drzewa po wartości węzłów list,
+		// rzuca tylko to, co porównania kluczy
+		void planRefill(node* x, const K* key, V value, std::uint64_t occupied, value_plan& plan)
+		{
+			plan.kind = value_plan::refill;
+			plan.source = lowest_bit(occupied);
+			node* head = impl.buckets[plan.source];
+			V m = head->entry.second;
+			for (node* n = head->next; n != head; n = n->next)
+				if (n->entry.second < m)
+					m = n->entry.second;
+			if (x != nullptr && value < m)
+			{
+				plan.level = value;
+				plan.refilled.insert_before(nullptr, x->value_link());
+				return;
+			}
+			plan.level = m;
+			node* n = head;
+			do
+				if (n->entry.second == m)
+					plan.refilled.link(plan.refilled.find_spot(
+							[n](hook* h) { return keyLess(n->entry.first, node::from_value(h)->entry.first); }),
+							n->value_link());
+			while ((n = n->next) != head);
+			if (x != nullptr && value == m)
+				plan.refilled.link(plan.refilled.find_spot(
+						[key](hook* h) { return keyLess(*key, node::from_value(h)->entry.first); }),
+						x->value_link());
+		}
+
+		// wykonanie planu z planRefill (kubełek 0 jest pusty), no-throw
+		void applyRefill(value_plan& plan) noexcept
+		{
+			node* list = takeBucket(plan.source);
+			impl.level = plan.level;
+			impl.current.swap(plan.refilled);
+			scatterBucket(list);
+		}
+
+		// wykonanie planu z planValue dla węzła x (już z nową parą), no-throw
+		void applyValue(node* x, value_plan& plan) noexcept
+		{
+			switch (plan.kind)
+			{
+			case value_plan::to_current:
+				impl.current.link(plan.spot, x->value_link());
+				break;
+			case value_plan::to_bucket:
+				pushBucket(x);
+				break;
+			case value_plan::below:
+				lower(x->entry.second);
+				impl.current.insert_before(nullptr, x->value_link());
+				break;
+			case value_plan::refill:
+				applyRefill(plan);
+				if (x->entry.second != impl.level)
+					pushBucket(x);
+				break;
+			case value_plan::alone:
+				impl.level = x->entry.second;
+				impl.current.insert_before(nullptr, x->value_link());
+				break;
+			}
+		}
+
+		// odwracalne wypięcie węzła x z porządku po wartości (bez zmiany level), no-throw
+		value_undo detachValue(node* x) noexcept
+		{
+			if (x->entry.second != impl.level)
+			{
+				unlinkBucket(x);
+				return value_undo{false, nullptr};
+			}
+			hook* next = rb_tree::next(x->value_link());
+			impl.current.erase(x->value_link());
+			return value_undo{true, next};
+		}
+
+		void undoDetach(node* x, const value_undo& undo) noexcept
+		{
+			if (undo.in_current)
+				impl.current.insert_before(undo.next, x->value_link());
+			else
+				pushBucket(x);
+		}
+
+		// plan nowego kubełka 0 po odpięciu węzła x (undo - z detachValue); przy wyjątku x wraca na miejsce
+		void planRefillAfter(node* x, const value_undo& undo, value_plan& plan)
+		{
+			try
+			{
+				planRefill(nullptr, nullptr, V(), impl.occupied, plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				undoDetach(x, undo);
+				throw;
+			}
+		}
+
+		// usunięcie węzła x; gdy był ostatnią parą kubełka 0, nowy kubełek 0 planujemy z najmłodszej listy
+		// strong guarantee (rzuca tylko to, co porównania kluczy), O(B) zamortyzowane
+		void eraseNode(node* x) noexcept(nothrow_comparable<K, V>::value)
+		{
+			value_undo undo = detachValue(x);
+			if (impl.current.empty() && impl.occupied != 0)
+			{
+				value_plan plan;
+				planRefillAfter(x, undo, plan);
+				//od tego miejsca nic nie rzuca
+				applyRefill(plan);
+			}
+			impl.by_key.erase(x->key_link());
+			destroyNode(x);
+			--impl.elements;
+		}
+
+		// pierwszy węzeł drzewa po kluczu o kluczu key, albo nullptr
+		template<typename KeyLike>
+		hook* findFirst(const KeyLike& key) const
+		{
+			hook* h = impl.by_key.lower_bound([&key](hook* x) { return node::from_key(x)->entry.first < key; });
+			if (h == nullptr || !(node::from_key(h)->entry.first == key))
+				return nullptr;
+			return h;
+		}
+
+		// para o kluczu key i najmniejszej wartości
+		template<typename KeyLike>
+		node* findKey(const KeyLike& key) const
+		{
+			hook* h = findFirst(key);
+			if (h == nullptr)
+				return nullptr;
+			node* best = node::from_key(h);
+			for (h = rb_tree::next(h); h != nullptr && node::from_key(h)->entry.first == key; h = rb_tree::next(h))
+			{
+				node* n = node::from_key(h);
+				if (by_key_order()(n->entry, best->entry))
+					best = n;
+			}
+			return best;
+		}
+
+		// wpięcie nowych węzłów fresh (kolejka przejmuje je na własność), strong guarantee:
+		// przy wyjątku wszystkie węzły fresh są zwalniane, a kolejka się nie zmienia
+		// sortujemy kopie fresh, bo przerwane wyjątkiem sortowanie może zgubić lub powtórzyć wskaźnik
+		void insertNodes(const node_vector& fresh)
+		{
+			if (fresh.empty())
+				return;
+			node_vector sorted{node_pointer_allocator(impl.allocator())};
+			key_links links{hook_vector(hook_pointer_allocator(impl.allocator())), false};
+			value_batch batch{V(), node_vector(node_pointer_allocator(impl.allocator())),
+					hook_vector(hook_pointer_allocator(impl.allocator()))};
+			try
+			{
+				sorted = fresh;
+				std::sort(sorted.begin(), sorted.end(),
+						[](const node* a, const node* b) { return keyLess(a->entry.first, b->entry.first); });
+				planKeyLinks(sorted, links);
+				planBatch(sorted, batch);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			applyKeyLinks(sorted, links);
+			applyBatch(sorted, batch);
+			impl.elements += fresh.size();
+		}
+
+		// plan wpięcia węzłów sorted (posortowanych po kluczu, spoza porządku po wartości): nowa
+		// najmniejsza wartość, węzły o niej i - gdy level się nie zmienia - ich miejsca w kubełku 0;
+		// pozostałe węzły trafią na listy bez porównań; rzuca tylko to, co porównania kluczy i alokacja
+		void planBatch(const node_vector& sorted, value_batch& batch)
+		{
+			V m = sorted[0]->entry.second;
+			for (const node* n : sorted)
+				if (n->entry.second < m)
+					m = n->entry.second;
+			//monotone: nie mniej niż ostatnio usunięte minimum
+			assert(!(m < impl.floor));
+			bool keeps_level = impl.elements != 0 && !(m < impl.level);
+			batch.level = keeps_level ? impl.level : m;
+			for (node* n : sorted)
+				if (n->entry.second == batch.level)
+					batch.low.push_back(n);
+			if (!keeps_level)
+				return;
+			batch.spots.reserve(batch.low.size());
+			for (const node* n : batch.low)
+				batch.spots.push_back(impl.current.lower_bound(
+						[n](hook* h) { return !keyLess(n->entry.first, node::from_value(h)->entry.first); }));
+		}
+
+		void applyBatch(const node_vector& sorted, const value_batch& batch) noexcept
+		{
+			if (impl.elements == 0)
+				impl.level = batch.level;
+			else if (batch.level < impl.level)
+				lower(batch.level);
+			//węzły o wspólnym następniku wpinamy przed nim w kolejności kluczy
+			for (size_type i = 0; i < batch.low.size(); ++i)
+				impl.current.insert_before(batch.spots.empty() ? nullptr : batch.spots[i], batch.low[i]->value_link());
+			for (node* n : sorted)
+				if (n->entry.second != impl.level)
+					pushBucket(n);
+		}
+
+		// czy m pojedynczych wpięć w drzewo po kluczu (O(m log (n + m))) jest tańsze
+		// od zbudowania go od nowa (O(n + m))
+		bool linkingIsCheaper(size_type m) const noexcept
+		{
+			size_type total = impl.elements + m;
+			size_type depth = 1;
+			while ((size_type(1) << depth) < total)
+				++depth;
+			return m * depth < impl.elements;
+		}
+
+		// plan wpięcia węzłów sorted (posortowanych po kluczu, spoza drzewa) w drzewo po kluczu:
+		// dla każdego pierwszy węzeł drzewa o większym kluczu (przed nim wpinamy) albo, gdy tak taniej,
+		// cała nowa kolejność drzewa ze scalenia; rzuca tylko to, co porównania i alokacja
+		void planKeyLinks(const node_vector& sorted, key_links& links)
+		{
+			links.rebuild = !linkingIsCheaper(sorted.size());
+			if (!links.rebuild)
+			{
+				links.hooks.reserve(sorted.size());
+				for (const node* n : sorted)
+					links.hooks.push_back(impl.by_key.lower_bound(
+							[n](hook* h) { return !keyLess(n->entry.first, node::from_key(h)->entry.first); }));
+				return;
+			}
+			links.hooks.reserve(impl.elements + sorted.size());
+			hook* h = impl.by_key.first();
+			for (node* n : sorted)
+			{
+				while (h != nullptr && !keyLess(n->entry.first, node::from_key(h)->entry.first))
+				{
+					links.hooks.push_back(h);
+					h = rb_tree::next(h);
+				}
+				links.hooks.push_back(n->key_link());
+			}
+			for (; h != nullptr; h = rb_tree::next(h))
+				links.hooks.push_back(h);
+		}
+
+		void applyKeyLinks(const node_vector& sorted, const key_links& links) noexcept
+		{
+			if (links.rebuild)
+			{
+				impl.by_key.assign_sorted(links.hooks.data(), links.hooks.size());
+				return;
+			}
+			//węzły o wspólnym następniku wpinamy przed nim w kolejności sorted
+			for (size_type i = 0; i < sorted.size(); ++i)
+				impl.by_key.insert_before(links.hooks[i], sorted[i]->key_link());
+		}
+
+		// nowe miejsce węzła n w drzewie po kluczu po zmianie klucza na key: stay == true, gdy może zostać
+		// (sprawdzamy tylko sąsiadów), wpp. trzeba go przepiąć przed before; rzuca tylko to, co porównania
+		key_move planKeyMove(node* n, const K& key) const
+		{
+			hook* self = n->key_link();
+			hook* prev = rb_tree::prev(self);
+			hook* next = rb_tree::next(self);
+			if ((prev == nullptr || !keyLess(key, node::from_key(prev)->entry.first)) &&
+					(next == nullptr || !keyLess(node::from_key(next)->entry.first, key)))
+				return key_move{true, nullptr};
+			hook* before = impl.by_key.lower_bound(
+					[&key](hook* h) { return !keyLess(key, node::from_key(h)->entry.first); });
+			if (before == self)
+				before = next;
+			return key_move{false, before};
+		}
+
+		void applyKeyMove(node* n, const key_move& move) noexcept
+		{
+			if (move.stay)
+				return;
+			impl.by_key.erase(n->key_link());
+			impl.by_key.insert_before(move.before, n->key_link());
+		}
+
+		// zamiana pary węzła n na parę nowego węzła fresh (kolejka przejmuje go na własność)
+		// strong guarantee: przy wyjątku z porównań fresh jest zwalniany
+		void replaceWith(node* n, node* fresh)
+		{
+			key_move key_position{true, nullptr};
+			try
+			{
+				key_position = planKeyMove(n, fresh->entry.first);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(fresh);
+				throw;
+			}
+			value_undo undo = detachValue(n);
+			value_plan plan;
+			try
+			{
+				planValue(fresh, fresh->entry.first, fresh->entry.second, plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				undoDetach(n, undo);
+				destroyNode(fresh);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_key.insert_before(key_position.stay ? n->key_link() : key_position.before, fresh->key_link());
+			impl.by_key.erase(n->key_link());
+			destroyNode(n);
+			applyValue(fresh, plan);
+		}
+
+		// zamiana pary w węźle n na (key, value) bez alokacji: najpierw wszystkie porównania
+		// (n jest na ten czas odwracalnie wypięty z porządku po wartości), potem assign() - przypisanie
+		// klucza, które nie może rzucić - i przepięcie węzła
+		template<typename Assign>
+		void assignInPlace(node* n, const K& key, V value, Assign assign)
+		{
+			key_move key_position = planKeyMove(n, key);
+			value_undo undo = detachValue(n);
+			value_plan plan;
+			try
+			{
+				planValue(n, key, value, plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				undoDetach(n, undo);
+				throw;
+			}
+			assign();
+			//od tego miejsca nic nie rzuca
+			n->entry.second = value;
+			applyKeyMove(n, key_position);
+			applyValue(n, plan);
+		}
+
+		// zastąpienie pary z węzła n parą (key, value), strong guarantee
+		// bez alokacji, jeśli przypisanie K nie rzuca (ewentualnie po skopiowaniu key); wpp. nowy węzeł
+		// zajmuje miejsce n
+		template<typename KK, typename VV>
+		void replaceEntry(node* n, KK&& key, VV&& value)
+		{
+			if (std::is_nothrow_copy_assignable<K>::value)
+				assignInPlace(n, key, V(value), [&] { n->entry.first = key; });
+			else if (std::is_nothrow_move_assignable<K>::value)
+			{
+				K key_copy(std::forward<KK>(key));
+				assignInPlace(n, key_copy, V(value), [&] { n->entry.first = std::move(key_copy); });
+			}
+			else
+				replaceWith(n, createNode(std::forward<KK>(key), std::forward<VV>(value)));
+		}
+
+		// zmiana wartości węzła n (przypisanie V nie rzuca), strong guarantee
+		void changeNodeValue(node* n, V value)
+		{
+			if (value == n->entry.second)
+				return;
+			value_undo undo = detachValue(n);
+			value_plan plan;
+			try
+			{
+				planValue(n, n->entry.first, value, plan);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				undoDetach(n, undo);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			n->entry.second = value;
+			applyValue(n, plan);
+		}
+	};
+
+	// silnik haszujący: porządek po wartości to drzewo czerwono-czarne (jak w silniku drzewiastym),
+	// a zamiast drzewa po kluczu - indeks haszujący hash_index od klucza do par o tym kluczu
+	// (pary o równym kluczu tworzą cykl, patrz hashed_node); szukanie po kluczu (changeValue, contains)
+	// to oczekiwane O(1) porównań kluczy (== zamiast <) plus przejście cyklu równych kluczy
+	// porządku po kluczu nie ma: operatory porównania, save i serialize sortują wskaźniki na żądanie,
+	// O(n log n), i nie ma iteratorów; węzeł nie ma zaczepu drzewa po kluczu, a indeks zajmuje
+	// ok. 9 bajtów na miejsce przy wypełnieniu do 7/8
+	// Hash jest tworzony domyślnym konstruktorem przy każdym użyciu, więc skrót może zależeć tylko od klucza
+	// (skróty węzłów są pamiętane i przechodzą z węzłami przy merge); Hash i == kluczy muszą być zgodne
+	// wszystkie operacje najpierw porównują i haszują, rezerwują miejsce w indeksie, a dopiero potem
+	// przepinają węzły, więc mają strong guarantee (basic_guarantee - jak w silniku drzewiastym)
+	template<typename K, typename V, typename Alloc, typename Policy, typename Hash>
+	class hash_engine
+	{
+		static_assert(!counts_duplicates<Policy>::value, "Hash engine doesn't support count_duplicates!");
+		static_assert(!deletes_lazily<Policy>::value, "Hash engine doesn't support lazy_deletion!");
+		static_assert(std::is_nothrow_default_constructible<Hash>::value,
+				"Hash engine requires no-throw default constructible Hash!");
+
+		static const bool stats = collects_stats<Policy>::value;
+		static const bool basic = relaxes_guarantee<Policy>::value;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef hashed_node<K, V> node;
+		typedef rb_hook hook;
+		typedef hash_index<node> index;
+		typedef typename index::storage index_storage;
+		typedef CompByFst<K, V, stats, Policy> by_key_order;
+		typedef CompBySnd<K, V, stats, Policy> by_value_order;
+
+		typedef typename std::allocator_traits<Alloc>::template rebind_alloc<node> node_allocator;
+		typedef std::allocator_traits<node_allocator> node_alloc_traits;
+		typedef typename node_alloc_traits::template rebind_alloc<node*> node_pointer_allocator;
+		typedef std::allocator_traits<node_pointer_allocator> node_pointer_alloc_traits;
+		typedef std::vector<node*, node_pointer_allocator> node_vector;
+		typedef typename node_alloc_traits::template rebind_alloc<hook*> hook_pointer_allocator;
+		typedef std::vector<hook*, hook_pointer_allocator> hook_vector;
+		typedef typename node_alloc_traits::template rebind_alloc<unsigned char> control_allocator;
+		typedef std::allocator_traits<control_allocator> control_alloc_traits;
+
+	public:
+		typedef size_t size_type;
+
+		static const bool has_handles = true;
+		static const bool has_ordered_iterators = false;
+		static const bool contiguous_key_order = branchless_comparable<K, V>::value;
+		static const bool parallel_bulk = false;
+
+		typedef no_iterator key_iterator;
+		typedef no_iterator value_iterator;
+
+		// uchwyt do pary: wskaźnik na jej węzeł
+		class handle
+		{
+		public:
+			handle() noexcept : target(nullptr)
+			{ }
+
+			explicit operator bool() const noexcept
+			{
+				return target != nullptr;
+			}
+
+			bool operator==(const handle& other) const noexcept
+			{
+				return target == other.target;
+			}
+
+			bool operator!=(const handle& other) const noexcept
+			{
+				return target != other.target;
+			}
+
+		private:
+			friend class hash_engine;
+
+			explicit handle(node* n) noexcept : target(n)
+			{ }
+
+			node* target;
+		};
+
+		// kopia par posortowana w porządku (klucz, wartość), dla arytmetycznych K i V
+		// konstrukcja: O(n log n), może rzucić (alokacja)
+		class key_array
+		{
+			typedef typename std::allocator_traits<Alloc>::template rebind_alloc<key_value_pair> entry_allocator;
+
+		public:
+			explicit key_array(const hash_engine& engine) : entries(entry_allocator(engine.impl.allocator()))
+			{
+				entries.reserve(engine.impl.elements);
+				for (hook* h = engine.impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+					entries.push_back(node::from_value(h)->entry);
+				std::sort(entries.begin(), entries.end(), by_key_order());
+			}
+
+			const key_value_pair* data() const noexcept
+			{
+				return entries.data();
+			}
+
+		private:
+			std::vector<key_value_pair, entry_allocator> entries;
+		};
+
+		// przejście w porządku (klucz, wartość) po posortowanej tablicy wskaźników
+		// konstrukcja: O(n log n), może rzucić (alokacja, porównania)
+		class key_cursor
+		{
+			typedef typename std::allocator_traits<Alloc>::template rebind_alloc<const key_value_pair*> pointer_allocator;
+
+		public:
+			explicit key_cursor(const hash_engine& engine) :
+					order(pointer_allocator(engine.impl.allocator())), position(0)
+			{
+				order.reserve(engine.impl.elements);
+				for (hook* h = engine.impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+					order.push_back(&node::from_value(h)->entry);
+				std::sort(order.begin(), order.end(),
+						[](const key_value_pair* a, const key_value_pair* b) { return by_key_order()(*a, *b); });
+			}
+
+			bool done() const noexcept
+			{
+				return position == order.size();
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return *order[position];
+			}
+
+			void advance() noexcept
+			{
+				++position;
+			}
+
+		private:
+			std::vector<const key_value_pair*, pointer_allocator> order;
+			size_type position;
+		};
+
+		explicit hash_engine(const Alloc& alloc) noexcept : impl(node_allocator(alloc))
+		{ }
+
+		// kopia węzłów w kolejności po wartości (dopinanie na koniec drzewa nie wymaga porównań),
+		// a cykle równych kluczy odtwarzamy przez odwzorowanie stary węzeł -> nowy węzeł;
+		// zapamiętane skróty są kopiowane, więc Hash nie jest wywoływany
+		// strong guarantee, O(n log n) operacji na wskaźnikach, bez porównań K i V
+		hash_engine(const hash_engine& engine, const Alloc& alloc) : impl(node_allocator(alloc))
+		{
+			typedef std::pair<const node*, node*> copy_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<copy_entry> copy_allocator;
+			std::vector<copy_entry, copy_allocator> copies{copy_allocator(impl.allocator())};
+			copies.reserve(engine.impl.elements);
+			try
+			{
+				reserveKeys(engine.impl.by_key.size());
+				for (hook* h = engine.impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+				{
+					const node* original = node::from_value(h);
+					node* copy = createNode(original->entry.first, original->entry.second);
+					copy->hash = original->hash;
+					impl.by_value.insert_before(nullptr, copy->value_link());
+					++impl.elements;
+					copies.emplace_back(original, copy);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				//destruktor się nie wykona
+				destroySubtree(impl.by_value.top());
+				freeIndex();
+				throw;
+			}
+
+			//od tego miejsca nic nie rzuca
+			std::less<const node*> address_less;
+			std::sort(copies.begin(), copies.end(),
+					[&address_less](const copy_entry& a, const copy_entry& b)
+					{ return address_less(a.first, b.first); });
+			auto copy_of = [&copies, &address_less](const node* original)
+			{
+				return std::lower_bound(copies.begin(), copies.end(), original,
+						[&address_less](const copy_entry& a, const node* b)
+						{ return address_less(a.first, b); })->second;
+			};
+			engine.impl.by_key.for_each([this, &copy_of](const node* first)
+			{
+				node* group = copy_of(first);
+				linkKey(group, nullptr);
+				for (const node* x = first->next_equal; x != first; x = x->next_equal)
+					linkKey(copy_of(x), group);
+			});
+		}
+
+		hash_engine(hash_engine&& engine) noexcept : impl(engine.impl.allocator())
+		{
+			swap(engine, false);
+		}
+
+		hash_engine& operator=(const hash_engine&) = delete;
+
+		~hash_engine()
+		{
+			destroySubtree(impl.by_value.top());
+			freeIndex();
+		}
+
+		Alloc getAllocator() const noexcept
+		{
+			return Alloc(impl.allocator());
+		}
+
+		// zamiana zawartości, a jeśli with_allocators - także alokatorów, no-throw
+		void swap(hash_engine& engine, bool with_allocators) noexcept
+		{
+			impl.by_value.swap(engine.impl.by_value);
+			impl.by_key.swap(engine.impl.by_key);
+			std::swap(impl.elements, engine.impl.elements);
+			if (with_allocators)
+				swap_allocators(impl.allocator(), engine.impl.allocator(), propagates_allocator<Alloc>());
+		}
+
+		void clear() noexcept
+		{
+			hash_engine tmp(getAllocator());
+			swap(tmp, false);
+		}
+
+		size_type size() const noexcept
+		{
+			return impl.elements;
+		}
+
+		// drzewo po wartości powstaje od razu zrównoważone (assign_sorted); w porządku po kluczu
+		// pary o równym kluczu są sąsiednie, więc cykle wyznaczają porównania == sąsiadów
+		// strong guarantee, O(n)
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition key_position)
+		{
+			assert(impl.elements == 0);
+			typedef typename node_alloc_traits::template rebind_alloc<bool> flag_allocator;
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			//czy i-ta para w porządku po kluczu ma inny klucz niż poprzednia
+			std::vector<bool, flag_allocator> new_key{flag_allocator(impl.allocator())};
+			try
+			{
+				fresh.reserve(n);
+				by_value_hooks.reserve(n);
+				new_key.reserve(n);
+				for (size_type i = 0; i < n; ++i)
+				{
+					auto e = entry_at(i);
+					fresh.push_back(createNode(std::move(e.key), std::move(e.value)));
+					fresh.back()->hash = hashOf(fresh.back()->entry.first);
+				}
+				size_type keys = 0;
+				for (size_type i = 0; i < n; ++i)
+				{
+					const node* x = fresh[static_cast<size_type>(key_position(i))];
+					new_key.push_back(i == 0 ||
+							!keyEqual(fresh[static_cast<size_type>(key_position(i - 1))]->entry.first, x->entry.first));
+					keys += new_key.back();
+				}
+				reserveKeys(keys);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			for (node* x : fresh)
+				by_value_hooks.push_back(x->value_link());
+			impl.by_value.assign_sorted(by_value_hooks.data(), n);
+			node* group = nullptr;
+			for (size_type i = 0; i < n; ++i)
+			{
+				node* x = fresh[static_cast<size_type>(key_position(i))];
+				if (new_key[i])
+					group = nullptr;
+				linkKey(x, group);
+				group = x;
+			}
+			impl.elements = n;
+		}
+
+		// jedna alokacja na parę; skrót, szukanie klucza w indeksie i miejsca w drzewie po wartości
+		// (oraz ewentualne powiększenie indeksu) wykonujemy przed wpięciem węzła
+		// strong guarantee, O(log n) porównań wartości i oczekiwane O(1) porównań kluczy
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			return handle(linkNode(createNode(std::forward<Args>(args)...)));
+		}
+
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			return emplace(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// wstawienie par z zakresu [first, last): najpierw tworzymy wszystkie węzły,
+		// małą partię wpinamy pojedynczo, a dla dużej sortujemy ją raz po wartości, scalamy
+		// z drzewem i budujemy je od nowa; klucze zawsze trafiają do indeksu pojedynczo
+		// strong guarantee (basic przy basic_guarantee), O(m log (n + m)) albo O(n + m log m)
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			node_vector fresh{node_pointer_allocator(impl.allocator())};
+			try
+			{
+				for (; first != last; ++first)
+				{
+					fresh.push_back(nullptr);
+					const auto& kv = *first;
+					fresh.back() = createNode(kv.first, kv.second);
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			insertNodes(fresh);
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return node::from_value(impl.by_value.first())->entry;
+		}
+
+		const key_value_pair& maxEntry() const noexcept
+		{
+			return node::from_value(impl.by_value.last())->entry;
+		}
+
+		// węzeł zna swój skrót, więc indeks odnajduje go porównaniem wskaźników, bez == kluczy
+		// nothrow, O(log n)
+		void deleteMin() noexcept
+		{
+			eraseNode(node::from_value(impl.by_value.first()));
+		}
+
+		void deleteMax() noexcept
+		{
+			eraseNode(node::from_value(impl.by_value.last()));
+		}
+
+		// zastąpienie pary o najmniejszej (największej) wartości parą (key, value), dla niepustego silnika
+		// strong guarantee, O(log n)
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			replaceEntry(node::from_value(impl.by_value.first()), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			replaceEntry(node::from_value(impl.by_value.last()), std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		// pary są usuwane od razu, nie ma czego zwalniać
+		void compact() noexcept
+		{ }
+
+		// zapisanie do out min(n, size()) par o najmniejszych wartościach (rosnąco) i ich usunięcie
+		// pary są najpierw zapisywane, a dopiero potem usuwane; przy dużej partii drzewo po wartości
+		// budujemy od nowa z pozostałych węzłów, a z indeksu usuwamy klucze pojedynczo (O(1) każdy)
+		// strong guarantee, O(k log n) albo O(n), k = min(n, size())
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			size_type k = std::min(n, impl.elements);
+			bool rebuild = !linkingIsCheaper(k);
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			if (rebuild)
+				by_value_hooks.reserve(impl.elements);
+
+			hook* h = impl.by_value.first();
+			for (size_type written = 0; written < k; ++written, h = rb_tree::next(h))
+			{
+				*out = node::from_value(h)->entry;
+				++out;
+			}
+
+			//od tego miejsca nic nie rzuca
+			if (!rebuild)
+			{
+				for (size_type removed = 0; removed < k; ++removed)
+					eraseNode(node::from_value(impl.by_value.first()));
+				return out;
+			}
+			for (h = impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+				by_value_hooks.push_back(h);
+			//węzły zwalniamy dopiero po przejściu drzewa, bo next() chodzi po przodkach
+			for (size_type i = 0; i < k; ++i)
+			{
+				node* x = node::from_value(by_value_hooks[i]);
+				unlinkKey(x);
+				destroyNode(x);
+			}
+			impl.elements -= k;
+			impl.by_value.assign_sorted(by_value_hooks.data() + k, impl.elements);
+			return out;
+		}
+
+		// jedno wyszukanie w indeksie i przepięcie istniejącego węzła w drzewie po wartości
+		// strong guarantee, oczekiwane O(1) porównań kluczy plus O(log n) porównań wartości
+		// KeyLike - K albo typ porównywalny z K (K == KeyLike), dla którego Hash daje ten sam skrót, co dla K
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			//para o danym kluczu i najmniejszej wartości
+			node* n = findKey(key);
+			if (n == nullptr)
+				return false;
+			changeNodeValue(n, value);
+			return true;
+		}
+
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			return findGroup(key, hashOf(key)) != nullptr;
+		}
+
+		handle changeValue(handle h, const V& value)
+		{
+			return handle(changeNodeValue(h.target, value));
+		}
+
+		const key_value_pair& entry(handle h) const noexcept
+		{
+			return h.target->entry;
+		}
+
+		void erase(handle h) noexcept
+		{
+			eraseNode(h.target);
+		}
+
+		// przeniesienie wszystkich par engine do *this, strong guarantee
+		// przy równych alokatorach węzły engine są przepinane bez alokacji i bez wywołań Hash: dla każdego
+		// klucza engine szukamy jego cyklu w *this, drzewa po wartości łączymy pojedynczo, O(m log (n + m)),
+		// albo scaleniem i zbudowaniem od nowa, O(n + m), a na końcu (bez porównań) łączymy cykle
+		// i uzupełniamy indeks; przy różnych alokatorach pary są kopiowane jak w insertRange
+		void merge(hash_engine& engine)
+		{
+			if (engine.impl.elements == 0)
+				return;
+			if (!(impl.allocator() == engine.impl.allocator()))
+			{
+				node_vector fresh{node_pointer_allocator(impl.allocator())};
+				try
+				{
+					fresh.reserve(engine.impl.elements);
+					for (hook* h = engine.impl.by_value.first(); h != nullptr; h = rb_tree::next(h))
+					{
+						const node* n = node::from_value(h);
+						fresh.push_back(createNode(n->entry.first, n->entry.second));
+					}
+				}
+				catch (...)
+				{
+					count_event<stats>(&PriorityQueueStats::rollbacks);
+					destroyNodes(fresh, 0);
+					throw;
+				}
+				insertNodes(fresh);
+				engine.clear();
+				return;
+			}
+
+			//dla każdego cyklu engine: węzeł cyklu i cykl tego samego klucza w *this (albo nullptr)
+			typedef std::pair<node*, node*> key_plan;
+			typedef typename node_alloc_traits::template rebind_alloc<key_plan> key_plan_allocator;
+			std::vector<key_plan, key_plan_allocator> plans{key_plan_allocator(impl.allocator())};
+			plans.reserve(engine.impl.by_key.size());
+			engine.impl.by_key.for_each([&plans](node* x) { plans.emplace_back(x, nullptr); });
+			size_type new_keys = 0;
+			for (key_plan& p : plans)
+			{
+				p.second = findGroup(p.first->entry.first, p.first->hash);
+				new_keys += p.second == nullptr;
+			}
+			reserveKeys(new_keys);
+			if (linkingIsCheaper(engine.impl.elements))
+				spliceValuesEach(engine);
+			else
+				spliceValuesMerged(engine);
+
+			//od tego miejsca nic nie rzuca
+			for (const key_plan& p : plans)
+			{
+				if (p.second == nullptr)
+					impl.by_key.insert(p.first->hash, p.first);
+				else
+					std::swap(p.first->next_equal, p.second->next_equal);
+			}
+			impl.elements += engine.impl.elements;
+			engine.impl.elements = 0;
+			engine.freeIndex();
+		}
+
+	private:
+		// alokator węzłów jest klasą bazową, więc pusty alokator nie zajmuje miejsca
+		struct engine_impl : node_allocator
+		{
+			rb_tree by_value; // porządek (wartość, klucz)
+			index by_key;     // jeden węzeł każdego cyklu równych kluczy
+			size_type elements;
+
+			explicit engine_impl(const node_allocator& alloc) noexcept :
+					node_allocator(alloc), elements(0)
+			{ }
+
+			node_allocator& allocator() noexcept
+			{
+				return *this;
+			}
+
+			const node_allocator& allocator() const noexcept
+			{
+				return *this;
+			}
+		};
+
+		engine_impl impl;
+
+		// alokacja i zwolnienie pojedynczego węzła alokatorem kolejki
+		// args - argumenty konstruktora pary
+		template<typename... Args>
+		node* createNode(Args&&... args)
+		{
+			typename node_alloc_traits::pointer p = node_alloc_traits::allocate(impl.allocator(), 1);
+			count_event<stats>(&PriorityQueueStats::allocations);
+			node* n = std::addressof(*p);
+			try
+			{
+				node_alloc_traits::construct(impl.allocator(), n, std::forward<Args>(args)...);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				node_alloc_traits::deallocate(impl.allocator(), p, 1);
+				throw;
+			}
+			return n;
+		}
+
+		void destroyNode(node* n) noexcept
+		{
+			node_alloc_traits::destroy(impl.allocator(), n);
+			node_alloc_traits::deallocate(impl.allocator(),
+					std::pointer_traits<typename node_alloc_traits::pointer>::pointer_to(*n), 1);
+		}
+
+		// zwolnienie węzłów fresh[from..], puste miejsca (nullptr) są pomijane
+		void destroyNodes(const node_vector& fresh, size_type from) noexcept
+		{
+			for (size_type i = from; i < fresh.size(); ++i)
+				if (fresh[i] != nullptr)
+					destroyNode(fresh[i]);
+		}
+
+		// zwolnienie wszystkich węzłów poddrzewa drzewa po wartości, głębokość rekursji O(log n)
+		void destroySubtree(hook* h) noexcept
+		{
+			if (!h)
+				return;
+			destroySubtree(h->left);
+			destroySubtree(h->right);
+			destroyNode(node::from_value(h));
+		}
+
+		// tablice indeksu o pojemności capacity; strong guarantee
+		index_storage allocateIndex(size_type capacity)
+		{
+			control_allocator control_alloc(impl.allocator());
+			node_pointer_allocator slot_alloc(impl.allocator());
+			typename control_alloc_traits::pointer control = control_alloc_traits::allocate(control_alloc, capacity);
+			count_event<stats>(&PriorityQueueStats::allocations);
+			typename node_pointer_alloc_traits::pointer slots;
+			try
+			{
+				slots = node_pointer_alloc_traits::allocate(slot_alloc, capacity);
+				count_event<stats>(&PriorityQueueStats::allocations);
+			}
+			catch (...)
+			{
+				control_alloc_traits::deallocate(control_alloc, control, capacity);
+				throw;
+			}
+			return index_storage{std::addressof(*control), std::addressof(*slots), capacity};
+		}
+
+		void deallocateIndex(const index_storage& tables) noexcept
+		{
+			if (tables.capacity == 0)
+				return;
+			control_allocator control_alloc(impl.allocator());
+			node_pointer_allocator slot_alloc(impl.allocator());
+			control_alloc_traits::deallocate(control_alloc,
+					std::pointer_traits<typename control_alloc_traits::pointer>::pointer_to(*tables.control),
+					tables.capacity);
+			node_pointer_alloc_traits::deallocate(slot_alloc,
+					std::pointer_traits<typename node_pointer_alloc_traits::pointer>::pointer_to(*tables.slots),
+					tables.capacity);
+		}
+
+		// zwolnienie tablic indeksu (węzły zostają), no-throw
+		void freeIndex() noexcept
+		{
+			deallocateIndex(impl.by_key.arrays());
+			impl.by_key.reset();
+		}
+
+		// miejsce w indeksie na extra nowych kluczy: przy jego braku indeks jest przebudowywany
+		// (bez wywołań Hash) w tablicach dla 1,5 raza tylu kluczy, ile będzie, a zwolnione
+		// miejsca znikają; strong guarantee (rzuca tylko alokacja)
+		void reserveKeys(size_type extra)
+		{
+			if (impl.by_key.room() >= extra)
+				return;
+			size_type keys = impl.by_key.size();
+			index_storage fresh = allocateIndex(index::capacity_for(keys + extra + keys / 2));
+			impl.by_key.rehash(fresh, [](const node* x) { return x->hash; });
+			deallocateIndex(fresh);
+		}
+
+		template<typename KeyLike>
+		static size_t hashOf(const KeyLike& key)
+		{
+			return mix_hash(Hash()(key));
+		}
+
+		template<typename KeyLike>
+		static bool keyEqual(const K& a, const KeyLike& b)
+		{
+			count_event<stats>(&PriorityQueueStats::comparisons);
+			return a == b;
+		}
+
+		// węzeł cyklu par o kluczu key (o skrócie hash), nullptr gdy nie ma
+		template<typename KeyLike>
+		node* findGroup(const KeyLike& key, size_t hash) const
+		{
+			return impl.by_key.find(hash, [&key, hash](const node* x) { return x->hash == hash && keyEqual(x->entry.first, key); });
+		}
+
+		// węzeł o kluczu key i najmniejszej wartości spośród takich, nullptr gdy nie ma
+		template<typename KeyLike>
+		node* findKey(const KeyLike& key) const
+		{
+			node* group = findGroup(key, hashOf(key));
+			if (group == nullptr)
+				return nullptr;
+			node* best = group;
+			for (node* x = group->next_equal; x != group; x = x->next_equal)
+				if (by_value_order::less(x->entry.first, x->entry.second, best->entry.first, best->entry.second))
+					best = x;
+			return best;
+		}
+
+		// czy x należy do cyklu group, no-throw
+		static bool inGroup(const node* x, const node* group) noexcept
+		{
+			const node* y = group;
+			do
+			{
+				if (y == x)
+					return true;
+				y = y->next_equal;
+			}
+			while (y != group);
+			return false;
+		}
+
+		// dopięcie n (ze skrótem w n->hash) do cyklu group albo - gdy group == nullptr - jako nowego
+		// klucza do indeksu (wywołujący zarezerwował miejsce), no-throw
+		void linkKey(node* n, node* group) noexcept
+		{
+			if (group == nullptr)
+			{
+				n->next_equal = n;
+				impl.by_key.insert(n->hash, n);
+				return;
+			}
+			n->next_equal = group->next_equal;
+			group->next_equal = n;
+		}
+
+		// odpięcie n z cyklu (i z indeksu, jeśli go wskazuje), no-throw, O(liczba par o tym kluczu)
+		void unlinkKey(node* n) noexcept
+		{
+			if (n->next_equal == n)
+			{
+				impl.by_key.erase(n->hash, n);
+				return;
+			}
+			node* prev = n->next_equal;
+			while (prev->next_equal != n)
+				prev = prev->next_equal;
+			prev->next_equal = n->next_equal;
+			impl.by_key.replace(n->hash, n, n->next_equal);
+			n->next_equal = n;
+		}
+
+		rb_spot valueSpot(const key_value_pair& kv) const
+		{
+			return impl.by_value.find_spot([&kv](hook* h) { return by_value_order()(kv, node::from_value(h)->entry); });
+		}
+
+		// wpięcie gotowego węzła w drzewo i indeks
+		// strong guarantee: wyjątek ze skrótu, porównań albo powiększenia indeksu zwalnia n i nie zmienia silnika
+		node* linkNode(node* n)
+		{
+			rb_spot value_spot;
+			node* group;
+			try
+			{
+				n->hash = hashOf(n->entry.first);
+				group = findGroup(n->entry.first, n->hash);
+				value_spot = valueSpot(n->entry);
+				if (group == nullptr)
+					reserveKeys(1);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				destroyNode(n);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_value.link(value_spot, n->value_link());
+			linkKey(n, group);
+			++impl.elements;
+			return n;
+		}
+
+		// odpięcie węzła z drzewa i indeksu i jego zwolnienie, no-throw
+		void eraseNode(node* n) noexcept
+		{
+			unlinkKey(n);
+			impl.by_value.erase(n->value_link());
+			--impl.elements;
+			destroyNode(n);
+		}
+
+		// czy m pojedynczych wpięć (O(m log (n + m))) jest tańsze od zbudowania drzewa od nowa (O(n + m))
+		bool linkingIsCheaper(size_type m) const noexcept
+		{
+			size_type total = impl.elements + m;
+			size_type depth = 1;
+			while ((size_type(1) << depth) < total)
+				++depth;
+			return m * depth < impl.elements;
+		}
+
+		// wpięcie nowych węzłów fresh (kolejka przejmuje je na własność), strong guarantee:
+		// przy wyjątku wszystkie węzły fresh są zwalniane, a kolejka się nie zmienia
+		void insertNodes(const node_vector& fresh)
+		{
+			if (fresh.empty())
+				return;
+			if (linkingIsCheaper(fresh.size()))
+			{
+				linkEach(fresh);
+				return;
+			}
+
+			size_type total = impl.elements + fresh.size();
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			size_type linked = 0;
+			try
+			{
+				//sortujemy kopię - przerwane wyjątkiem sortowanie może zdublować wskaźnik
+				node_vector sorted(fresh);
+				by_value_hooks.reserve(total);
+				std::sort(sorted.begin(), sorted.end(),
+						[](const node* a, const node* b) { return by_value_order()(a->entry, b->entry); });
+				mergeSorted(sorted, by_value_hooks);
+				for (node* x : fresh)
+					x->hash = hashOf(x->entry.first);
+				reserveKeys(fresh.size());
+				//kolejne klucze mogą trafić do cykli wcześniejszych, więc dopinamy je od razu
+				for (; linked < fresh.size(); ++linked)
+					linkKey(fresh[linked], findGroup(fresh[linked]->entry.first, fresh[linked]->hash));
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				while (linked > 0)
+					unlinkKey(fresh[--linked]);
+				destroyNodes(fresh, 0);
+				throw;
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_value.assign_sorted(by_value_hooks.data(), total);
+			impl.elements = total;
+		}
+
+		// wpięcie kolejnych węzłów fresh, strong guarantee
+		// w trybie basic_guarantee wpięte węzły zostają w kolejce, a zwalniamy tylko pozostałe
+		void linkEach(const node_vector& fresh)
+		{
+			size_type i = 0;
+			try
+			{
+				for (; i < fresh.size(); ++i)
+					linkNode(fresh[i]);
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				//fresh[i] zwolnił już linkNode
+				if (!basic)
+					for (size_type j = i; j-- > 0; )
+						eraseNode(fresh[j]);
+				destroyNodes(fresh, i + 1);
+				throw;
+			}
+		}
+
+		// scalenie drzewa po wartości z posortowanymi węzłami fresh w jeden ciąg zaczepów
+		// przy równych parach stare węzły idą pierwsze; out ma zarezerwowane miejsce,
+		// więc rzuca tylko to, co porównania
+		void mergeSorted(const node_vector& fresh, hook_vector& out) const
+		{
+			hook* h = impl.by_value.first();
+			size_type i = 0;
+			while (h != nullptr || i < fresh.size())
+			{
+				if (h == nullptr || (i < fresh.size() && by_value_order()(fresh[i]->entry, node::from_value(h)->entry)))
+					out.push_back(fresh[i++]->value_link());
+				else
+				{
+					out.push_back(h);
+					h = rb_tree::next(h);
+				}
+			}
+		}
+
+		// przepięcie węzłów engine z jego drzewa po wartości do drzewa *this pojedynczo, od najmniejszej
+		// wartości; przy wyjątku cofamy przepięcia od końca (wstawiając węzły przed ich dawnych następników
+		// w engine, bez porównań); dziennik cofania nie jest potrzebny, gdy porównania K i V nie rzucają
+		// indeksy i liczniki par zmienia merge
+		void spliceValuesEach(hash_engine& engine)
+		{
+			const bool undoable = !nothrow_comparable<K, V>::value;
+			typedef std::pair<node*, hook*> undo_entry;
+			typedef typename node_alloc_traits::template rebind_alloc<undo_entry> undo_allocator;
+			std::vector<undo_entry, undo_allocator> undo{undo_allocator(impl.allocator())};
+			if (undoable)
+				undo.reserve(engine.impl.elements);
+
+			try
+			{
+				while (!engine.impl.by_value.empty())
+				{
+					node* n = node::from_value(engine.impl.by_value.first());
+					rb_spot value_spot = valueSpot(n->entry);
+					//od tego miejsca do końca obrotu pętli nic nie rzuca
+					if (undoable)
+						undo.emplace_back(n, rb_tree::next(n->value_link()));
+					engine.impl.by_value.erase(n->value_link());
+					impl.by_value.link(value_spot, n->value_link());
+				}
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				for (size_type i = undo.size(); i-- > 0; )
+				{
+					impl.by_value.erase(undo[i].first->value_link());
+					engine.impl.by_value.insert_before(undo[i].second, undo[i].first->value_link());
+				}
+				throw;
+			}
+		}
+
+		// przepięcie wszystkich węzłów engine przez scalenie drzew po wartości i zbudowanie drzewa od nowa;
+		// do końca porównań żadne drzewo nie jest zmieniane, O(n + m)
+		void spliceValuesMerged(hash_engine& engine)
+		{
+			size_type total = impl.elements + engine.impl.elements;
+			hook_vector by_value_hooks{hook_pointer_allocator(impl.allocator())};
+			by_value_hooks.reserve(total);
+			hook* x = impl.by_value.first();
+			hook* y = engine.impl.by_value.first();
+			while (x != nullptr || y != nullptr)
+			{
+				if (x == nullptr || (y != nullptr &&
+						by_value_order()(node::from_value(y)->entry, node::from_value(x)->entry)))
+				{
+					by_value_hooks.push_back(y);
+					y = rb_tree::next(y);
+				}
+				else
+				{
+					by_value_hooks.push_back(x);
+					x = rb_tree::next(x);
+				}
+			}
+			//od tego miejsca nic nie rzuca
+			impl.by_value.assign_sorted(by_value_hooks.data(), total);
+			engine.impl.by_value.reset();
+		}
+
+		// nowe miejsce węzła self po zmianie jego pary w drzewie po wartości, jak w tree_engine:
+		// stay == true, gdy węzeł może zostać, wpp. trzeba go przepiąć bezpośrednio przed before
+		// rzuca tylko to, co porównania; drzewo nie jest zmieniane
+		struct relink_position
+		{
+			bool stay;
+			hook* before;
+		};
+
+		relink_position relinkPosition(node* self, const K& key, const V& value) const
+		{
+			auto probe_less = [&](hook* h) { const key_value_pair& e = node::from_value(h)->entry;
+					return by_value_order::less(key, value, e.first, e.second); };
+			auto less_probe = [&](hook* h) { const key_value_pair& e = node::from_value(h)->entry;
+					return by_value_order::less(e.first, e.second, key, value); };
+			hook* prev = rb_tree::prev(self->value_link());
+			hook* next = rb_tree::next(self->value_link());
+			if ((prev == nullptr || !probe_less(prev)) && (next == nullptr || !less_probe(next)))
+				return relink_position{true, nullptr};
+
+			//pierwszy element większy od nowej pary, jak przy insert
+			hook* before = impl.by_value.lower_bound([&probe_less](hook* h) { return !probe_less(h); });
+			if (before == self->value_link())
+				before = next;
+			return relink_position{false, before};
+		}
+
+		// przepięcie n w drzewie po wartości w miejsce wyznaczone przez relinkPosition, no-throw
+		void applyRelink(node* n, const relink_position& position) noexcept
+		{
+			if (position.stay)
+				return;
+			impl.by_value.erase(n->value_link());
+			impl.by_value.insert_before(position.before, n->value_link());
+		}
+
+		// wywołanie assign(); w trybie basic_guarantee assign() może rzucić - węzeł z niepełnie
+		// przypisaną parą jest wtedy usuwany z kolejki (bez porównań: indeks zna jego skrót i adres)
+		template<typename Assign>
+		void assignOrErase(node* n, Assign assign)
+		{
+			if (!basic)
+			{
+				assign();
+				return;
+			}
+			try
+			{
+				assign();
+			}
+			catch (...)
+			{
+				count_event<stats>(&PriorityQueueStats::rollbacks);
+				eraseNode(n);
+				throw;
+			}
+		}
+
+		// zamiana pary w węźle n na (key, value) bez alokacji węzła: skrót, szukanie klucza, miejsce
+		// w indeksie i w drzewie, potem assign() i przepięcia; cykl i indeks zmieniamy tylko przy zmianie klucza
+		// strong guarantee (basic - patrz assignOrErase)
+		template<typename Assign>
+		void assignInPlace(node* n, const K& key, const V& value, Assign assign)
+		{
+			size_t hash = hashOf(key);
+			node* group = findGroup(key, hash);
+			bool same_key = group != nullptr && inGroup(n, group);
+			if (group == nullptr)
+				reserveKeys(1);
+			relink_position position = relinkPosition(n, key, value);
+			assignOrErase(n, assign);
+			//od tego miejsca nic nie rzuca
+			if (!same_key)
+			{
+				unlinkKey(n);
+				n->hash = hash;
+				linkKey(n, group);
+			}
+			applyRelink(n, position);
+		}
+
+		// zastąpienie pary z węzła n parą (key, value), strong guarantee
+		// bez alokacji, jeśli przypisania K i V nie rzucają (ewentualnie po skopiowaniu key i value)
+		// albo w trybie basic_guarantee; wpp. wstawiamy nową parę i usuwamy starą
+		template<typename KK, typename VV>
+		void replaceEntry(node* n, KK&& key, VV&& value)
+		{
+			if ((std::is_nothrow_copy_assignable<K>::value && std::is_nothrow_copy_assignable<V>::value) || basic)
+				assignInPlace(n, key, value, [&] { n->entry.first = key; n->entry.second = value; });
+			else if (std::is_nothrow_move_assignable<K>::value && std::is_nothrow_move_assignable<V>::value)
+			{
+				K key_copy(std::forward<KK>(key));
+				V value_copy(std::forward<VV>(value));
+				assignInPlace(n, key_copy, value_copy,
+						[&] { n->entry.first = std::move(key_copy); n->entry.second = std::move(value_copy); });
+			}
+			else
+			{
+				insert(std::forward<KK>(key), std::forward<VV>(value));
+				eraseNode(n);
+			}
+		}
+
+		// zmiana wartości istniejącego węzła: klucz się nie zmienia, więc indeks zostaje bez zmian
+		// strong guarantee; jeśli przypisanie V może rzucić, zamiast przepinania wstawiamy nowy węzeł
+		// i usuwamy stary (w trybie basic_guarantee przypisujemy w miejscu, patrz assignOrErase)
+		// zwraca węzeł, w którym jest teraz para
+		node* changeNodeValue(node* n, const V& value)
+		{
+			if (std::is_nothrow_copy_assignable<V>::value || basic)
+			{
+				relink_position position = relinkPosition(n, n->entry.first, value);
+				assignOrErase(n, [&] { n->entry.second = value; });
+				applyRelink(n, position);
+			}
+			else if (std::is_nothrow_move_assignable<V>::value)
+			{
+				V copy(value);
+				relink_position position = relinkPosition(n, n->entry.first, copy);
+				n->entry.second = std::move(copy);
+				applyRelink(n, position);
+			}
+			else
+			{
+				//wstawiamy nową parę, wyjątek w tym miejscu nie zmienia stanu kolejki
+				node* fresh = linkNode(createNode(n->entry.first, value));
+				//usuwamy starą parę (no-throw)
+				eraseNode(n);
+				return fresh;
+			}
+			return n;
+		}
+	};
+
+	// silnik współdzielący zawartość między kopiami: kopia kolejki (przy równych alokatorach) to
+	// skopiowanie wskaźnika z licznikiem referencji, O(1); kolejka, która zmienia współdzieloną
+	// zawartość, najpierw robi sobie jej prywatną kopię (Inner(silnik, alokator)), po czym deleguje do Inner
+	// każda operacja zmieniająca kolejkę może więc rzucić (kopia), a gwarancje i złożoność ma jak w Inner
+	// plus O(n) przy pierwszej zmianie po skopiowaniu; uchwytów nie ma, bo kopia zawartości
+	// unieważniłaby uchwyty jednej z kolejek
+	// kopie współdzielące zawartość można zmieniać z różnych wątków, tak jak niezależne kolejki
+	template<typename K, typename V, typename Alloc, typename Policy, typename Inner>
+	class cow_engine
+	{
+		static const bool stats = collects_stats<Policy>::value;
+
+		typedef std::pair<K, V> key_value_pair;
+		typedef std::shared_ptr<Inner> contents_pointer;
+
+	public:
+		typedef size_t size_type;
+		typedef no_handle handle;
+
+		static const bool has_handles = false;
+		static const bool has_ordered_iterators = Inner::has_ordered_iterators;
+		static const bool contiguous_key_order = Inner::contiguous_key_order;
+		static const bool parallel_bulk = false;
+
+		// iteratory wskazują na zawartość, więc (jak przy każdej zmianie) kopia przy zapisie je unieważnia
+		typedef typename Inner::key_iterator key_iterator;
+		typedef typename Inner::value_iterator value_iterator;
+
+		// kursor Inner na współdzielonej zawartości albo, gdy jej nie ma, na własnym pustym silniku
+		class key_cursor
+		{
+		public:
+			explicit key_cursor(const cow_engine& engine) :
+					none(engine.alloc), cursor(engine.shared ? *engine.shared : none)
+			{ }
+
+			bool done() const noexcept
+			{
+				return cursor.done();
+			}
+
+			const key_value_pair& get() const noexcept
+			{
+				return cursor.get();
+			}
+
+			void advance() noexcept
+			{
+				cursor.advance();
+			}
+
+		private:
+			Inner none;
+			typename Inner::key_cursor cursor;
+		};
+
+		// tablica Inner ze współdzielonej zawartości albo, gdy jej nie ma, z własnego pustego silnika
+		class key_array
+		{
+		public:
+			explicit key_array(const cow_engine& engine) :
+					none(engine.alloc), array(engine.shared ? *engine.shared : none)
+			{ }
+
+			const key_value_pair* data() const noexcept
+			{
+				return array.data();
+			}
+
+		private:
+			Inner none;
+			typename Inner::key_array array;
+		};
+
+		explicit cow_engine(const Alloc& alloc) noexcept : alloc(alloc)
+		{ }
+
+		// przy równych alokatorach kopia współdzieli zawartość, wpp. kopiujemy ją od razu
+		cow_engine(const cow_engine& engine, const Alloc& alloc) : alloc(alloc)
+		{
+			if (!engine.shared)
+				return;
+			if (alloc == engine.alloc)
+				shared = engine.shared;
+			else
+			{
+				shared = std::allocate_shared<Inner>(alloc, *engine.shared, alloc);
+				count_event<stats>(&PriorityQueueStats::allocations);
+			}
+		}
+
+		cow_engine(cow_engine&& engine) noexcept : alloc(engine.alloc), shared(std::move(engine.shared))
+		{ }
+
+		cow_engine& operator=(const cow_engine&) = delete;
+
+		Alloc getAllocator() const noexcept
+		{
+			return alloc;
+		}
+
+		void swap(cow_engine& engine, bool with_allocators) noexcept
+		{
+			shared.swap(engine.shared);
+			if (with_allocators)
+				swap_allocators(alloc, engine.alloc, propagates_allocator<Alloc>());
+		}
+
+		// zwolnienie (albo tylko odpięcie współdzielonej) zawartości, no-throw
+		void clear() noexcept
+		{
+			shared.reset();
+		}
+
+		template<typename EntryAt, typename KeyPosition>
+		void assignSorted(size_type n, EntryAt entry_at, KeyPosition key_position)
+		{
+			if (n != 0)
+				contents().assignSorted(n, entry_at, key_position);
+		}
+
+		// współdzielonej zawartości nie ruszamy - compact nie zmienia par, więc nie warto jej kopiować
+		void compact() noexcept
+		{
+			if (shared && shared.use_count() == 1)
+			{
+				std::atomic_thread_fence(std::memory_order_acquire);
+				shared->compact();
+			}
+		}
+
+		size_type size() const noexcept
+		{
+			return shared ? shared->size() : 0;
+		}
+
+		// pusta kolejka nie ma zawartości - jej zakresy to pary domyślnych (równych sobie) iteratorów
+		key_iterator keyBegin() const noexcept
+		{
+			return shared ? shared->keyBegin() : key_iterator();
+		}
+
+		key_iterator keyEnd() const noexcept
+		{
+			return shared ? shared->keyEnd() : key_iterator();
+		}
+
+		value_iterator valueBegin() const noexcept
+		{
+			return shared ? shared->valueBegin() : value_iterator();
+		}
+
+		value_iterator valueEnd() const noexcept
+		{
+			return shared ? shared->valueEnd() : value_iterator();
+		}
+
+		template<typename KeyLike>
+		key_iterator keyLowerBound(const KeyLike& key) const
+		{
+			return shared ? shared->keyLowerBound(key) : key_iterator();
+		}
+
+		value_iterator valueLowerBound(const V& value) const
+		{
+			return shared ? shared->valueLowerBound(value) : value_iterator();
+		}
+
+		template<typename... Args>
+		handle emplace(Args&&... args)
+		{
+			contents().emplace(std::forward<Args>(args)...);
+			return handle();
+		}
+
+		template<typename KK, typename VV>
+		handle insert(KK&& key, VV&& value)
+		{
+			contents().insert(std::forward<KK>(key), std::forward<VV>(value));
+			return handle();
+		}
+
+		template<typename InputIt>
+		void insertRange(InputIt first, InputIt last)
+		{
+			if (first != last)
+				contents().insertRange(first, last);
+		}
+
+		template<typename KK, typename VV>
+		void replaceMin(KK&& key, VV&& value)
+		{
+			contents().replaceMin(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		template<typename KK, typename VV>
+		void replaceMax(KK&& key, VV&& value)
+		{
+			contents().replaceMax(std::forward<KK>(key), std::forward<VV>(value));
+		}
+
+		const key_value_pair& minEntry() const noexcept
+		{
+			return shared->minEntry();
+		}
+
+		// noexcept wtedy, gdy maxEntry Inner jest (silniki kopcowy, parujący i kubełkowy porównują pary)
+		const key_value_pair& maxEntry() const noexcept(noexcept(std::declval<const Inner&>().maxEntry()))
+		{
+			return shared->maxEntry();
+		}
+
+		void deleteMin()
+		{
+			contents().deleteMin();
+		}
+
+		void deleteMax()
+		{
+			contents().deleteMax();
+		}
+
+		template<typename OutputIt>
+		OutputIt popMinN(size_type n, OutputIt out)
+		{
+			if (n == 0 || size() == 0)
+				return out;
+			return contents().popMinN(n, out);
+		}
+
+		// najpierw szukamy klucza, żeby nie kopiować zawartości, gdy go nie ma
+		template<typename KeyLike>
+		bool changeValue(const KeyLike& key, const V& value)
+		{
+			if (!contains(key))
+				return false;
+			return contents().changeValue(key, value);
+		}
+
+		template<typename KeyLike>
+		bool contains(const KeyLike& key) const
+		{
+			return shared && shared->contains(key);
+		}
+
+		// współdzielona zawartość engine jest kopiowana, jak przy każdej zmianie engine
+		void merge(cow_engine& engine)
+		{
+			if (engine.size() == 0)
+				return;
+			if (size() == 0 && alloc == engine.alloc)
+			{
+				shared.swap(engine.shared);
+				return;
+			}
+			contents().merge(engine.contents());
+		}
+
+	private:
+		Alloc alloc;
+		contents_pointer shared;
+
+		// zawartość do zmiany, tylko dla tej kolejki; kopiowana, jeśli współdzieli ją inna kolejka
+		// strong guarantee
+		Inner& contents()
+		{
+			if (!shared)
+			{
+				shared = std::allocate_shared<Inner>(alloc, alloc);
+				count_event<stats>(&PriorityQueueStats::allocations);
+			}
+			else if (shared.use_count() != 1)
+			{
+				shared = std::allocate_shared<Inner>(alloc, *shared, alloc);
+				count_event<stats>(&PriorityQueueStats::allocations);
+			}
+			else
+			{
+				//ostatnia inna kopia mogła zwolnić zawartość w innym wątku; jej zmiany
+				//(zakończone przed zmniejszeniem licznika) muszą być widoczne przed naszymi
+				std::atomic_thread_fence(std::memory_order_acquire);
+			}
+			return *shared;
+		}
+	};
+
+}
+
+
+// Silniki kolejki, wybierane przez Policy::engine
+
+// dwa drzewa czerwono-czarne (po kluczu i po wartości) na wspólnych węzłach; pełny interfejs,
+// łącznie z uchwytami
+struct PriorityQueueTreeEngine
+{
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::tree_engine<K, V, Alloc, Policy>;
+};
+
+// d-arny kopiec min-max w jednej tablicy; dla kolejek, które używają tylko insert i operacji
+// na minimum/maksimum - changeValue jest liniowe, a uchwytów nie ma
+// wymaga no-throw przenoszenia K i V
+template<unsigned D = 2>
+struct PriorityQueueHeapEngine
+{
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::heap_engine<K, V, Alloc, Policy, D>;
+};
+
+// kopiec parujący z osobnym drzewem po kluczu; dla algorytmów grafowych (Dijkstra, Prim):
+// insert, merge i zmniejszenie wartości (changeValue, najlepiej przez uchwyt) kosztują w kopcu O(1),
+// deleteMin - O(log n) zamortyzowane, a operacje na maksimum są liniowe; bez count_duplicates i lazy_deletion
+struct PriorityQueuePairingEngine
+{
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::pairing_engine<K, V, Alloc, Policy>;
+};
+
+// indeks haszujący po kluczu (adresowanie otwarte, jak Swiss table) zamiast drzewa po kluczu, obok drzewa
+// po wartości; dla kolejek, które szukają po kluczu (changeValue, contains - oczekiwane O(1)), ale nie
+// przechodzą ich w porządku kluczy: operatory porównania, save i serialize sortują pary na żądanie,
+// a iteratorów nie ma; bez count_duplicates i lazy_deletion
+// Hash - skrót klucza (domyślnie std::hash<K>), zgodny z == kluczy i tworzony domyślnym konstruktorem
+template<typename Hash = void>
+struct PriorityQueueHashEngine
+{
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::hash_engine<K, V, Alloc, Policy,
+			typename std::conditional<std::is_void<Hash>::value, std::hash<K>, Hash>::type>;
+};
 
-struct PriorityQueueEmptyException : public std::exception
+// kubełki pozycyjne (radix heap) z osobnym drzewem po kluczu; dla całkowitych wartości bez znaku
+// (do 64 bitów) w kolejkach monotonicznych - znaczniki czasu, odległości w algorytmie Dijkstry:
+// insert i zmiana wartości kosztują w porządku po wartości O(1), deleteMin - O(B) zamortyzowane
+// (B - liczba bitów V), kolejne pary są w pamięci sąsiednimi węzłami list, a operacje na maksimum
+// przeglądają najstarszy kubełek; wymaga polityki z monotone (patrz PriorityQueueMonotonePolicy),
+// bez count_duplicates i lazy_deletion
+struct PriorityQueueRadixEngine
 {
-	virtual const char* what() const throw()
-	{
-		return "Invalid operation on empty queue";
-	}
-} PQEmptyEx;
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::radix_engine<K, V, Alloc, Policy>;
+};
 
+// kopiowanie przy zapisie: kopie kolejki współdzielą zawartość silnika Inner (kopia kolejki w O(1)),
+// a zmieniana kolejka kopiuje ją dopiero przy pierwszej zmianie; bez uchwytów
+template<typename Inner = PriorityQueueTreeEngine>
+struct PriorityQueueCopyOnWriteEngine
+{
+	template<typename K, typename V, typename Alloc, typename Policy>
+	using type = pq_detail::cow_engine<K, V, Alloc, Policy, typename Inner::template type<K, V, Alloc, Policy>>;
+};
 
-template<typename K, typename V>
-class PriorityQueue
+// Polityka kolejki: własne polityki najprościej tworzyć, dziedzicząc po tej i nadpisując wybrane składowe
+// polityka z typedef void is_transparent; (jak std::less<>) włącza szukanie po kluczu
+// (changeValue, contains) argumentem dowolnego typu porównywalnego z K, bez konstruowania K
+// polityka ze static const bool count_duplicates = true; (tylko silnik drzewiasty) przechowuje równe pary
+// (klucz, wartość) jako jedną pozycję z licznikiem kopii: size(), deleteMin, deleteMax, merge i operatory
+// porównania działają jak bez niej, a uchwyt wskazuje wszystkie kopie pary (erase usuwa jedną z nich)
+// polityka ze static const bool lazy_deletion = true; (tylko silnik drzewiasty) przyspiesza deleteMin, deleteMax
+// i popMinN: para jest od razu wypinana tylko z porządku po wartości, a jej węzeł zwalniany później, partiami
+// (patrz compact()); uchwyty usuniętych par tracą ważność od razu, jak bez tej polityki
+// polityka ze static const bool basic_guarantee = true; zamienia strong guarantee na basic guarantee
+// (po wyjątku kolejki są poprawne i nic nie wycieka, ale mogą być częściowo zmienione) tam, gdzie strong
+// guarantee wymaga kopii albo dziennika cofania: merge (każda para jest wtedy w dokładnie jednej z kolejek),
+// insert(first, last) i insertBatch (część par jest już wstawiona), changeValue i insertKeeping*
+// (przypisanie w miejscu; jeśli przypisanie K lub V rzuci, zmieniana para znika z kolejki);
+// gdy porównania K i V nie rzucają, także bez tej polityki merge i insert(first, last) nie prowadzą
+// dziennika cofania, a silnik kopcowy scala tablice w miejscu
+// polityka ze static const bool collect_stats = true; włącza liczniki porównań, alokacji, wycofań
+// i czasu operacji (PriorityQueue::stats()); bez niej liczniki nie kosztują nic, także pamięci
+// polityka ze static const bool monotone = true; deklaruje kolejkę monotoniczną: wartości wstawiane
+// i nadawane (insert, changeValue, merge, replaceMin) nie są mniejsze od ostatnio usuniętego minimum
+// (deleteMin, popMinN, replaceMin); wymaga jej PriorityQueueRadixEngine, który bez NDEBUG sprawdza to
+// asercją, a z NDEBUG obsługuje mniejsze wartości poprawnie, tylko wolniej; minValue, deleteMin
+// i pozostałe operacje działają jak bez niej
+// polityka z typedef ... key_compare; (typedef ... value_compare;) porównuje klucze (wartości) jednym
+// wywołaniem trójwartościowym: C()(a, b) < 0, == 0, > 0 zgodnie z < i == typu K (V); C jest konstruowany
+// domyślnie przy każdym porównaniu i musi być noexcept, jeśli < i == typu są noexcept albo typ ich nie ma;
+// dotyczy wszystkich silników i ConcurrentPriorityQueue, ShardedPriorityQueue; typ bez < i == wystarcza
+// do wstawiania i operacji na minimum i maksimum, ale szukanie po kluczu i operatory porównania kolejek
+// nadal ich wymagają
+// polityka z typedef ... key_prefix; (tylko silnik drzewiasty) zapamiętuje w węźle prefiks klucza
+// P()(key) typu arytmetycznego, zgodny z porządkiem kluczy (a < b => P()(a) <= P()(b), a == b =>
+// P()(a) == P()(b)), i porównuje klucze tylko przy równych prefiksach; P()(key) musi być noexcept,
+// a porównania prefiksów nie są liczone w stats().comparisons
+struct PriorityQueueDefaultPolicy
 {
-	static_assert(std::is_nothrow_destructible<K>::value, "Key type must be no-throw destructible!");
-	static_assert(std::is_nothrow_destructible<V>::value, "Value type must be no-throw destructible!");
+	typedef PriorityQueueTreeEngine engine;
+};
 
-private: // comparators
+// polityka kolejki monotonicznej na kubełkach pozycyjnych (V - całkowity typ bez znaku)
+struct PriorityQueueMonotonePolicy : PriorityQueueDefaultPolicy
+{
+	typedef PriorityQueueRadixEngine engine;
+	static const bool monotone = true;
+};
 
-	typedef std::pair<std::shared_ptr<K>, std::shared_ptr<V>> key_value_pair;
+// Wybór wykonania na wielu wątkach (w miejsce std::execution::par z C++17) dla konstruktora z zakresu,
+// konstruktora kopiującego, insert(first, last) i merge: PriorityQueueParallel() - na tylu wątkach,
+// ile jest wątków sprzętowych, PriorityQueueParallel(t) - na najwyżej t wątkach
+// każdy wątek dostaje co najmniej 2^14 par, więc małe kolejki są obsługiwane sekwencyjnie; równolegle
+// działa silnik drzewiasty, a pozostałe wykonują te operacje tak, jak bez PriorityQueueParallel
+// na wielu wątkach naraz wywoływane są porównania K i V, ich konstruktory kopiujące i construct alokatora
+// (na różnych obiektach); alokacja i zwalnianie pamięci zostają na wątku wywołującym
+struct PriorityQueueParallel
+{
+	unsigned threads;
 
-	// po kluczu
-	struct CompByFst
-	{
-		bool operator()(const key_value_pair& a, const key_value_pair& b)
-		{
-			if (!(*a.first == *b.first))
-				return *a.first < *b.first;
-			return *a.second < *b.second;
-		}
-	};
+	explicit PriorityQueueParallel(unsigned threads = 0) noexcept : threads(threads)
+	{ }
+};
 
-	// po wartości
-	struct CompBySnd
-	{
-		bool operator()(const key_value_pair& a, const key_value_pair& b)
-		{
-			if (!(*a.second == *b.second))
-				return *a.second < *b.second;
-			return *a.first < *b.first;
-		}
-	};
+
+// Alloc - alokator, z którego kolejka bierze pamięć na pary i na bufory pomocnicze;
+// wystarczy, że spełnia wymagania Allocator z biblioteki standardowej
+// Policy - wybór silnika przechowującego pary, patrz PriorityQueueDefaultPolicy
+template<typename K, typename V, typename Alloc = std::allocator<std::pair<K, V>>,
+		typename Policy = PriorityQueueDefaultPolicy>
+class PriorityQueue : private pq_detail::stats_holder<pq_detail::collects_stats<Policy>::value>
+{
+	static_assert(std::is_nothrow_destructible<K>::value, "Key type must be no-throw destructible!");
+	static_assert(std::is_nothrow_destructible<V>::value, "Value type must be no-throw destructible!");
+
+	typedef typename Policy::engine::template type<K, V, Alloc, Policy> engine_type;
+	typedef std::allocator_traits<Alloc> alloc_traits;
+	typedef typename pq_detail::stats_holder<pq_detail::collects_stats<Policy>::value>::scope stats_scope;
+	typedef pq_detail::CompBySnd<K, V, pq_detail::collects_stats<Policy>::value, Policy> by_value_order;
+
+	// std::vector<PriorityQueue> przenosi elementy przy realokacji tylko wtedy, gdy przeniesienie nie rzuca;
+	// pusty silnik (także ten, z którego przeniesiono zawartość) nie może więc niczego alokować
+	static_assert(std::is_nothrow_move_constructible<engine_type>::value,
+			"Queue engine must be no-throw move constructible!");
 
 public: // public typedefs
 
 	typedef size_t size_type;
 	typedef K key_type;
 	typedef V value_type;
+	typedef Alloc allocator_type;
+	typedef Policy policy_type;
+
+	// Uchwyt do pary przechowywanej w kolejce, zwracany przez insert
+	// pozwala usunąć lub zmienić parę bez szukania jej po kluczu
+	// uchwyt jest ważny, dopóki para jest w kolejce; swap i merge (przy równych alokatorach) przenoszą
+	// uchwyty razem z zawartością, a przypisanie i changeValue po kluczu mogą je unieważnić
+	// silniki bez uchwytów (engine_type::has_handles == false) zwracają z insert pusty obiekt
+	typedef typename engine_type::handle handle;
+
+	// Iteratory dwukierunkowe, tylko do odczytu, po parach w porządku (klucz, wartość) i (wartość, klucz),
+	// bez kopiowania kolejki; każda zmiana kolejki je unieważnia
+	// dostępne w silnikach z engine_type::has_ordered_iterators (drzewiastym i kopiującym go przy zapisie)
+	typedef typename engine_type::key_iterator key_iterator;
+	typedef typename engine_type::value_iterator value_iterator;
+	typedef pq_detail::range_view<key_iterator> key_range;
+	typedef pq_detail::range_view<value_iterator> value_range;
 
 private: // members and helpers
 
+	engine_type impl;
+
+	typedef typename alloc_traits::template rebind_alloc<const std::pair<K, V>*> pointer_allocator;
+	typedef std::vector<const std::pair<K, V>*, pointer_allocator> pointer_vector;
+	typedef typename alloc_traits::template rebind_alloc<std::uint64_t> index_allocator;
+	typedef std::vector<std::uint64_t, index_allocator> index_vector;
+
 	// czyszczenie kolejki, no throw
 	void clear() noexcept
 	{
-		PriorityQueue<K, V> tmp;
-		swap(tmp);
+		impl.clear();
+	}
+
+	// oba porządki par do zapisu (save, serialize): by_key - wskaźniki par w porządku (klucz, wartość),
+	// by_value - numery (w porządku po kluczu) kolejnych par w porządku (wartość, klucz)
+	void bothOrders(pointer_vector& by_key, index_vector& by_value) const
+	{
+		by_key.reserve(size());
+		for (typename engine_type::key_cursor it(impl); !it.done(); it.advance())
+			by_key.push_back(&it.get());
+		by_value.reserve(size());
+		valueOrder(by_key, by_value, std::integral_constant<bool, engine_type::has_ordered_iterators>());
+	}
+
+	// operacje PriorityQueueParallel: w silnikach z engine_type::parallel_bulk - na threads wątkach,
+	// wpp. sekwencyjne
+	typedef std::integral_constant<bool, engine_type::parallel_bulk> parallel_bulk;
+
+	static engine_type copyEngine(const engine_type& engine, const Alloc& alloc, unsigned threads, std::true_type)
+	{
+		return engine_type(engine, alloc, threads);
+	}
+
+	static engine_type copyEngine(const engine_type& engine, const Alloc& alloc, unsigned, std::false_type)
+	{
+		return engine_type(engine, alloc);
+	}
+
+	template<typename InputIt>
+	void insertRange(InputIt first, InputIt last, unsigned threads, std::true_type)
+	{
+		impl.insertRange(first, last, threads);
+	}
+
+	template<typename InputIt>
+	void insertRange(InputIt first, InputIt last, unsigned, std::false_type)
+	{
+		impl.insertRange(first, last);
+	}
+
+	void mergeEngine(engine_type& engine, unsigned threads, std::true_type)
+	{
+		impl.merge(engine, threads);
 	}
 
-	// kolejka jest w stanie invalid, kiedy była ofiarą move ctor-a
-	bool isValid() const
+	void mergeEngine(engine_type& engine, unsigned, std::false_type)
 	{
-		return pairs_by_K != nullptr && pairs_by_V != nullptr;
+		impl.merge(engine);
 	}
 
-	typedef std::multiset<key_value_pair, CompByFst> pairs_by_key_set;
-	typedef std::multiset<key_value_pair, CompBySnd> pairs_by_value_set;
+	// silnik z porządkiem po wartości: pary z obu porządków sortujemy po adresie (bez porównań K i V)
+	// i zestawiamy; kopie równej pary w trybie count_duplicates mają jeden adres, a ich numery
+	// w obu porządkach są kolejne, więc zestawiamy je według numerów, O(n log n)
+	void valueOrder(const pointer_vector& by_key, index_vector& by_value, std::true_type) const
+	{
+		typedef std::pair<const std::pair<K, V>*, std::uint64_t> located;
+		typedef typename alloc_traits::template rebind_alloc<located> located_allocator;
+		typedef std::vector<located, located_allocator> located_vector;
+		std::less<const std::pair<K, V>*> address_less;
+		auto by_address = [&address_less](const located& a, const located& b)
+				{ return address_less(a.first, b.first) || (a.first == b.first && a.second < b.second); };
+
+		located_vector key_side{located_allocator(get_allocator())};
+		key_side.reserve(by_key.size());
+		for (std::size_t i = 0; i < by_key.size(); ++i)
+			key_side.emplace_back(by_key[i], i);
+		located_vector value_side{located_allocator(get_allocator())};
+		value_side.reserve(by_key.size());
+		for (const std::pair<K, V>& kv : byValue())
+			value_side.emplace_back(&kv, value_side.size());
+		std::sort(key_side.begin(), key_side.end(), by_address);
+		std::sort(value_side.begin(), value_side.end(), by_address);
 
-	// kontenery uporządkowane po kluczu i po wartości
-	std::unique_ptr<pairs_by_key_set> pairs_by_K;
-	std::unique_ptr<pairs_by_value_set> pairs_by_V;
-	
-	// zmienne pomocnicze dla operacji changeValue
-	typename pairs_by_key_set::iterator inserted_K;
-	typename pairs_by_value_set::iterator inserted_V;
+		by_value.resize(by_key.size());
+		for (std::size_t i = 0; i < key_side.size(); ++i)
+			by_value[static_cast<std::size_t>(value_side[i].second)] = key_side[i].second;
+	}
+
+	// wpp. stabilne sortowanie numerów par, O(n log n) porównań
+	void valueOrder(const pointer_vector& by_key, index_vector& by_value, std::false_type) const
+	{
+		for (std::size_t i = 0; i < by_key.size(); ++i)
+			by_value.push_back(i);
+		std::stable_sort(by_value.begin(), by_value.end(), [&by_key](std::uint64_t a, std::uint64_t b)
+				{ return pq_detail::CompBySnd<K, V, false, Policy>()(*by_key[a], *by_key[b]); });
+	}
 
 public: // interface
 
 
 	// Konstruktor bezparametrowy tworzący pustą kolejkę
-	// zlozonosc: O(1)
-	PriorityQueue() :
-			pairs_by_K(new std::multiset<key_value_pair, CompByFst>()),
-			pairs_by_V(new std::multiset<key_value_pair, CompBySnd>())
+	// nothrow, zlozonosc: O(1)
+	PriorityQueue() noexcept(noexcept(Alloc())) : impl(Alloc())
+	{ }
+
+	// Konstruktor tworzący pustą kolejkę, która będzie alokować pamięć z alloc
+	// nothrow, zlozonosc: O(1)
+	explicit PriorityQueue(const Alloc& alloc) noexcept : impl(alloc)
 	{ }
 
+	// Konstruktor tworzący kolejkę z par (klucz, wartość) z zakresu [first, last)
+	// pary są sortowane raz w każdym z porządków, a drzewa budowane od razu zrównoważone
+	// strong guarantee, zlozonosc: O(n log n) porównań, n = std::distance(first, last)
+	template<typename InputIt, typename = pq_detail::pair_iterator_check<InputIt>>
+	PriorityQueue(InputIt first, InputIt last, const Alloc& alloc = Alloc()) : impl(alloc)
+	{
+		impl.insertRange(first, last);
+	}
+
+	// Konstruktor z zakresu na wielu wątkach (PriorityQueueParallel): pary są kopiowane na wątku
+	// wywołującym, a sortowanie i scalanie w obu porządkach dzielone między wątki
+	// strong guarantee, zlozonosc: O(n log n / t + n) porównań na wątek, t - liczba wątków
+	template<typename InputIt, typename = pq_detail::pair_iterator_check<InputIt>>
+	PriorityQueue(PriorityQueueParallel parallel, InputIt first, InputIt last, const Alloc& alloc = Alloc()) :
+			impl(alloc)
+	{
+		insertRange(first, last, parallel.threads, parallel_bulk());
+	}
+
 	// Konstruktor kopiujący
-	// zlozonosc: O(queue.size())
-	PriorityQueue(const PriorityQueue<K, V>& queue) :
-			pairs_by_K(new std::multiset<key_value_pair, CompByFst>(*queue.pairs_by_K)),
-			pairs_by_V(new std::multiset<key_value_pair, CompBySnd>(*queue.pairs_by_V))
+	// zlozonosc: O(queue.size() * log queue.size()) operacji na wskaźnikach, bez porównań K i V
+	// (PriorityQueueCopyOnWriteEngine przy równych alokatorach: O(1), kopia dopiero przy pierwszej zmianie)
+	PriorityQueue(const PriorityQueue& queue) :
+			PriorityQueue(queue, alloc_traits::select_on_container_copy_construction(queue.get_allocator()))
+	{ }
+
+	// Konstruktor kopiujący z podanym alokatorem
+	PriorityQueue(const PriorityQueue& queue, const Alloc& alloc) : impl(queue.impl, alloc)
+	{ }
+
+	// Konstruktory kopiujące na wielu wątkach (PriorityQueueParallel): pary są kopiowane kawałkami
+	// na wszystkich wątkach, a oba porządki odtwarzane równolegle
+	// zlozonosc: O(queue.size() * log queue.size() / t + queue.size()) operacji na wskaźnikach
+	PriorityQueue(PriorityQueueParallel parallel, const PriorityQueue& queue) :
+			PriorityQueue(parallel, queue,
+					alloc_traits::select_on_container_copy_construction(queue.get_allocator()))
+	{ }
+
+	PriorityQueue(PriorityQueueParallel parallel, const PriorityQueue& queue, const Alloc& alloc) :
+			impl(copyEngine(queue.impl, alloc, parallel.threads, parallel_bulk()))
 	{ }
 
 	// Konstruktor przenoszący
-	// nothrow, zlozonosc: O(queue.size())
-	PriorityQueue(PriorityQueue<K, V>&& queue) noexcept
+	// nothrow, zlozonosc: O(1)
+	// queue zostaje pustą, poprawną kolejką
+	PriorityQueue(PriorityQueue&& queue) noexcept : impl(std::move(queue.impl))
+	{ }
+
+	// strong guarantee, zlozonosc: O(queue.size()) (jak konstruktor kopiujący), copy-and-swap idiom
+	// alokator przechodzi z queue tylko, jeśli pozwala na to propagate_on_container_copy_assignment
+	PriorityQueue& operator=(const PriorityQueue& queue)
 	{
-		*this = std::move(queue);
-		//patrz komentarz w move=, queue moze byc popsute
+		if(this != &queue)
+		{
+			PriorityQueue temp(queue, alloc_traits::propagate_on_container_copy_assignment::value ?
+					queue.get_allocator() : get_allocator());
+			impl.swap(temp.impl, true);
+		}
+		return *this;
 	}
 
-	// strong guarantee, zlozonosc: O(queue.size()), copy-and-swap idiom
-	PriorityQueue<K, V>& operator=(const PriorityQueue<K, V>& queue)
+	// nothrow (dla alokatorów propagowanych przy przeniesieniu lub zawsze równych), zlozonosc: O(1)
+	// plus zwolnienie dotychczasowych elementów *this; queue zostaje pustą, poprawną kolejką
+	// przy różnych, niepropagowanych alokatorach elementy są kopiowane do pamięci z alokatora *this,
+	// O(queue.size()) jak konstruktor kopiujący
+	PriorityQueue& operator=(PriorityQueue&& queue)
+			noexcept(alloc_traits::propagate_on_container_move_assignment::value ||
+					alloc_traits::is_always_equal::value)
 	{
-		if(this != &queue)
+		if (this != &queue)
 		{
-			PriorityQueue<K, V> temp(queue);
-			swap(temp);
+			if (alloc_traits::propagate_on_container_move_assignment::value ||
+					get_allocator() == queue.get_allocator())
+			{
+				PriorityQueue temp(std::move(queue));
+				impl.swap(temp.impl, true);
+			}
+			else
+			{
+				PriorityQueue temp(queue, get_allocator());
+				impl.swap(temp.impl, true);
+				queue.clear();
+			}
 		}
 		return *this;
 	}
 
+	// Metoda zwracająca kopię alokatora kolejki
 	// nothrow, zlozonosc: O(1)
-	PriorityQueue<K, V>& operator=(PriorityQueue<K, V>&& queue) noexcept
+	allocator_type get_allocator() const noexcept
 	{
-		pairs_by_K = std::move(queue.pairs_by_K);
-		pairs_by_V = std::move(queue.pairs_by_V);
-
-		//po wykonaniu move w queue sa pointer'y, ktore sa == nullptr
-		//zatem queue jest w dosc paskudnym stanie, dlatego przy wywolaniu metody odwolujacej sie do pol obiektu
-		//nalezy brac pod uwage mozliwosc, ze ta kolejka jest w stanie niepoprawnym
-		return *this;
+		return impl.getAllocator();
 	}
 
 
@@ -144,10 +8425,7 @@ public: // interface
 	// zlozonosc: O(1)
 	size_type size() const noexcept
 	{
-		if (!isValid())
-			return 0;
-		assert(pairs_by_K->size() == pairs_by_V->size());
-		return pairs_by_K->size();
+		return impl.size();
 	}
 
 	// Metoda zwracająca true wtedy i tylko wtedy, gdy kolejka jest pusta
@@ -158,64 +8436,164 @@ public: // interface
 	}
 
 	// Metoda wstawiająca do kolejki parę o kluczu key i wartości value
+	// zwraca uchwyt do wstawionej pary
 	// strong guarentee, zlozonosc: O(log size())
-	void insert(const K& key, const V& value)
+	handle insert(const K& key, const V& value)
 	{
-		//kopia argumentow insert'a
-		auto to_find = std::make_pair(std::make_shared<K>(key), std::make_shared<V>(value));
-		auto pair_iterator = pairs_by_K->find(to_find); //iterator do istniejacej juz pary == to_find
-		
-		if (pair_iterator != pairs_by_K->end()) //to_find jest juz w multisecie
-		{
-			//wkladamy kopie pary shared_ptr'ów bedacych juz w multisecie
-			inserted_K = pairs_by_K->insert(*pair_iterator); //wyjatek w tym miejscu nie zmienia stanu kolejki
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		return impl.insert(key, value);
+	}
 
-			try
-			{
-				inserted_V = pairs_by_V->insert(*pair_iterator);
-			}
-			catch(...)
-			{
-				//w razie niepowodzenia przy 2. insertcie, usuwamy 1. element
-				//erase jest no-throw
-				pairs_by_K->erase(inserted_K); 
-				throw;
-			}
+	// Metoda wstawiająca do kolejki parę, przenosząc do niej key i value zamiast je kopiować
+	// strong guarentee (przy wyjątku key i value mogą już być przeniesione), zlozonosc: O(log size())
+	handle insert(K&& key, V&& value)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		return impl.insert(std::move(key), std::move(value));
+	}
+
+	// Metoda wstawiająca do kolejki parę skonstruowaną w miejscu z args, tak jak std::pair<K, V>(args...)
+	// (np. emplace(key, value) albo emplace(std::piecewise_construct, key_args, value_args))
+	// zwraca uchwyt do wstawionej pary
+	// strong guarentee, zlozonosc: O(log size())
+	template<typename... Args>
+	handle emplace(Args&&... args)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		return impl.emplace(std::forward<Args>(args)...);
+	}
 
+	// Metody wstawiające parę do kolejki ograniczonej do capacity par (np. k najlepszych wyników):
+	// gdy kolejka jest pełna (size() == capacity), insertKeepingSmallest usuwa parę o największej wartości,
+	// a insertKeepingLargest - o najmniejszej, tak jak insert i następujące po nim deleteMax (deleteMin);
+	// jeśli usunięta byłaby właśnie nowa para, kolejka się nie zmienia
+	// wymaga size() <= capacity (sprawdzane asercją): kolejki większej niż capacity (np. wypełnionej
+	// przez insert) metody nie przycinają - trzeba najpierw usunąć nadmiarowe pary przez deleteMax (deleteMin)
+	// nowa para zastępuje usuwaną w tym samym miejscu: w silniku drzewiastym bez alokacji węzła
+	// (o ile przypisania K i V nie rzucają), w kopcowym bez przesuwania tablicy
+	// zwraca, czy para trafiła do kolejki
+	// strong guarantee (basic przy basic_guarantee)
+	// zlozonosc: O(log size()) w silnikach drzewiastym i haszującym, O(D^2 log_D size()) w kopcowym;
+	// w parującym insertKeepingLargest - O(log size()) zamortyzowane, insertKeepingSmallest - O(size());
+	// w kubełkowym insertKeepingLargest - O(log size()) zamortyzowane, insertKeepingSmallest - O(r), r - długość
+	// najstarszej niepustej listy; z kopiowaniem przy zapisie jak w silniku Inner, plus kopia
+	// współdzielonej zawartości
+	bool insertKeepingSmallest(const K& key, const V& value, size_type capacity)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		assert(size() <= capacity);
+		if (size() < capacity)
+		{
+			impl.insert(key, value);
+			return true;
 		}
-		else //nie ma w secie
+		if (capacity == 0)
+			return false;
+		const std::pair<K, V>& max = impl.maxEntry();
+		if (!by_value_order::less(key, value, max.first, max.second))
+			return false;
+		impl.replaceMax(key, value);
+		return true;
+	}
+
+	bool insertKeepingLargest(const K& key, const V& value, size_type capacity)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		assert(size() <= capacity);
+		if (size() < capacity)
 		{
-			//wstawiamy nową parę shared_ptr'ów
-			inserted_K = pairs_by_K->insert(to_find);
-			try
-			{
-				inserted_V = pairs_by_V->insert(to_find);
-			}
-			catch(...)
-			{
-				//w razie niepowodzenia usuwamy 1. element
-				pairs_by_K->erase(inserted_K); 
-				throw;
-			}
+			impl.insert(key, value);
+			return true;
 		}
+		if (capacity == 0)
+			return false;
+		const std::pair<K, V>& min = impl.minEntry();
+		if (!by_value_order::less(min.first, min.second, key, value))
+			return false;
+		impl.replaceMin(key, value);
+		return true;
+	}
+
+	// Metoda wstawiająca do kolejki wszystkie pary (klucz, wartość) z zakresu [first, last)
+	// silnik drzewiasty: duże partie są sortowane raz i scalane z kolejką, a drzewa budowane od nowa,
+	// O(min(m log (size() + m), size() + m log m)); silnik kopcowy: O(size() + m)
+	// strong guarantee (basic przy basic_guarantee), m = std::distance(first, last)
+	template<typename InputIt, typename = pq_detail::pair_iterator_check<InputIt>>
+	void insert(InputIt first, InputIt last)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		impl.insertRange(first, last);
+	}
+
+	// insert(first, last) na wielu wątkach (PriorityQueueParallel): duża partia jest sortowana i scalana
+	// z kolejką w obu porządkach równolegle
+	// strong guarantee
+	template<typename InputIt, typename = pq_detail::pair_iterator_check<InputIt>>
+	void insert(PriorityQueueParallel parallel, InputIt first, InputIt last)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		insertRange(first, last, parallel.threads, parallel_bulk());
+	}
+
+	// Metoda wstawiająca do kolejki wszystkie pary (klucz, wartość) z pairs
+	// (np. std::vector, tablicy albo std::span par), jak insert(first, last): jeden punkt kontrolny
+	// wyjątków dla całej partii
+	// strong guarantee (basic przy basic_guarantee)
+	template<typename Range>
+	void insertBatch(const Range& pairs)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::insert);
+		using std::begin;
+		using std::end;
+		impl.insertRange(begin(pairs), end(pairs));
+	}
+
+	// Metoda zwracająca klucz pary wskazywanej przez uchwyt
+	// nothrow, zlozonosc: O(1)
+	const K& key(handle h) const noexcept
+	{
+		static_assert(engine_type::has_handles, "This engine doesn't support handles!");
+		assert(h);
+		return impl.entry(h).first;
+	}
+
+	// Metoda zwracająca wartość pary wskazywanej przez uchwyt
+	// nothrow, zlozonosc: O(1)
+	const V& value(handle h) const noexcept
+	{
+		static_assert(engine_type::has_handles, "This engine doesn't support handles!");
+		assert(h);
+		return impl.entry(h).second;
+	}
+
+	// Metoda usuwająca z kolejki parę wskazywaną przez uchwyt (przy count_duplicates - jedną jej kopię)
+	// nothrow (w silniku parującym strong guarantee, gdy porównania K i V mogą rzucić),
+	// zlozonosc: O(log size()) (w silniku parującym zamortyzowana)
+	void erase(handle h) noexcept(noexcept(std::declval<engine_type&>().erase(h)))
+	{
+		stats_scope scope(*this, &PriorityQueueStats::remove);
+		static_assert(engine_type::has_handles, "This engine doesn't support handles!");
+		assert(h);
+		impl.erase(h);
 	}
 
 	// Metoda zwracajaca najmniejsza wartosc w kolejce
 	// strong guarantee, zlozonosc: O(1)
 	const V& minValue() const
-	{		
+	{
 		if (empty())
 			throw PQEmptyEx;
-		return *(pairs_by_V->begin()->second);
+		return impl.minEntry().second;
 	}
 
 	// Metoda zwracajaca najwieksza wartosc w kolejce
-	// strong guarantee, zlozonosc: O(1)
+	// strong guarantee, zlozonosc: O(1); w silniku kopcowym O(D), w parującym O(size()), w kubełkowym O(r),
+	// r - długość najstarszej niepustej listy (te silniki szukają maksimum, porównując pary)
 	const V& maxValue() const
 	{
 		if (empty())
 			throw PQEmptyEx;
-		return *(pairs_by_V->rbegin()->second);
+		return impl.maxEntry().second;
 	}
 
 	// Metoda zwracająca klucz przypisany do najmniejszej wartości
@@ -224,224 +8602,409 @@ public: // interface
 	{
 		if (empty())
 			throw PQEmptyEx;
-		return *(pairs_by_V->begin()->first);
+		return impl.minEntry().first;
 	}
 
 	// Metoda zwracająca klucz przypisany do najwiekszej wartości
-	// strong guarantee, zlozonosc: O(1)
+	// strong guarantee, zlozonosc: jak maxValue
 	const K& maxKey() const
 	{
 		if (empty())
 			throw PQEmptyEx;
-		return *(pairs_by_V->rbegin()->first);
+		return impl.maxEntry().first;
 	}
 
 	// Metoda usuwająca z kolejki jedną parę o najmniejszej wartosci
-	// strong guarantee, zlozonosc: O(log size())
+	// strong guarantee (w silniku drzewiastym nothrow), zlozonosc: O(log size())
 	void deleteMin()
 	{
+		stats_scope scope(*this, &PriorityQueueStats::remove);
 		if (empty())
 			return;
-		auto to_delete1 = pairs_by_V->begin();
-		auto to_delete2 = pairs_by_K->find(*to_delete1); //except do tego momentu nic nie robi
-
-		pairs_by_V->erase(to_delete1); //nothrow
-		pairs_by_K->erase(to_delete2); //nothrow
+		impl.deleteMin();
 	}
 
 	// Metoda usuwająca z kolejki jedną parę o najwiekszej wartosci
-	// strong guarantee, zlozonosc: O(log size())
+	// strong guarantee (w silniku drzewiastym nothrow), zlozonosc: O(log size())
 	void deleteMax()
 	{
+		stats_scope scope(*this, &PriorityQueueStats::remove);
 		if (empty())
 			return;
-		auto to_delete1 = pairs_by_V->end();
-		to_delete1--;
-		auto to_delete2 = pairs_by_K->find(*to_delete1);
+		impl.deleteMax();
+	}
 
-		pairs_by_V->erase(to_delete1); //nothrow
-		pairs_by_K->erase(to_delete2); //nothrow
+	// Metoda wyjmująca z kolejki min(n, size()) par o najmniejszych wartościach: zapisuje je do out
+	// (jako std::pair<K, V>, w kolejności rosnących wartości) i usuwa z kolejki
+	// pary są usuwane dopiero po zapisaniu wszystkich, więc wyjątek (także z zapisu do out) nie zmienia kolejki
+	// strong guarantee, zlozonosc: silnik drzewiasty O(min(k log size(), size())), k = min(n, size());
+	// silnik kopcowy O(size() + k log size())
+	template<typename OutputIt>
+	OutputIt popMinN(size_type n, OutputIt out)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::remove);
+		return impl.popMinN(n, out);
 	}
 
-	// Metoda zmieniająca dotychczasową wartość przypisaną kluczowi key na nową
+	// Metoda zwalniająca pamięć par usuniętych przez deleteMin, deleteMax i popMinN w trybie lazy_deletion
+	// (tryb jest włączany polityką, patrz PriorityQueueDefaultPolicy); kolejka robi to sama, gdy
+	// usuniętych par jest ponad cztery razy więcej niż przechowywanych i co najmniej 32, więc do tego
+	// czasu węzły usuniętych par (np. z kluczami std::string) zajmują pamięć; compact() przydaje się
+	// po fazie usuwania, np. przed długim okresem samego szukania po kluczu
+	// nothrow, zlozonosc: O(size() + liczba usuniętych par)
+	void compact() noexcept
+	{
+		impl.compact();
+	}
+
+	// Metody zwracające wszystkie pary w porządku (klucz, wartość) albo (wartość, klucz),
+	// np. for (const auto& kv : queue.byValue())
+	// nothrow, zlozonosc: O(1), przejście - O(size())
+	key_range byKey() const
+	{
+		static_assert(engine_type::has_ordered_iterators, "This engine doesn't support ordered iteration!");
+		return key_range(impl.keyBegin(), impl.keyEnd());
+	}
+
+	value_range byValue() const
+	{
+		static_assert(engine_type::has_ordered_iterators, "This engine doesn't support ordered iteration!");
+		return value_range(impl.valueBegin(), impl.valueEnd());
+	}
+
+	// Metody zwracające pary o kluczach (wartościach) z przedziału [lo, hi), w tym samym porządku;
+	// granice zakresu szukamy w drzewie, bez kopiowania par; dla hi < lo zakres jest pusty
 	// strong guarantee, zlozonosc: O(log size())
+	key_range rangeByKey(const K& lo, const K& hi) const
+	{
+		static_assert(engine_type::has_ordered_iterators, "This engine doesn't support ordered iteration!");
+		key_iterator first = impl.keyLowerBound(lo);
+		if (hi < lo)
+			return key_range(first, first);
+		return key_range(first, impl.keyLowerBound(hi));
+	}
+
+	value_range rangeByValue(const V& lo, const V& hi) const
+	{
+		static_assert(engine_type::has_ordered_iterators, "This engine doesn't support ordered iteration!");
+		value_iterator first = impl.valueLowerBound(lo);
+		if (hi < lo)
+			return value_range(first, first);
+		return value_range(first, impl.valueLowerBound(hi));
+	}
+
+	// Metoda zmieniająca dotychczasową wartość przypisaną kluczowi key na nową
+	// w silniku drzewiastym: jedno wyszukanie po kluczu i przepięcie istniejącego węzła,
+	// bez alokacji, o ile przypisanie V nie rzuca; w silniku haszującym klucz szuka indeks haszujący
+	// strong guarantee (basic przy basic_guarantee), zlozonosc: O(log size())
 	void changeValue(const K& key, const V& value)
 	{
-		//szukamy pary o danym kluczu
-		auto to_find = std::make_pair(std::make_shared<K>(key), std::make_shared<V>(minValue()));
-		auto pair_iterator = pairs_by_K->lower_bound(to_find);
-		
-		if (pair_iterator == pairs_by_K->end() || !(*pair_iterator->first == key))
+		stats_scope scope(*this, &PriorityQueueStats::change_value);
+		if (!impl.changeValue(key, value))
+			throw PQNotFoundEx;
+	}
+
+	// Wersja changeValue dla klucza innego typu niż K (np. std::string_view dla kluczy std::string),
+	// dostępna, gdy polityka ma is_transparent; wymaga K == KeyLike i K < KeyLike
+	// (w silniku haszującym zamiast K < KeyLike - skrótu Hash dla KeyLike równego skrótowi równego klucza)
+	// nie konstruuje K, więc przed samą zmianą wartości nie alokuje pamięci
+	// strong guarantee (basic przy basic_guarantee), zlozonosc: O(log size())
+	template<typename KeyLike, typename P = Policy,
+			typename = typename std::enable_if<pq_detail::is_transparent<P>::value>::type>
+	void changeValue(const KeyLike& key, const V& value)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::change_value);
+		if (!impl.changeValue(key, value))
 			throw PQNotFoundEx;
-			
-		//zapisujemy parę którą chcemy usunąć
-		auto pair_to_delete = *pair_iterator;
-		
-		//wstawiamy nową parę
-		//insert zapisuje nam iteratory do wstawionych elementów
-		//może pojawić się wyjątek, ale mamy strong guarantee
-		insert(key, value);
-		
-		//szukamy znowu pary do usunięcia
-		typename pairs_by_key_set::iterator to_delete1;
-		typename pairs_by_value_set::iterator to_delete2;
-		try
-		{
-			to_delete1 = pairs_by_K->find(pair_to_delete);
-			to_delete2 = pairs_by_V->find(pair_to_delete);
-		}
-		catch(...)
-		{			
-			//jeśli pojawił się wyjątek przy szukaniu, usuwamy to co wstawiliśmy
-			//mamy zapisane iteratory z inserta
-			//erase jest no-throw
-			pairs_by_K->erase(inserted_K);
-			pairs_by_V->erase(inserted_V);	
-			throw;			
-		}
-		
-		//jeśli wszystko poszło dobrze, usuwamy starą parę (no-throw)
-		pairs_by_K->erase(to_delete1);
-		pairs_by_V->erase(to_delete2);
+	}
+
+	// Metoda zwracająca true wtedy i tylko wtedy, gdy w kolejce jest para o kluczu key
+	// strong guarantee, zlozonosc: O(log size()) (w silniku kopcowym O(size()), w haszującym oczekiwane O(1))
+	bool contains(const K& key) const
+	{
+		return impl.contains(key);
+	}
+
+	// Wersja contains dla klucza innego typu niż K, jak changeValue
+	template<typename KeyLike, typename P = Policy,
+			typename = typename std::enable_if<pq_detail::is_transparent<P>::value>::type>
+	bool contains(const KeyLike& key) const
+	{
+		return impl.contains(key);
+	}
+
+	// Metoda zmieniająca wartość pary wskazywanej przez uchwyt, bez szukania po kluczu
+	// zwraca uchwyt do zmienionej pary: ten sam, jeśli przypisanie V nie rzuca, wpp. nowy
+	// (stary jest wtedy nieważny); przy count_duplicates zmieniana jest jedna kopia pary,
+	// a uchwyt może wskazywać inną pozycję
+	// strong guarantee (basic przy basic_guarantee), zlozonosc: O(log size())
+	// (w silniku parującym zmniejszenie wartości - O(1), zwiększenie - O(log size()) zamortyzowane)
+	handle changeValue(handle h, const V& value)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::change_value);
+		static_assert(engine_type::has_handles, "This engine doesn't support handles!");
+		assert(h);
+		return impl.changeValue(h, value);
+	}
+
+	// Metoda zapisująca kolejkę do pliku path (nadpisuje go) w formacie dla mapFrom: pary w porządku
+	// (wartość, klucz) i permutacja porządku (klucz, wartość), patrz pq_detail::queue_file_header
+	// tylko dla trywialnie kopiowalnych K i V; plik odczyta program z tymi samymi typami
+	// na maszynie o tej samej kolejności bajtów
+	// rzuca std::ios_base::failure, gdy zapis się nie uda; kolejka się nie zmienia
+	// zlozonosc: O(size() log size()) (w silniku drzewiastym bez porównań K i V)
+	void save(const std::string& path) const
+	{
+		static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+				"Saved queues require trivially copyable keys and values!");
+		pointer_vector by_key{pointer_allocator(get_allocator())};
+		index_vector by_value{index_allocator(get_allocator())};
+		bothOrders(by_key, by_value);
+
+		std::ofstream out;
+		out.exceptions(std::ios::failbit | std::ios::badbit);
+		out.open(path, std::ios::binary | std::ios::trunc);
+		pq_detail::write_queue_file<K, V>(out, by_key, by_value, get_allocator());
+		out.close();
+	}
+
+	// Metoda tworząca kolejkę z pliku zapisanego przez save: plik jest mapowany do pamięci (w systemach
+	// POSIX), oba porządki i permutacja sprawdzane w O(n) porównań sąsiednich par, a drzewa budowane
+	// od razu zrównoważone z gotowych porządków, bez n wstawień po O(log n)
+	// rzuca PQFormatEx dla pliku, który nie jest poprawnym plikiem kolejki dla K i V,
+	// a std::system_error, gdy pliku nie da się otworzyć
+	// zlozonosc: O(n), n - liczba par w pliku
+	static PriorityQueue mapFrom(const std::string& path, const Alloc& alloc = Alloc())
+	{
+		static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+				"Saved queues require trivially copyable keys and values!");
+		pq_detail::queue_file_reader<K, V> file(path);
+		typedef typename alloc_traits::template rebind_alloc<bool> flag_allocator;
+		std::vector<bool, flag_allocator> seen{flag_allocator(alloc)};
+		file.checkContents(seen);
+
+		PriorityQueue queue(alloc);
+		queue.impl.assignSorted(file.size(), [&file](size_type i) { return file.at(i); },
+				[&file](size_type i) { return file.keyPosition(i); });
+		return queue;
+	}
+
+	// Metoda zapisująca kolejkę do strumienia out (np. do wysłania przez sieć) jako ciąg rekordów
+	// w porządku (wartość, klucz), patrz pq_detail::queue_stream_header; klucze i wartości zapisuje
+	// PriorityQueueSerializer, więc w przeciwieństwie do save działa też np. dla std::string
+	// strumień odczyta deserialize w programie z tymi samymi typami, na maszynie o tej samej kolejności bajtów
+	// błędy zapisu zgłasza strumień (stan albo wyjątki out); kolejka się nie zmienia
+	// zlozonosc: O(size() log size()) (w silniku drzewiastym bez porównań K i V) plus zapis
+	void serialize(std::ostream& out) const
+	{
+		pointer_vector by_key{pointer_allocator(get_allocator())};
+		index_vector by_value{index_allocator(get_allocator())};
+		bothOrders(by_key, by_value);
+
+		pq_detail::queue_stream_header header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, pq_detail::queue_stream_magic, sizeof(header.magic));
+		header.byte_order = pq_detail::queue_file_byte_order;
+		header.count = by_key.size();
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		//bufor rekordu, wspólny dla wszystkich rekordów
+		std::string record;
+		for (std::uint64_t key_index : by_value)
+		{
+			const std::pair<K, V>& kv = *by_key[static_cast<std::size_t>(key_index)];
+			record.clear();
+			PriorityQueueSerializer<std::uint64_t>::write(record, 0);
+			PriorityQueueSerializer<std::uint64_t>::write(record, key_index);
+			PriorityQueueSerializer<K>::write(record, kv.first);
+			PriorityQueueSerializer<V>::write(record, kv.second);
+			std::uint64_t length = record.size() - sizeof(std::uint64_t);
+			std::memcpy(&record[0], &length, sizeof(length));
+			out.write(record.data(), static_cast<std::streamsize>(record.size()));
+		}
+	}
+
+	// Metoda tworząca kolejkę ze strumienia zapisanego przez serialize: rekordy czyta po kolei,
+	// a drzewa buduje od razu zrównoważone z gotowych porządków (sprawdzonych w O(n) porównań
+	// sąsiednich par), bez szukania miejsca dla każdej pary
+	// rzuca PQFormatEx, gdy strumień się kończy albo nie jest poprawnym strumieniem kolejki dla K i V
+	// zlozonosc: O(n) plus odczyt, n - liczba par w strumieniu
+	static PriorityQueue deserialize(std::istream& in, const Alloc& alloc = Alloc())
+	{
+		typedef pq_detail::file_entry<K, V> entry;
+		typedef typename alloc_traits::template rebind_alloc<entry> entry_allocator;
+
+		pq_detail::queue_stream_header header;
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+				std::memcmp(header.magic, pq_detail::queue_stream_magic, sizeof(header.magic)) != 0 ||
+				header.byte_order != pq_detail::queue_file_byte_order)
+			throw PQFormatEx;
+
+		//bufory rosną razem z odczytanymi rekordami, nie według (być może uszkodzonego) header.count
+		std::vector<entry, entry_allocator> entries{entry_allocator(alloc)};
+		index_vector key_index_of{index_allocator(alloc)};
+		std::string record;
+		for (std::uint64_t i = 0; i < header.count; ++i)
+		{
+			std::uint64_t length;
+			if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length < sizeof(std::uint64_t))
+				throw PQFormatEx;
+			pq_detail::read_stream_record(in, record, length);
+			const char* first = record.data();
+			const char* last = first + record.size();
+			std::uint64_t key_index = PriorityQueueSerializer<std::uint64_t>::read(first, last);
+			K key = PriorityQueueSerializer<K>::read(first, last);
+			V value = PriorityQueueSerializer<V>::read(first, last);
+			if (first != last || key_index >= header.count)
+				throw PQFormatEx;
+			entries.push_back(entry{std::move(key), std::move(value)});
+			key_index_of.push_back(key_index);
+		}
+
+		//odwrócenie numerów z rekordów w permutację porządku po kluczu; n - numer jeszcze nieustalony
+		std::size_t n = entries.size();
+		index_vector key_position(n, n, index_allocator(alloc));
+		for (std::size_t i = 0; i < n; ++i)
+			key_position[static_cast<std::size_t>(key_index_of[i])] = i;
+
+		typedef typename alloc_traits::template rebind_alloc<bool> flag_allocator;
+		std::vector<bool, flag_allocator> seen{flag_allocator(alloc)};
+		pq_detail::check_sorted_contents<K, V>(n, [&entries](std::size_t i) -> const entry& { return entries[i]; },
+				[&key_position](std::size_t i) { return key_position[i]; }, seen);
+
+		PriorityQueue queue(alloc);
+		queue.impl.assignSorted(n, [&entries](size_type i) { return std::move(entries[i]); },
+				[&key_position](size_type i) { return key_position[i]; });
+		return queue;
+	}
+
+	// Metoda zwracająca kopię liczników kolejki z polityką collect_stats (patrz PriorityQueueStats)
+	// liczniki należą do obiektu kolejki, a nie do zawartości: kopia i przeniesienie kolejki zaczynają
+	// od zera, a przypisanie, swap i merge ich nie przenoszą
+	// nothrow, zlozonosc: O(1)
+	PriorityQueueStats stats() const noexcept
+	{
+		static_assert(pq_detail::collects_stats<Policy>::value, "This queue doesn't collect stats!");
+		return this->collectedStats();
+	}
+
+	// Metoda zerująca liczniki kolejki z polityką collect_stats
+	// nothrow, zlozonosc: O(1)
+	void resetStats() noexcept
+	{
+		static_assert(pq_detail::collects_stats<Policy>::value, "This queue doesn't collect stats!");
+		this->resetCollectedStats();
 	}
 
 	// Metoda scalająca zawartość kolejki z podaną kolejką queue; ta operacja usuwa
 	// wszystkie elementy z kolejki queue i wstawia je do kolejki *this
-	// strong guarantee
-	// tworzenie kopii zapasowej kolejki na wypadek wyjatku rzuconego przy mergowaniu: O(size())
-	// kopiowanie multisetów queue do *this: O(queue.size() * log (queue.size() + size()))
-	// zlozonosc: O(size() + queue.size() * log (queue.size() + size()))
-	void merge(PriorityQueue<K, V>& queue)
+	// strong guarantee (basic przy basic_guarantee)
+	// silnik drzewiasty, równe alokatory: węzły queue są przepinane do *this bez alokacji
+	// (uchwyty do par z queue pozostają ważne), zlozonosc:
+	// O(min(queue.size() * log (queue.size() + size()), size() + queue.size()))
+	// silnik drzewiasty, różne alokatory: pary queue są kopiowane, jak w insert(first, last)
+	// silnik kopcowy: O(size() + queue.size())
+	// silnik parujący: kopce łączone jednym porównaniem, O(1), a drzewo po kluczu jak w silniku drzewiastym
+	void merge(PriorityQueue& queue)
 	{
+		stats_scope scope(*this, &PriorityQueueStats::merge);
 		if (this != &queue)
-		{
-			PriorityQueue<K, V> tmp(*this); //kopia zapasowa
-			try {
-				pairs_by_K->insert(queue.pairs_by_K->begin(), queue.pairs_by_K->end());
-				pairs_by_V->insert(queue.pairs_by_V->begin(), queue.pairs_by_V->end());
-			}
-			catch (...) {
-				swap(tmp);
-				throw;
-			}
-			queue.clear();
-		}
+			impl.merge(queue.impl);
+	}
+
+	// merge na wielu wątkach (PriorityQueueParallel): w silniku drzewiastym, gdy drzewa są budowane od nowa,
+	// oba porządki są scalane równolegle, kawałkami (przy różnych alokatorach pary queue są najpierw
+	// kopiowane jak w konstruktorze kopiującym na wielu wątkach)
+	// strong guarantee (basic przy basic_guarantee), zlozonosc: O((size() + queue.size()) / t) porównań na wątek
+	void merge(PriorityQueueParallel parallel, PriorityQueue& queue)
+	{
+		stats_scope scope(*this, &PriorityQueueStats::merge);
+		if (this != &queue)
+			mergeEngine(queue.impl, parallel.threads, parallel_bulk());
 	}
 
 
 	// Metoda zamieniającą zawartość kolejki z podaną kolejką queue
+	// alokatory są zamieniane, jeśli pozwala na to propagate_on_container_swap,
+	// w przeciwnym razie (jak w kontenerach standardowych) muszą być równe
 	// no-throw guarantee, zlozonosc: O(1)
-	void swap(PriorityQueue<K, V>& queue) noexcept
+	void swap(PriorityQueue& queue) noexcept
 	{
 		if (this != &queue)
 		{
-			std::swap(pairs_by_K, queue.pairs_by_K);
-			std::swap(pairs_by_V, queue.pairs_by_V);
+			assert(alloc_traits::propagate_on_container_swap::value ||
+					get_allocator() == queue.get_allocator());
+			impl.swap(queue.impl, alloc_traits::propagate_on_container_swap::value);
 		}
 	}
 
-	template<typename X, typename Y>
-	friend void swap(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs) noexcept;
+	template<typename X, typename Y, typename A, typename P>
+	friend bool operator==(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs);
 
-	template<typename X, typename Y>
-	friend bool operator==(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs);
-
-	template<typename X, typename Y>
-	friend bool operator<(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs);
+	template<typename X, typename Y, typename A, typename P>
+	friend bool operator<(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs);
 };
 
 // no-throw guarantee, zlozonosc: O(1)
-template<typename X, typename Y>
-void swap(PriorityQueue<X, Y>& lhs, PriorityQueue<X, Y>& rhs) noexcept
+template<typename X, typename Y, typename A, typename P>
+void swap(PriorityQueue<X, Y, A, P>& lhs, PriorityQueue<X, Y, A, P>& rhs) noexcept
 {
 	lhs.swap(rhs);
 }
 
 // wszystkie operatory mają strong guarantee
-template<typename X, typename Y>
-bool operator==(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+// silnik kopcowy z arytmetycznymi K i V porównuje posortowane kopie tablic blokami, bez skoków
+template<typename X, typename Y, typename A, typename P>
+bool operator==(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
+	typedef typename PriorityQueue<X, Y, A, P>::engine_type engine_type;
+
 	// jeśli kolejki mają różną wielkość, zwracamy false
 	if (lhs.size() == rhs.size())
-	{
-		//jesli obie kolejki sa puste, zwracamy true
-		if(lhs.size() == 0)
-			return true;
-
-		auto it1 = lhs.pairs_by_K->begin();
-		auto it2 = rhs.pairs_by_K->begin();
-		auto end1 = lhs.pairs_by_K->end();
-
-		// jeśli na którejś pozycji kolejki się różnią, zwracamy false
-		for (; it1 != end1; it1++, it2++)
-		{
-			if (!(*(it1->first) == *(it2->first) && //po kluczu
-				*(it1->second) == *(it2->second))) //po wartości
-				return false;
-		}
-
-		return true;
-	}
+		return pq_detail::equal_in_key_order(lhs.impl, rhs.impl,
+				std::integral_constant<bool, engine_type::contiguous_key_order>());
 	return false;
 }
 
-template<typename X, typename Y>
-bool operator<(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+template<typename X, typename Y, typename A, typename P>
+bool operator<(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
+	typedef typename PriorityQueue<X, Y, A, P>::engine_type engine_type;
+
 	if (lhs.size() == 0 && rhs.size() == 0)
 		return false;
 	if (lhs.size() == 0 || rhs.size() == 0)
 		return lhs.size() == 0;
 
 	//w tym momencie obie kolejki sa niepuste
-	auto it1 = lhs.pairs_by_K->begin();
-	auto it2 = rhs.pairs_by_K->begin();
-	auto end1 = lhs.pairs_by_K->end();
-	auto end2 = rhs.pairs_by_K->end();
-
-	assert(it1 != end1 && it2 != end2);
-
-	while (it1 != end1 && it2 != end2)
-	{
-		if (!(*(it1->first) == *(it2->first))) //po kluczu
-			return *(it1->first) < *(it2->first);
-		if (!(*(it1->second) == *(it2->second))) //po wartosci
-			return *(it1->second) < *(it2->second);
-
-		++it1;
-		++it2;
-	}
-	//skonczyla sie ktoras z kolejek
-	//zwracam true jesli skonczyla sie tylko pierwsza kolejka, wpp. false
-	//poniewaz albo sa rowne, albo pierwsza jest dluzsza, w obu przypadkach pierwsza nie jest mniejsza.
-	return (it1 == end1 && it2 != end2);
+	return pq_detail::less_in_key_order(lhs.impl, rhs.impl,
+			std::integral_constant<bool, engine_type::contiguous_key_order>());
 }
 
 // trywialne operatory korzystające z poprzednich
-template<typename X, typename Y>
-bool operator!=(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+template<typename X, typename Y, typename A, typename P>
+bool operator!=(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
 	return !(lhs == rhs);
 }
 
-template<typename X, typename Y>
-bool operator>(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+template<typename X, typename Y, typename A, typename P>
+bool operator>(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
 	return !(lhs == rhs) && !(lhs < rhs);
 }
 
-template<typename X, typename Y>
-bool operator<=(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+template<typename X, typename Y, typename A, typename P>
+bool operator<=(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
 	return lhs == rhs || lhs < rhs;
 }
 
-template<typename X, typename Y>
-bool operator>=(const PriorityQueue<X, Y>& lhs, const PriorityQueue<X, Y>& rhs)
+template<typename X, typename Y, typename A, typename P>
+bool operator>=(const PriorityQueue<X, Y, A, P>& lhs, const PriorityQueue<X, Y, A, P>& rhs)
 {
 	return !(lhs < rhs);
 }
 
 
 #endif
-
@@ -0,0 +1,138 @@
+// ConcurrentPriorityQueue i ShardedPriorityQueue porządkują minima kolejek cząstkowych porządkiem
+// z polityki: z value_compare odwracającym porządek wartości tryb strict i kolejka z dwoma wątkami
+// (która zawsze podgląda drugą kolejkę) wyjmują pary dokładnie od największej wartości; typ bez < i ==,
+// porównywany tylko przez key_compare i value_compare, wystarcza do wstawiania i wyjmowania
+//
+// budowa:       cmake -S test -B build/test && cmake --build build/test
+// uruchomienie: ctest --test-dir build/test --output-on-failure
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+#include "concurrentpriorityqueue.hh"
+
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* what, const char* queue)
+	{
+		if (!condition)
+		{
+			std::cerr << queue << ": " << what << " failed\n";
+			++failures;
+		}
+	}
+
+	struct reversed
+	{
+		int operator()(int a, int b) const noexcept
+		{
+			return a < b ? 1 : (b < a ? -1 : 0);
+		}
+	};
+
+	struct reversed_policy : PriorityQueueDefaultPolicy
+	{
+		typedef reversed value_compare;
+	};
+
+	// liczba bez < i ==
+	struct opaque
+	{
+		int x;
+	};
+
+	struct opaque_compare
+	{
+		int operator()(const opaque& a, const opaque& b) const noexcept
+		{
+			return a.x < b.x ? -1 : (b.x < a.x ? 1 : 0);
+		}
+	};
+
+	struct opaque_hash
+	{
+		std::size_t operator()(const opaque& a) const noexcept
+		{
+			return static_cast<std::size_t>(a.x);
+		}
+	};
+
+	struct opaque_policy : PriorityQueueDefaultPolicy
+	{
+		typedef opaque_compare key_compare;
+		typedef opaque_compare value_compare;
+	};
+
+	void checkStrict()
+	{
+		const char* queue = "ConcurrentPriorityQueue<reversed>";
+		ConcurrentPriorityQueue<int, int, std::hash<int>, std::allocator<std::pair<int, int>>, reversed_policy>
+				q(ConcurrentPriorityQueueOrdering::strict, 4);
+		for (int i = 0; i < 64; ++i)
+			q.insert(i, i);
+		check(q.minValue() == 63 && q.minKey() == 63, "minValue", queue);
+		check(q.maxValue() == 0 && q.maxKey() == 0, "maxValue", queue);
+
+		int key;
+		int value;
+		for (int i = 63; i >= 0; --i)
+			check(q.popMin(key, value) && key == i && value == i, "popMin order", queue);
+		check(!q.popMin(key, value), "popMin on empty", queue);
+	}
+
+	void checkSharded()
+	{
+		const char* queue = "ShardedPriorityQueue<reversed>";
+		ShardedPriorityQueue<int, int, std::allocator<std::pair<int, int>>, reversed_policy> q(2, 1);
+		for (int i = 0; i < 64; ++i)
+			q.insert(i < 32 ? 0 : 1, i, i);
+
+		int key;
+		int value;
+		for (int i = 63; i >= 0; --i)
+			check(q.popMin(0, key, value) && key == i && value == i, "popMin order", queue);
+		check(!q.popMin(0, key, value), "popMin on empty", queue);
+	}
+
+	void checkOpaque()
+	{
+		const char* queue = "opaque pairs";
+		ConcurrentPriorityQueue<opaque, opaque, opaque_hash, std::allocator<std::pair<opaque, opaque>>, opaque_policy>
+				concurrent(ConcurrentPriorityQueueOrdering::strict, 4);
+		ShardedPriorityQueue<opaque, opaque, std::allocator<std::pair<opaque, opaque>>, opaque_policy> sharded(2, 1);
+		for (int i = 0; i < 16; ++i)
+		{
+			concurrent.insert(opaque{i}, opaque{15 - i});
+			sharded.insert(i % 2, opaque{i}, opaque{15 - i});
+		}
+		check(concurrent.minValue().x == 0 && concurrent.maxValue().x == 15, "min/maxValue", queue);
+		concurrent.deleteMax();
+
+		opaque key;
+		opaque value;
+		for (int i = 0; i < 15; ++i)
+		{
+			check(concurrent.popMin(key, value) && value.x == i, "ConcurrentPriorityQueue popMin", queue);
+			check(sharded.popMin(1, key, value) && value.x == i, "ShardedPriorityQueue popMin", queue);
+		}
+	}
+}
+
+
+int main()
+{
+	checkStrict();
+	checkSharded();
+	checkOpaque();
+
+	if (failures != 0)
+		return EXIT_FAILURE;
+	std::cout << "all checks passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+// ConcurrentPriorityQueue (w trybach strict i relaxed) i ShardedPriorityQueue pod równoległymi insert,
+// changeValue i popMin z kilku wątków: każda wstawiona para jest wyjęta albo zostaje w kolejce dokładnie raz,
+// a w trybie strict kolejka opróżniana na koniec jednym wątkiem oddaje pozostałe pary w porządku po wartości
+//
+// budowa:       cmake -S test -B build/test && cmake --build build/test
+// uruchomienie: ctest --test-dir build/test --output-on-failure
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "concurrentpriorityqueue.hh"
+
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* what, const char* queue)
+	{
+		if (!condition)
+		{
+			std::cerr << queue << ": " << what << " failed\n";
+			++failures;
+		}
+	}
+
+	const int threads = 4;
+	const int per_thread = 3000;
+
+	// klucze wątku t to t * per_thread .. (t + 1) * per_thread - 1; widziane klucze zliczamy w seen
+	void checkSeen(const std::vector<int>& seen, const char* queue)
+	{
+		bool once = true;
+		for (int count : seen)
+			once = once && count == 1;
+		check(once, "every pair popped or left exactly once", queue);
+	}
+
+	// wyjmowanie pozostałych par z kolejki; gdy ordered, wartości nie mogą maleć
+	template<typename Pop>
+	void drain(std::vector<int>& seen, bool ordered, Pop pop, const char* queue)
+	{
+		int key;
+		unsigned value;
+		unsigned last = 0;
+		bool sorted = true;
+		while (pop(key, value))
+		{
+			sorted = sorted && last <= value;
+			last = value;
+			++seen[key];
+		}
+		check(!ordered || sorted, "final drain in value order", queue);
+	}
+
+	void checkConcurrent(ConcurrentPriorityQueueOrdering ordering, const char* queue)
+	{
+		ConcurrentPriorityQueue<int, unsigned> q(ordering, 8);
+		std::vector<std::vector<int>> popped(threads);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; ++t)
+			workers.emplace_back([&q, &popped, t]
+			{
+				std::mt19937 random(t + 1);
+				for (int i = 0; i < per_thread; ++i)
+				{
+					int key = t * per_thread + i;
+					q.insert(key, random() % 1000);
+					if (i % 3 == 0)
+					{
+						//para mogła już zostać wyjęta przez inny wątek
+						try
+						{
+							q.changeValue(t * per_thread + static_cast<int>(random() % (i + 1)), random() % 1000);
+						}
+						catch (const PriorityQueueNotFoundException&)
+						{ }
+					}
+					int k;
+					unsigned v;
+					if (i % 2 == 0 && q.popMin(k, v))
+						popped[t].push_back(k);
+				}
+			});
+		for (auto& w : workers)
+			w.join();
+
+		std::vector<int> seen(threads * per_thread, 0);
+		for (const auto& keys : popped)
+			for (int k : keys)
+				++seen[k];
+		drain(seen, ordering == ConcurrentPriorityQueueOrdering::strict,
+				[&q](int& k, unsigned& v) { return q.popMin(k, v); }, queue);
+		check(q.empty() && q.size() == 0, "empty after drain", queue);
+		checkSeen(seen, queue);
+	}
+
+	void checkSharded()
+	{
+		const char* queue = "ShardedPriorityQueue";
+		ShardedPriorityQueue<int, unsigned> q(threads, 3);
+		std::vector<std::vector<int>> popped(threads);
+		std::vector<std::thread> workers;
+		std::atomic<int> producing(threads - 1);
+		for (int t = 0; t < threads; ++t)
+			workers.emplace_back([&q, &popped, &producing, t]
+			{
+				int k;
+				unsigned v;
+				//wątek 0 tylko wyjmuje, więc kradnie pary pozostałych, dopóki ci je wstawiają (i przynajmniej
+				//jedną, gdyby wystartował dopiero po nich - połowa ich par zostaje w kolejce)
+				if (t == 0)
+				{
+					for (;;)
+					{
+						bool produced = producing.load() == 0;
+						if (q.popMin(0, k, v))
+							popped[0].push_back(k);
+						else if (produced)
+							return;
+						if (produced && !popped[0].empty())
+							return;
+					}
+				}
+				std::mt19937 random(t + 1);
+				for (int i = 0; i < per_thread; ++i)
+				{
+					q.insert(static_cast<std::size_t>(t), t * per_thread + i, random() % 1000);
+					if (i % 2 == 0 && q.popMin(static_cast<std::size_t>(t), k, v))
+						popped[t].push_back(k);
+				}
+				--producing;
+			});
+		for (auto& w : workers)
+			w.join();
+
+		std::vector<int> seen(threads * per_thread, 0);
+		for (int i = 0; i < per_thread; ++i)
+			seen[i] = 1;
+		for (const auto& keys : popped)
+			for (int k : keys)
+				++seen[k];
+		check(!popped[0].empty(), "an idle worker steals", queue);
+		drain(seen, false, [&q](int& k, unsigned& v) { return q.popMin(0, k, v); }, queue);
+		check(q.empty() && q.size() == 0, "empty after drain", queue);
+		checkSeen(seen, queue);
+	}
+}
+
+
+int main()
+{
+	checkConcurrent(ConcurrentPriorityQueueOrdering::strict, "ConcurrentPriorityQueue<strict>");
+	checkConcurrent(ConcurrentPriorityQueueOrdering::relaxed, "ConcurrentPriorityQueue<relaxed>");
+	checkSharded();
+
+	if (failures != 0)
+		return EXIT_FAILURE;
+	std::cout << "all checks passed\n";
+	return EXIT_SUCCESS;
+}
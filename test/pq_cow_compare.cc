@@ -0,0 +1,192 @@
+// Operatory porównania kolejek na PriorityQueueCopyOnWriteEngine<Inner> dla każdego silnika Inner,
+// z arytmetycznymi parami (contiguous_key_order, porównanie tablic z key_array) i z std::string
+// (przejście key_cursor); kolejki puste, współdzielące zawartość i skopiowane przy zapisie
+// oraz maxValue, maxKey i insertKeepingSmallest z kluczem, którego < rzuca: wyjątek dochodzi
+// do wywołującego, a kolejka się nie zmienia
+//
+// budowa:       cmake -S test -B build/test && cmake --build build/test
+// uruchomienie: ctest --test-dir build/test --output-on-failure
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "priorityqueue.hh"
+
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* what, const char* queue)
+	{
+		if (!condition)
+		{
+			std::cerr << queue << ": " << what << " failed\n";
+			++failures;
+		}
+	}
+
+	template<typename T>
+	T make(unsigned x);
+
+	template<>
+	int make<int>(unsigned x)
+	{
+		return static_cast<int>(x);
+	}
+
+	template<>
+	unsigned make<unsigned>(unsigned x)
+	{
+		return x;
+	}
+
+	template<>
+	std::string make<std::string>(unsigned x)
+	{
+		//dopełnione zerami, żeby porządek napisów był porządkiem liczb
+		std::string digits = std::to_string(x);
+		return "key-" + std::string(4 - digits.size(), '0') + digits;
+	}
+
+	template<typename Engine>
+	struct cow_policy : PriorityQueueDefaultPolicy
+	{
+		typedef PriorityQueueCopyOnWriteEngine<Engine> engine;
+	};
+
+	template<typename Engine>
+	struct cow_monotone_policy : PriorityQueueMonotonePolicy
+	{
+		typedef PriorityQueueCopyOnWriteEngine<Engine> engine;
+	};
+
+	// wszystkie sześć operatorów dla pary kolejek, z których lhs jest mniejsza (less) albo równa rhs
+	template<typename Q>
+	void checkOrder(const Q& lhs, const Q& rhs, bool less, const char* queue)
+	{
+		check((lhs == rhs) == !less, "==", queue);
+		check((lhs != rhs) == less, "!=", queue);
+		check((lhs < rhs) == less, "<", queue);
+		check(!(lhs > rhs), ">", queue);
+		check(lhs <= rhs, "<=", queue);
+		check((lhs >= rhs) == !less, ">=", queue);
+		check((rhs > lhs) == less, "> (reversed)", queue);
+		check(!(rhs < lhs), "< (reversed)", queue);
+	}
+
+	template<typename K, typename V, typename Policy>
+	void checkQueue(const char* queue)
+	{
+		typedef PriorityQueue<K, V, std::allocator<std::pair<K, V>>, Policy> Q;
+
+		Q empty;
+		Q other_empty;
+		checkOrder(empty, other_empty, false, queue);
+
+		Q a;
+		for (unsigned i = 0; i < 20; ++i)
+			a.insert(make<K>(i), make<V>(i % 7));
+		checkOrder(empty, a, true, queue);
+
+		Q shared(a);
+		checkOrder(a, shared, false, queue);
+
+		Q copied(a);
+		copied.insert(make<K>(20), make<V>(1));
+		checkOrder(a, copied, true, queue);
+
+		Q changed(a);
+		changed.changeValue(make<K>(3), make<V>(6));
+		checkOrder(a, changed, true, queue);
+	}
+
+	// klucz, którego porównania rzucają, gdy armed
+	bool armed = false;
+
+	struct fragile
+	{
+		int x;
+
+		friend bool operator==(const fragile& a, const fragile& b)
+		{
+			if (armed)
+				throw 0;
+			return a.x == b.x;
+		}
+
+		friend bool operator<(const fragile& a, const fragile& b)
+		{
+			if (armed)
+				throw 0;
+			return a.x < b.x;
+		}
+	};
+
+	// pary o równych wartościach, więc szukanie maksimum porównuje klucze
+	template<typename Policy>
+	void checkThrowingMax(const char* queue)
+	{
+		typedef PriorityQueue<fragile, unsigned, std::allocator<std::pair<fragile, unsigned>>, Policy> Q;
+
+		Q a;
+		for (int i = 0; i < 20; ++i)
+			a.insert(fragile{i}, i < 2 ? 0 : 9);
+		Q shared(a);
+
+		bool threw = false;
+		armed = true;
+		try
+		{
+			check(a.maxKey().x == 19 && a.maxValue() == 9, "maxKey/maxValue", queue);
+		}
+		catch (int)
+		{
+			threw = true;
+		}
+		try
+		{
+			a.insertKeepingSmallest(fragile{20}, 1, 20);
+		}
+		catch (int)
+		{
+			threw = true;
+		}
+		armed = false;
+
+		check(threw, "throwing comparison", queue);
+		check(a.size() == 20 && a == shared, "unchanged after exception", queue);
+		check(a.maxKey().x == 19 && a.maxValue() == 9, "maxKey/maxValue after exception", queue);
+	}
+
+	template<typename Engine>
+	void checkEngine(const char* queue)
+	{
+		checkQueue<int, unsigned, cow_policy<Engine>>(queue);
+		checkQueue<std::string, unsigned, cow_policy<Engine>>(queue);
+	}
+}
+
+
+int main()
+{
+	checkEngine<PriorityQueueTreeEngine>("CopyOnWrite<Tree>");
+	checkEngine<PriorityQueueHeapEngine<>>("CopyOnWrite<Heap<2>>");
+	checkEngine<PriorityQueueHeapEngine<3>>("CopyOnWrite<Heap<3>>");
+	checkEngine<PriorityQueuePairingEngine>("CopyOnWrite<Pairing>");
+	checkEngine<PriorityQueueHashEngine<>>("CopyOnWrite<Hash>");
+	checkQueue<int, unsigned, cow_monotone_policy<PriorityQueueRadixEngine>>("CopyOnWrite<Radix>");
+	checkQueue<std::string, unsigned, cow_monotone_policy<PriorityQueueRadixEngine>>("CopyOnWrite<Radix>");
+
+	checkThrowingMax<cow_policy<PriorityQueueHeapEngine<3>>>("CopyOnWrite<Heap<3>>");
+	checkThrowingMax<cow_policy<PriorityQueuePairingEngine>>("CopyOnWrite<Pairing>");
+	checkThrowingMax<cow_monotone_policy<PriorityQueueRadixEngine>>("CopyOnWrite<Radix>");
+
+	if (failures != 0)
+		return EXIT_FAILURE;
+	std::cout << "all checks passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,577 @@
+// Losowe ciągi operacji PriorityQueue porównywane z modelem (std::multiset par (wartość, klucz)) dla każdego
+// silnika i polityki: wstawianie pojedyncze, z zakresu, partiami i z ograniczeniem pojemności, usuwanie
+// minimum i maksimum, popMinN, changeValue po kluczu i przez uchwyt, merge, kopie, przypisania i swap,
+// operatory porównania, serialize i save/mapFrom, wersje na wielu wątkach oraz iteratory i zakresy
+// po zakończeniu każdej operacji kolejka ma zawierać dokładnie pary modelu w obu porządkach
+//
+// budowa:       cmake -S test -B build/test && cmake --build build/test
+// uruchomienie: ctest --test-dir build/test --output-on-failure
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "priorityqueue.hh"
+
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* what, const char* queue)
+	{
+		if (!condition)
+		{
+			std::cerr << queue << ": " << what << " failed\n";
+			++failures;
+		}
+	}
+
+	// klucze to liczby 0 .. 39; dla std::string dopełnione zerami, żeby porządek napisów był porządkiem liczb
+	template<typename K>
+	struct keys;
+
+	template<>
+	struct keys<int>
+	{
+		static int make(int id)
+		{
+			return id;
+		}
+
+		static int id(int key)
+		{
+			return key;
+		}
+	};
+
+	template<>
+	struct keys<std::string>
+	{
+		static std::string make(int id)
+		{
+			std::string digits = std::to_string(id);
+			return "key-" + std::string(4 - digits.size(), '0') + digits;
+		}
+
+		static int id(const std::string& key)
+		{
+			return std::stoi(key.substr(4));
+		}
+	};
+
+	// prefiks klucza keys<std::string> za wspólnym "key-" i trójwartościowe porównanie napisów
+	struct string_prefix
+	{
+		std::uint64_t operator()(const std::string& key) const noexcept
+		{
+			std::uint64_t prefix = 0;
+			for (std::size_t i = 4; i < 12; ++i)
+				prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+			return prefix;
+		}
+	};
+
+	struct string_compare
+	{
+		int operator()(const std::string& a, const std::string& b) const noexcept
+		{
+			return a.compare(b);
+		}
+	};
+
+	template<typename Engine>
+	struct engine_policy : PriorityQueueDefaultPolicy
+	{
+		typedef Engine engine;
+	};
+
+	struct duplicates_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool count_duplicates = true;
+	};
+
+	struct lazy_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool lazy_deletion = true;
+	};
+
+	struct basic_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool basic_guarantee = true;
+	};
+
+	struct stats_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool collect_stats = true;
+	};
+
+	struct prefix_policy : PriorityQueueDefaultPolicy
+	{
+		typedef string_compare key_compare;
+		typedef string_prefix key_prefix;
+	};
+
+	// model: pary (wartość, numer klucza) w porządku kolejki po wartości
+	typedef std::pair<unsigned, int> model_pair;
+	typedef std::multiset<model_pair> model_type;
+
+	template<typename Q>
+	class differential
+	{
+		typedef typename Q::key_type K;
+		typedef typename Q::value_type V;
+		typedef std::vector<std::pair<K, V>> pair_vector;
+
+		static const bool has_handles = !std::is_same<typename Q::handle, pq_detail::no_handle>::value;
+		static const bool has_iterators = !std::is_same<typename Q::key_iterator, pq_detail::no_iterator>::value;
+		static const bool savable = std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value;
+
+	public:
+		differential(const char* name, unsigned seed) : name(name), random(seed)
+		{ }
+
+		void run(int steps)
+		{
+			for (int step = 0; step < steps; ++step)
+			{
+				this->step();
+				verifyEnds();
+				if (step % 16 == 0)
+					verifyContents(queue, model);
+			}
+			verifyContents(queue, model);
+		}
+
+	private:
+		const char* name;
+		std::mt19937 random;
+		Q queue;
+		model_type model;
+		// ostatnio usunięte minimum: wartości nie są od niego mniejsze (polityka monotone)
+		unsigned floor = 0;
+
+		int randomKey()
+		{
+			return static_cast<int>(random() % 40);
+		}
+
+		unsigned randomValue()
+		{
+			return floor + static_cast<unsigned>(random() % 30);
+		}
+
+		static model_pair toModel(const std::pair<K, V>& kv)
+		{
+			return model_pair(static_cast<unsigned>(kv.second), keys<K>::id(kv.first));
+		}
+
+		pair_vector randomPairs(std::size_t n)
+		{
+			pair_vector pairs;
+			for (std::size_t i = 0; i < n; ++i)
+				pairs.emplace_back(keys<K>::make(randomKey()), static_cast<V>(randomValue()));
+			return pairs;
+		}
+
+		static void add(model_type& m, const pair_vector& pairs)
+		{
+			for (const auto& kv : pairs)
+				m.insert(toModel(kv));
+		}
+
+		std::size_t keyCount(int key) const
+		{
+			std::size_t count = 0;
+			for (const auto& p : model)
+				count += p.second == key;
+			return count;
+		}
+
+		void removeMin()
+		{
+			floor = model.begin()->first;
+			model.erase(model.begin());
+		}
+
+		void step()
+		{
+			int key = randomKey();
+			unsigned value = randomValue();
+			K k = keys<K>::make(key);
+			V v = static_cast<V>(value);
+
+			//kolejka rośnie, więc co jakiś czas wyjmujemy jej większą część
+			if (model.size() > 300)
+			{
+				drain();
+				return;
+			}
+
+			switch (random() % 22)
+			{
+			case 0:
+				queue.insert(k, v);
+				model.insert(model_pair(value, key));
+				break;
+			case 1:
+				queue.insert(std::move(k), std::move(v));
+				model.insert(model_pair(value, key));
+				break;
+			case 2:
+				queue.emplace(k, v);
+				model.insert(model_pair(value, key));
+				break;
+			case 3:
+			{
+				std::size_t capacity = model.size() + random() % 2;
+				bool inserted = queue.insertKeepingSmallest(k, v, capacity);
+				bool expected = model.size() < capacity ||
+						(capacity != 0 && model_pair(value, key) < *model.rbegin());
+				check(inserted == expected, "insertKeepingSmallest result", name);
+				if (expected && model.size() == capacity)
+					model.erase(std::prev(model.end()));
+				if (expected)
+					model.insert(model_pair(value, key));
+				break;
+			}
+			case 4:
+			{
+				std::size_t capacity = model.size() + random() % 2;
+				bool inserted = queue.insertKeepingLargest(k, v, capacity);
+				bool expected = model.size() < capacity ||
+						(capacity != 0 && *model.begin() < model_pair(value, key));
+				check(inserted == expected, "insertKeepingLargest result", name);
+				if (expected && model.size() == capacity)
+					removeMin();
+				if (expected)
+					model.insert(model_pair(value, key));
+				break;
+			}
+			case 5:
+			{
+				//małe partie wstawiane po jednej, duże - sortowane i scalane
+				pair_vector pairs = randomPairs(random() % 2 ? random() % 4 : random() % 120);
+				queue.insert(pairs.begin(), pairs.end());
+				add(model, pairs);
+				break;
+			}
+			case 6:
+			{
+				pair_vector pairs = randomPairs(random() % 40);
+				queue.insertBatch(pairs);
+				add(model, pairs);
+				break;
+			}
+			case 7:
+				queue.deleteMin();
+				if (!model.empty())
+					removeMin();
+				break;
+			case 8:
+				queue.deleteMax();
+				if (!model.empty())
+					model.erase(std::prev(model.end()));
+				break;
+			case 9:
+			{
+				std::vector<std::pair<K, V>> popped;
+				std::size_t n = random() % 6;
+				queue.popMinN(n, std::back_inserter(popped));
+				check(popped.size() == std::min(n, model.size()), "popMinN count", name);
+				for (const auto& kv : popped)
+				{
+					check(!model.empty() && toModel(kv) == *model.begin(), "popMinN order", name);
+					if (!model.empty())
+						removeMin();
+				}
+				break;
+			}
+			case 10:
+			{
+				//przy kilku parach o kluczu key nie jest określone, którą zmieni changeValue
+				std::size_t count = keyCount(key);
+				if (count > 1)
+					break;
+				bool thrown = false;
+				try
+				{
+					queue.changeValue(k, v);
+				}
+				catch (const PriorityQueueNotFoundException&)
+				{
+					thrown = true;
+				}
+				check(thrown == (count == 0), "changeValue of a missing key", name);
+				for (auto it = model.begin(); it != model.end(); ++it)
+					if (it->second == key)
+					{
+						model.erase(it);
+						model.insert(model_pair(value, key));
+						break;
+					}
+				break;
+			}
+			case 11:
+				check(queue.contains(k) == (keyCount(key) != 0), "contains", name);
+				break;
+			case 12:
+			{
+				pair_vector pairs = randomPairs(random() % 2 ? random() % 4 : random() % 120);
+				Q other(pairs.begin(), pairs.end());
+				queue.merge(other);
+				check(other.empty(), "merged queue is empty", name);
+				add(model, pairs);
+				break;
+			}
+			case 13:
+			{
+				Q copy(queue);
+				check(copy == queue, "copy is equal", name);
+				Q assigned;
+				assigned = copy;
+				copy.insert(k, v);
+				verifyContents(assigned, model);
+				using std::swap;
+				swap(queue, assigned);
+				break;
+			}
+			case 14:
+			{
+				std::vector<std::pair<K, V>> pairs;
+				for (const auto& p : model)
+					pairs.emplace_back(keys<K>::make(p.second), static_cast<V>(p.first));
+				Q rebuilt(pairs.begin(), pairs.end());
+				check(rebuilt == queue && !(rebuilt != queue), "== of equal queues", name);
+				check(!(rebuilt < queue) && !(queue < rebuilt) && rebuilt <= queue && rebuilt >= queue,
+						"< of equal queues", name);
+				Q bigger(rebuilt);
+				bigger.insert(k, v);
+				check(bigger != queue && (queue < bigger) != (bigger < queue), "< of different queues", name);
+				break;
+			}
+			case 15:
+				handles(k, v, key, value, std::integral_constant<bool, has_handles>());
+				break;
+			case 16:
+				queue.compact();
+				break;
+			case 17:
+			{
+				std::stringstream stream;
+				queue.serialize(stream);
+				Q restored = Q::deserialize(stream);
+				check(restored == queue, "serialize/deserialize round trip", name);
+				break;
+			}
+			case 18:
+				saveAndMap(std::integral_constant<bool, savable>());
+				break;
+			case 19:
+			{
+				PriorityQueueParallel parallel(2);
+				pair_vector pairs = randomPairs(random() % 200);
+				queue.insert(parallel, pairs.begin(), pairs.end());
+				add(model, pairs);
+				pair_vector other_pairs = randomPairs(random() % 200);
+				Q other(parallel, other_pairs.begin(), other_pairs.end());
+				queue.merge(parallel, other);
+				add(model, other_pairs);
+				Q copy(parallel, queue);
+				check(copy == queue, "parallel copy is equal", name);
+				break;
+			}
+			case 20:
+				ranges(std::integral_constant<bool, has_iterators>());
+				break;
+			default:
+				queue.insert(k, v);
+				model.insert(model_pair(value, key));
+				break;
+			}
+		}
+
+		// usunięcie z obu końców, aż kolejka zmniejszy się do 100 par
+		void drain()
+		{
+			std::vector<std::pair<K, V>> popped;
+			std::size_t n = (model.size() - 100) / 2;
+			queue.popMinN(n, std::back_inserter(popped));
+			check(popped.size() == n, "popMinN count", name);
+			for (const auto& kv : popped)
+			{
+				check(toModel(kv) == *model.begin(), "popMinN order", name);
+				removeMin();
+			}
+			while (model.size() > 100)
+			{
+				check(queue.maxValue() == static_cast<V>(model.rbegin()->first), "maxValue", name);
+				queue.deleteMax();
+				model.erase(std::prev(model.end()));
+			}
+		}
+
+		// uchwyt nowej pary: odczyt, zmiana wartości albo usunięcie
+		void handles(const K& k, const V& v, int key, unsigned value, std::true_type)
+		{
+			typename Q::handle h = queue.insert(k, v);
+			model.insert(model_pair(value, key));
+			check(queue.key(h) == k && queue.value(h) == v, "handle of a new pair", name);
+			if (random() % 2)
+			{
+				unsigned new_value = randomValue();
+				h = queue.changeValue(h, static_cast<V>(new_value));
+				check(queue.key(h) == k && queue.value(h) == static_cast<V>(new_value), "changeValue by handle", name);
+				model.erase(model.find(model_pair(value, key)));
+				model.insert(model_pair(new_value, key));
+			}
+			else
+			{
+				queue.erase(h);
+				model.erase(model.find(model_pair(value, key)));
+			}
+		}
+
+		void handles(const K&, const V&, int, unsigned, std::false_type)
+		{ }
+
+		void saveAndMap(std::true_type)
+		{
+			std::string path = std::string("pq_differential_") + std::to_string(random()) + ".bin";
+			queue.save(path);
+			Q mapped = Q::mapFrom(path);
+			std::remove(path.c_str());
+			check(mapped == queue, "save/mapFrom round trip", name);
+		}
+
+		void saveAndMap(std::false_type)
+		{ }
+
+		// zakresy po kluczu i po wartości zgodne z modelem
+		void ranges(std::true_type)
+		{
+			int lo_key = randomKey();
+			int hi_key = randomKey();
+			std::size_t expected = 0;
+			for (const auto& p : model)
+				expected += lo_key <= p.second && p.second < hi_key;
+			std::size_t count = 0;
+			for (const auto& kv : queue.rangeByKey(keys<K>::make(lo_key), keys<K>::make(hi_key)))
+			{
+				int id = keys<K>::id(kv.first);
+				check(lo_key <= id && id < hi_key, "rangeByKey bounds", name);
+				++count;
+			}
+			check(count == expected, "rangeByKey count", name);
+
+			unsigned lo_value = randomValue();
+			unsigned hi_value = randomValue();
+			expected = 0;
+			for (const auto& p : model)
+				expected += lo_value <= p.first && p.first < hi_value;
+			count = 0;
+			for (const auto& kv : queue.rangeByValue(static_cast<V>(lo_value), static_cast<V>(hi_value)))
+			{
+				check(lo_value <= kv.second && kv.second < hi_value, "rangeByValue bounds", name);
+				++count;
+			}
+			check(count == expected, "rangeByValue count", name);
+		}
+
+		void ranges(std::false_type)
+		{ }
+
+		void verifyEnds()
+		{
+			check(queue.size() == model.size() && queue.empty() == model.empty(), "size", name);
+			if (model.empty())
+				return;
+			check(queue.minValue() == static_cast<V>(model.begin()->first) &&
+					keys<K>::id(queue.minKey()) == model.begin()->second, "minValue/minKey", name);
+			check(queue.maxValue() == static_cast<V>(model.rbegin()->first) &&
+					keys<K>::id(queue.maxKey()) == model.rbegin()->second, "maxValue/maxKey", name);
+		}
+
+		// wszystkie pary q w porządku po wartości (przez popMinN na kopii) i po kluczu (iteratory)
+		void verifyContents(const Q& q, const model_type& m)
+		{
+			Q copy(q);
+			std::vector<std::pair<K, V>> popped;
+			copy.popMinN(q.size(), std::back_inserter(popped));
+			std::vector<model_pair> by_value;
+			for (const auto& kv : popped)
+				by_value.push_back(toModel(kv));
+			check(by_value == std::vector<model_pair>(m.begin(), m.end()), "contents by value", name);
+			check(copy.empty(), "popMinN of everything", name);
+			verifyKeyOrder(q, m, std::integral_constant<bool, has_iterators>());
+		}
+
+		void verifyKeyOrder(const Q& q, const model_type& m, std::true_type)
+		{
+			std::multiset<std::pair<int, unsigned>> by_key;
+			for (const auto& p : m)
+				by_key.insert(std::make_pair(p.second, p.first));
+			std::vector<std::pair<int, unsigned>> iterated;
+			for (const auto& kv : q.byKey())
+				iterated.emplace_back(keys<K>::id(kv.first), static_cast<unsigned>(kv.second));
+			check(iterated == std::vector<std::pair<int, unsigned>>(by_key.begin(), by_key.end()),
+					"contents by key", name);
+			std::vector<model_pair> by_value;
+			for (const auto& kv : q.byValue())
+				by_value.push_back(toModel(kv));
+			check(by_value == std::vector<model_pair>(m.begin(), m.end()), "byValue", name);
+		}
+
+		void verifyKeyOrder(const Q& q, const model_type& m, std::false_type)
+		{
+			for (const auto& p : m)
+				check(q.contains(keys<K>::make(p.second)), "contains of a stored key", name);
+		}
+	};
+
+	template<typename K, typename Policy>
+	void checkQueue(const char* name)
+	{
+		typedef PriorityQueue<K, unsigned, std::allocator<std::pair<K, unsigned>>, Policy> Q;
+		for (unsigned seed = 1; seed <= 3; ++seed)
+			differential<Q>(name, seed).run(2000);
+	}
+}
+
+
+int main()
+{
+	checkQueue<int, PriorityQueueDefaultPolicy>("Tree");
+	checkQueue<std::string, PriorityQueueDefaultPolicy>("Tree<string>");
+	checkQueue<int, duplicates_policy>("Tree count_duplicates");
+	checkQueue<std::string, duplicates_policy>("Tree<string> count_duplicates");
+	checkQueue<int, lazy_policy>("Tree lazy_deletion");
+	checkQueue<std::string, basic_policy>("Tree<string> basic_guarantee");
+	checkQueue<int, stats_policy>("Tree collect_stats");
+	checkQueue<std::string, prefix_policy>("Tree<string> key_prefix");
+	checkQueue<int, engine_policy<PriorityQueueHeapEngine<>>>("Heap<2>");
+	checkQueue<std::string, engine_policy<PriorityQueueHeapEngine<4>>>("Heap<4><string>");
+	checkQueue<int, engine_policy<PriorityQueuePairingEngine>>("Pairing");
+	checkQueue<std::string, engine_policy<PriorityQueuePairingEngine>>("Pairing<string>");
+	checkQueue<int, engine_policy<PriorityQueueHashEngine<>>>("Hash");
+	checkQueue<std::string, engine_policy<PriorityQueueHashEngine<>>>("Hash<string>");
+	checkQueue<int, PriorityQueueMonotonePolicy>("Radix");
+	checkQueue<std::string, PriorityQueueMonotonePolicy>("Radix<string>");
+	checkQueue<int, engine_policy<PriorityQueueCopyOnWriteEngine<>>>("CopyOnWrite<Tree>");
+	checkQueue<int, engine_policy<PriorityQueueCopyOnWriteEngine<PriorityQueueHeapEngine<3>>>>("CopyOnWrite<Heap<3>>");
+
+	if (failures != 0)
+		return EXIT_FAILURE;
+	std::cout << "all checks passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,730 @@
+// Wyjątki wstrzykiwane w kopiowanie i przypisanie kluczy i wartości, ich porównania (wersja fragile<true>)
+// i alokacje, po kolei w każdym punkcie, w którym operacja może rzucić, dla każdego silnika i polityki
+// po wyjątku kolejka (i druga kolejka merge, przypisania i porównania) ma mieć dokładnie dawną zawartość
+// (strong guarantee), a przy basic_guarantee - być poprawna, a merge nie może zgubić ani podwoić pary;
+// po zakończeniu nie może zostać żaden klucz, wartość ani blok pamięci
+// fragile<false> ma porównania noexcept, więc silniki wybierają ścieżki bez dzienników cofania
+//
+// budowa:       cmake -S test -B build/test && cmake --build build/test
+// uruchomienie: ctest --test-dir build/test --output-on-failure
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "priorityqueue.hh"
+
+
+namespace
+{
+	int failures = 0;
+
+	void check(bool condition, const char* what, const char* queue)
+	{
+		if (!condition)
+		{
+			std::cerr << queue << ": " << what << " failed\n";
+			++failures;
+		}
+	}
+
+	struct injected
+	{ };
+
+	// liczba punktów, które jeszcze przepuszczamy bez wyjątku (-1 - bez wstrzykiwania); atomowa,
+	// bo operacje z PriorityQueueParallel kopiują i porównują pary na kilku wątkach
+	std::atomic<long> countdown(-1);
+	std::atomic<long> live_objects(0);
+	std::atomic<long> live_blocks(0);
+
+	void injectionPoint()
+	{
+		if (countdown.load() >= 0 && countdown.fetch_sub(1) == 0)
+			throw injected();
+	}
+
+	template<bool Comparisons>
+	struct fragile
+	{
+		int x;
+
+		explicit fragile(int x) noexcept : x(x)
+		{
+			++live_objects;
+		}
+
+		fragile(const fragile& f) : x(f.x)
+		{
+			injectionPoint();
+			++live_objects;
+		}
+
+		fragile(fragile&& f) noexcept : x(f.x)
+		{
+			++live_objects;
+		}
+
+		fragile& operator=(const fragile& f)
+		{
+			injectionPoint();
+			x = f.x;
+			return *this;
+		}
+
+		fragile& operator=(fragile&& f) noexcept
+		{
+			x = f.x;
+			return *this;
+		}
+
+		~fragile()
+		{
+			--live_objects;
+		}
+
+		friend bool operator==(const fragile& a, const fragile& b) noexcept(!Comparisons)
+		{
+			if (Comparisons)
+				injectionPoint();
+			return a.x == b.x;
+		}
+
+		friend bool operator<(const fragile& a, const fragile& b) noexcept(!Comparisons)
+		{
+			if (Comparisons)
+				injectionPoint();
+			return a.x < b.x;
+		}
+	};
+
+	struct fragile_hash
+	{
+		template<bool Comparisons>
+		std::size_t operator()(const fragile<Comparisons>& f) const noexcept
+		{
+			return std::hash<int>()(f.x);
+		}
+	};
+
+	// alokator zliczający zajęte bloki, też z punktem wstrzykiwania
+	template<typename T>
+	struct counting_allocator
+	{
+		typedef T value_type;
+		typedef std::true_type is_always_equal;
+		typedef std::true_type propagate_on_container_copy_assignment;
+		typedef std::true_type propagate_on_container_move_assignment;
+		typedef std::true_type propagate_on_container_swap;
+
+		counting_allocator() noexcept
+		{ }
+
+		template<typename U>
+		counting_allocator(const counting_allocator<U>&) noexcept
+		{ }
+
+		T* allocate(std::size_t n)
+		{
+			injectionPoint();
+			T* p = std::allocator<T>().allocate(n);
+			++live_blocks;
+			return p;
+		}
+
+		void deallocate(T* p, std::size_t n) noexcept
+		{
+			--live_blocks;
+			std::allocator<T>().deallocate(p, n);
+		}
+
+		template<typename U>
+		bool operator==(const counting_allocator<U>&) const noexcept
+		{
+			return true;
+		}
+
+		template<typename U>
+		bool operator!=(const counting_allocator<U>&) const noexcept
+		{
+			return false;
+		}
+	};
+}
+
+template<bool Comparisons>
+struct PriorityQueueSerializer<fragile<Comparisons>>
+{
+	static void write(std::string& out, const fragile<Comparisons>& f)
+	{
+		PriorityQueueSerializer<int>::write(out, f.x);
+	}
+
+	static fragile<Comparisons> read(const char*& first, const char* last)
+	{
+		return fragile<Comparisons>(PriorityQueueSerializer<int>::read(first, last));
+	}
+};
+
+namespace
+{
+	template<typename Engine>
+	struct engine_policy : PriorityQueueDefaultPolicy
+	{
+		typedef Engine engine;
+	};
+
+	struct duplicates_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool count_duplicates = true;
+	};
+
+	struct lazy_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool lazy_deletion = true;
+	};
+
+	struct basic_policy : PriorityQueueDefaultPolicy
+	{
+		static const bool basic_guarantee = true;
+	};
+
+	template<typename T>
+	struct numbers;
+
+	template<bool Comparisons>
+	struct numbers<fragile<Comparisons>>
+	{
+		static fragile<Comparisons> make(int x)
+		{
+			return fragile<Comparisons>(x);
+		}
+
+		static int get(const fragile<Comparisons>& f)
+		{
+			return f.x;
+		}
+	};
+
+	template<>
+	struct numbers<unsigned>
+	{
+		static unsigned make(int x)
+		{
+			return static_cast<unsigned>(x);
+		}
+
+		static int get(unsigned x)
+		{
+			return static_cast<int>(x);
+		}
+	};
+
+	// model: pary (wartość, klucz) w porządku kolejki po wartości
+	typedef std::pair<int, int> model_pair;
+	typedef std::multiset<model_pair> model_type;
+
+	template<typename Q>
+	class injection
+	{
+		typedef typename Q::key_type K;
+		typedef typename Q::value_type V;
+		typedef std::vector<std::pair<K, V>> pair_vector;
+
+		static const bool has_handles = !std::is_same<typename Q::handle, pq_detail::no_handle>::value;
+		static const bool has_iterators = !std::is_same<typename Q::key_iterator, pq_detail::no_iterator>::value;
+		static const bool basic = pq_detail::relaxes_guarantee<typename Q::policy_type>::value;
+
+	public:
+		injection(const char* name, unsigned seed) : name(name), random(seed)
+		{ }
+
+		void run(int steps)
+		{
+			for (int step = 0; step < steps; ++step)
+				this->step();
+			verify(queue, model, "final contents");
+		}
+
+	private:
+		const char* name;
+		std::mt19937 random;
+		Q queue;
+		model_type model;
+		// ostatnio usunięte minimum (polityka monotone) i jego nowa wartość po udanej operacji
+		int floor = 0;
+		int next_floor = 0;
+
+		int randomKey()
+		{
+			return static_cast<int>(random() % 20);
+		}
+
+		int randomValue()
+		{
+			return floor + static_cast<int>(random() % 20);
+		}
+
+		static model_pair toModel(const std::pair<K, V>& kv)
+		{
+			return model_pair(numbers<V>::get(kv.second), numbers<K>::get(kv.first));
+		}
+
+		pair_vector randomPairs(std::size_t n)
+		{
+			pair_vector pairs;
+			pairs.reserve(n);
+			for (std::size_t i = 0; i < n; ++i)
+				pairs.emplace_back(numbers<K>::make(randomKey()), numbers<V>::make(randomValue()));
+			return pairs;
+		}
+
+		static void add(model_type& m, const pair_vector& pairs)
+		{
+			for (const auto& kv : pairs)
+				m.insert(toModel(kv));
+		}
+
+		static model_type modelOf(const pair_vector& pairs)
+		{
+			model_type m;
+			add(m, pairs);
+			return m;
+		}
+
+		std::size_t keyCount(int key) const
+		{
+			std::size_t count = 0;
+			for (const auto& p : model)
+				count += p.second == key;
+			return count;
+		}
+
+		void removeMin(model_type& m)
+		{
+			next_floor = m.begin()->first;
+			m.erase(m.begin());
+		}
+
+		// zawartość q (bez wstrzykiwania): pary w porządku po wartości z popMinN na kopii, sprawdzone
+		// z size, końcami kolejki i porządkiem po kluczu (operator== z kolejką zbudowaną od nowa)
+		model_type contentsOf(const Q& q, const char* what)
+		{
+			Q copy(q);
+			pair_vector popped;
+			copy.popMinN(q.size(), std::back_inserter(popped));
+			model_type m;
+			std::vector<model_pair> order;
+			for (const auto& kv : popped)
+			{
+				m.insert(toModel(kv));
+				order.push_back(toModel(kv));
+			}
+			check(std::vector<model_pair>(m.begin(), m.end()) == order, what, name);
+			check(q.size() == m.size() && copy.empty(), what, name);
+			if (!m.empty())
+				check(numbers<V>::get(q.minValue()) == m.begin()->first &&
+						numbers<K>::get(q.minKey()) == m.begin()->second &&
+						numbers<V>::get(q.maxValue()) == m.rbegin()->first &&
+						numbers<K>::get(q.maxKey()) == m.rbegin()->second, what, name);
+			Q rebuilt(popped.begin(), popped.end());
+			check(rebuilt == q, what, name);
+			for (const auto& p : m)
+				check(q.contains(numbers<K>::make(p.second)), what, name);
+			return m;
+		}
+
+		void verify(const Q& q, const model_type& m, const char* what)
+		{
+			check(contentsOf(q, what) == m, what, name);
+		}
+
+		// op(work, expected, arm) na kopiach kolejki: op przygotowuje argumenty, wywołuje arm() i wykonuje
+		// operację, a po niej uzupełnia expected; wyjątek wstrzykujemy w n-tym punkcie po arm(),
+		// n = 0, 1, ..., aż operacja się uda; expected z chwili arm() to zawartość sprzed operacji
+		template<typename Op>
+		void inject(const char* what, Op op)
+		{
+			for (long n = 0; n < 1000000; ++n)
+			{
+				Q work(queue);
+				model_type expected(model);
+				model_type before;
+				next_floor = floor;
+				bool done = false;
+				try
+				{
+					op(work, expected, [&] { before = expected; countdown = n; });
+					done = true;
+				}
+				catch (const injected&)
+				{ }
+				countdown = -1;
+				if (done)
+				{
+					verify(work, expected, what);
+					queue = std::move(work);
+					model = std::move(expected);
+					floor = next_floor;
+					return;
+				}
+				if (basic)
+					contentsOf(work, what);
+				else
+					verify(work, before, what);
+			}
+			check(false, "operation completes", name);
+		}
+
+		void step()
+		{
+			//kolejka rośnie, więc co jakiś czas wyjmujemy (bez wstrzykiwania) połowę par
+			if (model.size() > 24)
+			{
+				pair_vector popped;
+				queue.popMinN(12, std::back_inserter(popped));
+				for (std::size_t i = 0; i < popped.size(); ++i)
+					removeMin(model);
+				floor = next_floor;
+				return;
+			}
+
+			int key = randomKey();
+			int value = randomValue();
+
+			switch (random() % 20)
+			{
+			case 0:
+				inject("insert", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					K k = numbers<K>::make(key);
+					V v = numbers<V>::make(value);
+					arm();
+					q.insert(k, v);
+					m.insert(model_pair(value, key));
+				});
+				break;
+			case 1:
+				inject("emplace", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.emplace(numbers<K>::make(key), numbers<V>::make(value));
+					m.insert(model_pair(value, key));
+				});
+				break;
+			case 2:
+			{
+				std::size_t capacity = model.size() + random() % 2;
+				inject("insertKeepingSmallest", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					K k = numbers<K>::make(key);
+					V v = numbers<V>::make(value);
+					arm();
+					if (!q.insertKeepingSmallest(k, v, capacity))
+						return;
+					if (m.size() == capacity)
+						m.erase(std::prev(m.end()));
+					m.insert(model_pair(value, key));
+				});
+				break;
+			}
+			case 3:
+			{
+				std::size_t capacity = model.size() + random() % 2;
+				inject("insertKeepingLargest", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					K k = numbers<K>::make(key);
+					V v = numbers<V>::make(value);
+					arm();
+					if (!q.insertKeepingLargest(k, v, capacity))
+						return;
+					if (m.size() == capacity)
+						removeMin(m);
+					m.insert(model_pair(value, key));
+				});
+				break;
+			}
+			case 4:
+			{
+				//małe partie wstawiane po jednej, duże - sortowane i scalane
+				pair_vector pairs = randomPairs(random() % 2 ? 3 : 20);
+				inject("insert(first, last)", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.insert(pairs.begin(), pairs.end());
+					add(m, pairs);
+				});
+				break;
+			}
+			case 5:
+			{
+				pair_vector pairs = randomPairs(random() % 10);
+				inject("insertBatch", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.insertBatch(pairs);
+					add(m, pairs);
+				});
+				break;
+			}
+			case 6:
+				inject("deleteMin", [this](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.deleteMin();
+					if (!m.empty())
+						removeMin(m);
+				});
+				break;
+			case 7:
+				inject("deleteMax", [](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.deleteMax();
+					if (!m.empty())
+						m.erase(std::prev(m.end()));
+				});
+				break;
+			case 8:
+			{
+				std::size_t n = random() % 6;
+				inject("popMinN", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					pair_vector popped;
+					popped.reserve(n);
+					arm();
+					q.popMinN(n, std::back_inserter(popped));
+					for (std::size_t i = 0; i < popped.size(); ++i)
+						removeMin(m);
+				});
+				break;
+			}
+			case 9:
+			{
+				//przy kilku parach o kluczu key nie jest określone, którą zmieni changeValue
+				if (keyCount(key) != 1)
+					break;
+				inject("changeValue", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					K k = numbers<K>::make(key);
+					V v = numbers<V>::make(value);
+					arm();
+					q.changeValue(k, v);
+					for (auto it = m.begin(); it != m.end(); ++it)
+						if (it->second == key)
+						{
+							m.erase(it);
+							break;
+						}
+					m.insert(model_pair(value, key));
+				});
+				break;
+			}
+			case 10:
+				changeByHandle(key, value, std::integral_constant<bool, has_handles>());
+				break;
+			case 11:
+			case 12:
+			{
+				pair_vector pairs = randomPairs(random() % 2 ? 3 : 20);
+				bool parallel = random() % 4 == 0;
+				inject("merge", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					Q other(pairs.begin(), pairs.end());
+					arm();
+					try
+					{
+						if (parallel)
+							q.merge(PriorityQueueParallel(2), other);
+						else
+							q.merge(other);
+					}
+					catch (const injected&)
+					{
+						//bez wstrzykiwania sprawdzamy drugą kolejkę: przy basic_guarantee każda para
+						//jest w dokładnie jednej z kolejek
+						countdown = -1;
+						if (basic)
+						{
+							model_type both = contentsOf(q, "merge (this)");
+							model_type rest = contentsOf(other, "merge (other)");
+							both.insert(rest.begin(), rest.end());
+							model_type expected = model;
+							add(expected, pairs);
+							check(both == expected, "merge keeps every pair once", name);
+						}
+						else
+							verify(other, modelOf(pairs), "merge (other)");
+						throw;
+					}
+					check(other.empty(), "merged queue is empty", name);
+					add(m, pairs);
+				});
+				break;
+			}
+			case 13:
+			{
+				pair_vector pairs = randomPairs(random() % 20);
+				inject("insert(parallel)", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					q.insert(PriorityQueueParallel(2), pairs.begin(), pairs.end());
+					add(m, pairs);
+				});
+				break;
+			}
+			case 14:
+			{
+				bool parallel = random() % 2;
+				inject("copy", [&](Q& q, model_type&, std::function<void()> arm)
+				{
+					arm();
+					if (parallel)
+					{
+						Q copy(PriorityQueueParallel(2), q);
+					}
+					else
+					{
+						Q copy(q);
+					}
+				});
+				break;
+			}
+			case 15:
+			{
+				pair_vector pairs = randomPairs(random() % 10);
+				inject("operator=", [&](Q& q, model_type&, std::function<void()> arm)
+				{
+					Q target(pairs.begin(), pairs.end());
+					arm();
+					try
+					{
+						target = q;
+					}
+					catch (const injected&)
+					{
+						countdown = -1;
+						verify(target, modelOf(pairs), "operator= (target)");
+						throw;
+					}
+				});
+				break;
+			}
+			case 16:
+				inject("serialize/deserialize", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					std::stringstream stream;
+					q.serialize(stream);
+					arm();
+					Q restored = Q::deserialize(stream);
+					q = std::move(restored);
+					(void) m;
+				});
+				break;
+			case 17:
+				inject("comparisons", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					Q other(q);
+					other.insert(numbers<K>::make(key), numbers<V>::make(value));
+					arm();
+					bool equal = q == other;
+					bool less = q < other;
+					bool greater = q > other;
+					check(!equal && less != greater, "comparisons of different queues", name);
+					(void) m;
+				});
+				break;
+			case 18:
+				inject("maxValue/maxKey", [&](Q& q, model_type& m, std::function<void()> arm)
+				{
+					arm();
+					if (q.empty())
+						return;
+					V v = q.maxValue();
+					K k = q.maxKey();
+					check(model_pair(numbers<V>::get(v), numbers<K>::get(k)) == *m.rbegin(), "maxValue/maxKey", name);
+				});
+				break;
+			default:
+				inject("contains and compact", [&](Q& q, model_type&, std::function<void()> arm)
+				{
+					K k = numbers<K>::make(key);
+					arm();
+					check(q.contains(k) == (keyCount(key) != 0), "contains", name);
+					q.compact();
+				});
+				break;
+			}
+		}
+
+		// changeValue przez uchwyt nowej pary (wstawionej przed punktami wstrzykiwania)
+		void changeByHandle(int key, int value, std::true_type)
+		{
+			int new_value = randomValue();
+			inject("changeValue(handle)", [&](Q& q, model_type& m, std::function<void()> arm)
+			{
+				typename Q::handle h = q.insert(numbers<K>::make(key), numbers<V>::make(value));
+				m.insert(model_pair(value, key));
+				V v = numbers<V>::make(new_value);
+				arm();
+				q.changeValue(h, v);
+				m.erase(m.find(model_pair(value, key)));
+				m.insert(model_pair(new_value, key));
+			});
+		}
+
+		void changeByHandle(int, int, std::false_type)
+		{ }
+	};
+
+	template<typename K, typename V, typename Policy>
+	void checkQueue(const char* name)
+	{
+		typedef PriorityQueue<K, V, counting_allocator<std::pair<K, V>>, Policy> Q;
+		for (unsigned seed = 1; seed <= 2; ++seed)
+			injection<Q>(name, seed).run(200);
+		check(live_objects == 0, "no leaked keys or values", name);
+		check(live_blocks == 0, "no leaked memory", name);
+	}
+
+	template<bool Comparisons>
+	void checkAll()
+	{
+		typedef fragile<Comparisons> F;
+		checkQueue<F, F, PriorityQueueDefaultPolicy>("Tree");
+		checkQueue<F, F, duplicates_policy>("Tree count_duplicates");
+		checkQueue<F, F, lazy_policy>("Tree lazy_deletion");
+		checkQueue<F, F, basic_policy>("Tree basic_guarantee");
+		checkQueue<F, F, engine_policy<PriorityQueueHeapEngine<>>>("Heap<2>");
+		checkQueue<F, F, engine_policy<PriorityQueueHeapEngine<3>>>("Heap<3>");
+		checkQueue<F, F, engine_policy<PriorityQueuePairingEngine>>("Pairing");
+		checkQueue<F, F, engine_policy<PriorityQueueHashEngine<fragile_hash>>>("Hash");
+		checkQueue<F, unsigned, PriorityQueueMonotonePolicy>("Radix");
+		checkQueue<F, F, engine_policy<PriorityQueueCopyOnWriteEngine<>>>("CopyOnWrite<Tree>");
+		checkQueue<F, F, engine_policy<PriorityQueueCopyOnWriteEngine<PriorityQueueHeapEngine<3>>>>(
+				"CopyOnWrite<Heap<3>>");
+	}
+}
+
+
+int main()
+{
+	checkAll<true>();
+	checkAll<false>();
+
+	if (failures != 0)
+		return EXIT_FAILURE;
+	std::cout << "all checks passed\n";
+	return EXIT_SUCCESS;
+}